@@ -1,77 +1,292 @@
 #include "application.h"
 
-Application::Application() {
-  initWindow();
-  _vulkan = std::make_unique<Vulkan>(_window);
-}
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
 
-Application::~Application() {
-  glfwDestroyWindow(_window);
-  glfwTerminate();
-}
+#include "event_tracer.h"
+#include "tiled_ppm.h"
 
 using timer = std::chrono::high_resolution_clock;
-uint64_t timeFrom(const timer::time_point& timePoint) {
-  return std::chrono::duration_cast<std::chrono::milliseconds>(timer::now() - timePoint).count();
+
+Application::Application(const Settings& settings)
+    : _settings(settings),
+      _scene(settings.randomSpheres > 0 ? Scene::makeRandom(settings.randomSpheres, settings.seed) : Scene::makeDefault()) {
+  if (!_settings.traceOutput.empty()) {
+    EventTracer::get().enable();
+    EventTracer::get().setThreadName("main");
+  }
+  if (!_settings.meshFile.empty()) {
+    auto start = timer::now();
+    Mesh mesh = loadMesh(_settings.meshFile, getThreadCount(_settings));
+    std::cout << "loaded " << mesh.indices.size() / 3 << " triangles in "
+              << std::chrono::duration<double, std::milli>(timer::now() - start).count() << " ms" << std::endl;
+    _scene.addMesh(mesh, _scene.addMaterial(kDiffuseMaterial, glm::vec3(0.8f), 0.0f));
+  }
+  _scene.addRandomMotion(_settings.movingSpheres, _settings.seed);
+  if (!_settings.headless) {
+    TraceScope scope("initWindow");
+    initWindow();
+  }
+  if (_settings.offlineTileSize > 0) {
+    // Every tile starts a new accumulation, which must not trace its first frame with the moving settings
+    _settings.movingSamples = _settings.samples;
+    _settings.movingQuality = _settings.quality;
+  }
+  _vulkan = std::make_unique<Vulkan>(_window, _settings, _scene);
+}
+
+Application::~Application() {
+  _vulkan.reset();
+  if (_window != nullptr) {
+    glfwDestroyWindow(_window);
+    glfwTerminate();
+  }
 }
 
 void Application::run() {
-  float speed = 0.1;
+  if (_settings.offlineTileSize > 0) {
+    runOffline();
+    return;
+  }
+  if (_settings.headless) {
+    runHeadless();
+    return;
+  }
+
+  float speed = 2;  // Per second
   float rotationSpeed = 1. / 250;
-  int fps = 20;
+
+  FrameScheduler scheduler(_settings.pacing, _settings.targetFrameTimeMs);
 
   double mouseX, mouseY;
   glfwGetCursorPos(_window, &mouseX, &mouseY);
 
-  auto lastRender = timer::now();
+  bool idle = false;
+  bool traceKeyDown = false;
+  int previousWidth = 0;
+  int previousHeight = 0;
+  uint64_t frame = 0;
+  auto animationStart = timer::now();
   while (!glfwWindowShouldClose(_window)) {
-    glfwPollEvents();
-
-    if (timeFrom(lastRender) > 1000. / fps) {
-      int w = glfwGetKey(_window, GLFW_KEY_W);
-      int a = glfwGetKey(_window, GLFW_KEY_A);
-      int s = glfwGetKey(_window, GLFW_KEY_S);
-      int d = glfwGetKey(_window, GLFW_KEY_D);
-
-      // TODO: Refactor moving system
-      float yaw = _camera.yaw;
-      if (w == GLFW_PRESS) {
-        _camera.origin += glm::vec3(sin(yaw), 0, cos(yaw)) * speed;
+    int width, height;
+    glfwGetFramebufferSize(_window, &width, &height);
+    if (width == 0 || height == 0) {
+      // Minimized, there is nothing to present to
+      glfwWaitEvents();
+      continue;
+    }
+
+    // A resized window has to be redrawn even when nothing else changed
+    bool resized = width != previousWidth || height != previousHeight;
+    previousWidth = width;
+    previousHeight = height;
+
+    {
+      TraceScope scope("wait for frame start");
+      scheduler.waitForFrame(idle && !resized);
+    }
+    auto inputTime = FrameScheduler::Clock::now();
+    TraceScope inputScope("input");
+    float step = speed * scheduler.getFrameDelta();
+
+    int w = glfwGetKey(_window, GLFW_KEY_W);
+    int a = glfwGetKey(_window, GLFW_KEY_A);
+    int s = glfwGetKey(_window, GLFW_KEY_S);
+    int d = glfwGetKey(_window, GLFW_KEY_D);
+
+    Camera previousCamera = _camera;
+
+    // TODO: Refactor moving system
+    float yaw = _camera.yaw;
+    if (w == GLFW_PRESS) {
+      _camera.origin += glm::vec3(sin(yaw), 0, cos(yaw)) * step;
+    }
+    if (a == GLFW_PRESS) {
+      _camera.origin += glm::vec3(sin(yaw - M_PI / 2), 0, cos(yaw - M_PI / 2)) * step;
+    }
+    if (s == GLFW_PRESS) {
+      _camera.origin += glm::vec3(sin(yaw + M_PI), 0, cos(yaw + M_PI)) * step;
+    }
+    if (d == GLFW_PRESS) {
+      _camera.origin += glm::vec3(sin(yaw + M_PI  / 2), 0, cos(yaw + M_PI / 2)) * step;
+    }
+
+    // TODO: Refactor rotation system
+    double xPos, yPos;
+    glfwGetCursorPos(_window, &xPos, &yPos);
+    _camera.yaw += std::clamp((xPos - mouseX) * rotationSpeed, -0.5, 0.5);
+    _camera.pitch -= std::clamp((yPos - mouseY) * rotationSpeed, -0.5, 0.5);
+    _camera.pitch = std::clamp(_camera.pitch, -0.6f, 0.6f);
+    mouseX = xPos;
+    mouseY = yPos;
+
+    // 1, 2 and 3 switch between the draft, balanced and high quality presets
+    const Quality qualities[] = {Quality::Draft, Quality::Balanced, Quality::High};
+    for (int i = 0; i < 3; ++i) {
+      if (glfwGetKey(_window, GLFW_KEY_1 + i) == GLFW_PRESS && _settings.quality != qualities[i]) {
+        _settings.quality = qualities[i];
+        _vulkan->setQuality(qualities[i]);
       }
-      if (a == GLFW_PRESS) {
-        _camera.origin += glm::vec3(sin(yaw - M_PI / 2), 0, cos(yaw - M_PI / 2)) * speed;
+    }
+
+    bool moving = w == GLFW_PRESS || a == GLFW_PRESS || s == GLFW_PRESS || d == GLFW_PRESS;
+    bool cameraChanged = _camera != previousCamera;
+    if (cameraChanged) {
+      _vulkan->resetAccumulation();
+    }
+
+    // F12 writes what was traced so far
+    bool traceKey = glfwGetKey(_window, GLFW_KEY_F12) == GLFW_PRESS;
+    if (traceKey && !traceKeyDown && !_settings.traceOutput.empty()) {
+      EventTracer::get().write(_settings.traceOutput);
+      std::cout << "trace written to " << _settings.traceOutput << std::endl;
+    }
+    traceKeyDown = traceKey;
+
+    float animationTime = std::chrono::duration<float>(timer::now() - animationStart).count();
+    const std::vector<uint32_t>& moved = _scene.animate(animationTime);
+    _vulkan->moveSpheres(_scene.getSpheres(), moved);
+
+    _vulkan->pushConstants(_camera);  // TODO: Refactor updating camera in shader
+    inputScope.end();
+    _vulkan->drawFrame(cameraChanged ? inputTime : FrameScheduler::Clock::time_point{});
+
+    // Without accumulation or moving spheres the next frame would be identical, so sleep until there is input
+    idle = !_settings.accumulate && !moving && !cameraChanged && moved.empty();
+
+    if (_settings.profileStdout && ++frame % kProfileReportInterval == 0) {
+      _vulkan->getProfiler().print(std::cout);
+      _vulkan->getLatency().print(std::cout);
+      if (_settings.dynamicResolution) {
+        VkExtent2D extent = _vulkan->getTraceExtent();
+        std::cout << "traced resolution: " << extent.width << "x" << extent.height << std::endl;
       }
-      if (s == GLFW_PRESS) {
-        _camera.origin += glm::vec3(sin(yaw + M_PI), 0, cos(yaw + M_PI)) * speed;
+      if (_settings.adaptiveThreshold > 0.0f) {
+        std::cout << "converged pixels: " << _vulkan->getConvergedPixels() << std::endl;
       }
-      if (d == GLFW_PRESS) {
-        _camera.origin += glm::vec3(sin(yaw + M_PI  / 2), 0, cos(yaw + M_PI / 2)) * speed;
+      if (_vulkan->getCaptureWriter() != nullptr) {
+        _vulkan->getCaptureWriter()->print(std::cout);
       }
+      if (_settings.movingSpheres > 0) {
+        const SphereBvh& bvh = _vulkan->getSphereBvh();
+        std::cout << "sphere BVH: " << bvh.getDegradation() << "x its built cost, " << bvh.getRebuildCount()
+                  << " rebuilds" << std::endl;
+      }
+    }
+  }
+
+  vkDeviceWaitIdle(_vulkan->getDevice());
+  _vulkan->getLatency().print(std::cout);
+  reportProfile();
+}
+
+void Application::runHeadless() {
+  auto start = timer::now();
+  for (uint32_t frame = 0; frame < _settings.frames; ++frame) {
+    // Frames are a 60th of a second apart, however long they take
+    const std::vector<uint32_t>& moved = _scene.animate(frame / 60.0f);
+    _vulkan->moveSpheres(_scene.getSpheres(), moved);
+    _vulkan->pushConstants(_camera);
+    _vulkan->drawFrame();
 
-      // TODO: Refactor rotation system
-      double xPos, yPos;
-      glfwGetCursorPos(_window, &xPos, &yPos);
-      _camera.yaw += std::clamp((xPos - mouseX) * rotationSpeed, -0.5, 0.5);
-      _camera.pitch -= std::clamp((yPos - mouseY) * rotationSpeed, -0.5, 0.5);
-      _camera.pitch = std::clamp(_camera.pitch, -0.6f, 0.6f);
-      mouseX = xPos;
-      mouseY = yPos;
+    if (!_settings.outputPrefix.empty()) {
+      char filename[32];
+      std::snprintf(filename, sizeof(filename), "_%04u.ppm", frame);
+      TraceScope scope("saveFrame");
+      _vulkan->saveFrame(_settings.outputPrefix + filename);
+    }
+  }
+  vkDeviceWaitIdle(_vulkan->getDevice());
+
+  double seconds = std::chrono::duration<double>(timer::now() - start).count();
+  std::cout << _settings.frames << " frames in " << seconds << " s ("
+            << _settings.frames / seconds << " fps)" << std::endl;
+  reportProfile();
+}
 
-      _vulkan->pushConstants(_camera);  // TODO: Refactor updating camera in shader
+void Application::runOffline() {
+  // Everything but the resolution and tile size, which the writer checks itself, that a resumed tile depends on
+  std::ostringstream configuration;
+  configuration << "frames=" << _settings.frames << " samples=" << _settings.samples
+                << " accumulate=" << _settings.accumulate << " adaptive=" << _settings.adaptiveThreshold << "/"
+                << _settings.adaptiveMinSamples << " sampler=" << static_cast<int>(_settings.sampler)
+                << " quality=" << static_cast<int>(_settings.quality) << " moving=" << _settings.movingSamples << "/"
+                << static_cast<int>(_settings.movingQuality) << " fov=" << _settings.verticalFov
+                << " spheres=" << _settings.randomSpheres << " seed=" << _settings.seed;
+  if (!_settings.meshFile.empty()) {
+    // A mesh file changed on disk since the first tiles were traced changes the scene too
+    std::filesystem::path mesh(_settings.meshFile);
+    configuration << " mesh=" << _settings.meshFile << " size=" << std::filesystem::file_size(mesh)
+                  << " modified=" << std::filesystem::last_write_time(mesh).time_since_epoch().count();
+  }
+
+  std::string filename = _settings.outputPrefix + ".ppm";
+  TiledPpmWriter writer(filename, _settings.width, _settings.height, _settings.offlineTileSize, configuration.str());
+  if (writer.getCompletedTiles() > 0) {
+    std::cout << "resuming " << filename << " after " << writer.getCompletedTiles() << " of "
+              << writer.getTileCount() << " tiles" << std::endl;
+  }
+
+  auto start = timer::now();
+  uint32_t stride = _vulkan->getTraceExtent().width;
+  for (uint32_t index = writer.getCompletedTiles(); index < writer.getTileCount(); ++index) {
+    Tile tile = writer.getTile(index);
+    _vulkan->setTile(tile.x, tile.y);
+    for (uint32_t frame = 0; frame < _settings.frames; ++frame) {
+      _vulkan->pushConstants(_camera);
       _vulkan->drawFrame();
-      lastRender = timer::now();
     }
+    writer.writeTile(index, _vulkan->readFrame(), stride);
+    std::cout << "tile " << index + 1 << " of " << writer.getTileCount() << " written" << std::endl;
   }
+  writer.finish();
+  vkDeviceWaitIdle(_vulkan->getDevice());
 
-  vkDeviceWaitIdle(*_vulkan->getDevice());
+  double seconds = std::chrono::duration<double>(timer::now() - start).count();
+  std::cout << filename << " finished in " << seconds << " s" << std::endl;
+  reportProfile();
+}
+
+void Application::reportProfile() {
+  _vulkan->flushProfiler();
+  const GpuProfiler& profiler = _vulkan->getProfiler();
+  if (_settings.profileStdout) {
+    profiler.print(std::cout);
+  }
+  if (!_settings.profileOutput.empty()) {
+    profiler.write(_settings.profileOutput);
+  }
+  if (_settings.memoryStatistics) {
+    _vulkan->getAllocator().printStatistics(std::cout);
+  }
+  if (_settings.adaptiveThreshold > 0.0f) {
+    std::cout << "converged pixels: " << _vulkan->getConvergedPixels() << std::endl;
+  }
+  if (_vulkan->getCaptureWriter() != nullptr) {
+    _vulkan->getCaptureWriter()->print(std::cout);
+  }
+  if (!_settings.traceOutput.empty()) {
+    EventTracer::get().write(_settings.traceOutput);
+  }
+}
+
+void Application::framebufferResizeCallback(GLFWwindow* window, int width, int height) {
+  auto application = static_cast<Application*>(glfwGetWindowUserPointer(window));
+  if (application->_vulkan) {
+    application->_vulkan->notifyFramebufferResized();
+  }
 }
 
 void Application::initWindow() {
   glfwInit();
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+  glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
   _window = glfwCreateWindow(_width, _height, "Vulkan", nullptr, nullptr);
+  glfwSetWindowUserPointer(_window, this);
+  glfwSetFramebufferSizeCallback(_window, framebufferResizeCallback);
 
   glfwSetInputMode(_window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 }
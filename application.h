@@ -5,22 +5,32 @@
 #include <cstdint>
 #include <memory>
 
+#include "scene.h"
+#include "settings.h"
 #include "vulkan.h"
 
 class Application {
  public:
-  Application();
+  explicit Application(const Settings& settings);
   ~Application();
   void run();
 
  private:
-  Camera _camera;
+  const uint32_t kProfileReportInterval = 100;  // Frames between GPU timings printed to stdout
 
+  Settings _settings;
+  Scene _scene;
+  Camera _camera{};
+
+  static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
   void initWindow();
+  void runHeadless();
+  void runOffline();
+  void reportProfile();
 
   uint32_t _width = 800;
   uint32_t _height = 400;
-  GLFWwindow* _window;
+  GLFWwindow* _window = nullptr;
 
   std::unique_ptr<Vulkan> _vulkan;
 };
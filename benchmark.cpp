@@ -0,0 +1,203 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+  return sorted[std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * fraction))];
+}
+
+}  // namespace
+
+void BenchmarkResult::print(std::ostream& stream) const {
+  stream << std::fixed << std::setprecision(3)
+         << configuration << ", " << frames << " frames\n"
+         << "  fps:        " << fps << "\n"
+         << "  frame time: avg " << frameTimeAverageMs << " ms, median " << frameTimeMedianMs << " ms, p99 "
+         << frameTimeP99Ms << " ms, max " << frameTimeMaxMs << " ms\n"
+         << "  cpu time:   avg " << cpuTimeAverageMs << " ms per frame" << std::defaultfloat << std::endl;
+}
+
+void BenchmarkResult::write(const std::string& filename) const {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open " + filename + "!");
+  }
+
+  file << std::setprecision(9)
+       << "configuration " << configuration << "\n"
+       << "frames " << frames << "\n"
+       << "fps " << fps << "\n"
+       << "frame_time_avg_ms " << frameTimeAverageMs << "\n"
+       << "frame_time_median_ms " << frameTimeMedianMs << "\n"
+       << "frame_time_p99_ms " << frameTimeP99Ms << "\n"
+       << "frame_time_max_ms " << frameTimeMaxMs << "\n"
+       << "cpu_time_avg_ms " << cpuTimeAverageMs << "\n";
+}
+
+BenchmarkResult BenchmarkResult::read(const std::string& filename) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open " + filename + "!");
+  }
+
+  BenchmarkResult result;
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream stream(line);
+    std::string key;
+    if (!(stream >> key)) {
+      continue;
+    }
+    if (key == "configuration") {
+      std::getline(stream >> std::ws, result.configuration);
+    } else if (key == "frames") {
+      stream >> result.frames;
+    } else if (key == "fps") {
+      stream >> result.fps;
+    } else if (key == "frame_time_avg_ms") {
+      stream >> result.frameTimeAverageMs;
+    } else if (key == "frame_time_median_ms") {
+      stream >> result.frameTimeMedianMs;
+    } else if (key == "frame_time_p99_ms") {
+      stream >> result.frameTimeP99Ms;
+    } else if (key == "frame_time_max_ms") {
+      stream >> result.frameTimeMaxMs;
+    } else if (key == "cpu_time_avg_ms") {
+      stream >> result.cpuTimeAverageMs;
+    }
+    if (stream.fail()) {
+      throw std::runtime_error("invalid line '" + line + "' in " + filename + "!");
+    }
+  }
+  return result;
+}
+
+std::string describeConfiguration(const Settings& settings) {
+  std::ostringstream stream;
+  stream << settings.width << "x" << settings.height << " samples=" << settings.samples
+         << " backend=" << (settings.backend == Backend::Compute ? "compute" : "fragment")
+         << " spheres=" << settings.randomSpheres << " seed=" << settings.seed
+         << " accumulate=" << (settings.accumulate ? 1 : 0);
+  const char* samplerNames[] = {"random", "sobol", "blue-noise"};
+  stream << " sampler=" << samplerNames[static_cast<int>(settings.sampler)];
+  const char* qualityNames[] = {"draft", "balanced", "high"};
+  stream << " quality=" << qualityNames[static_cast<int>(settings.quality)];
+  if (settings.accumulate) {
+    stream << " moving-quality=" << qualityNames[static_cast<int>(settings.movingQuality)];
+  }
+  if (settings.verticalFov != 90.0f) {
+    stream << " fov=" << settings.verticalFov;
+  }
+  if (settings.dynamicResolution) {
+    stream << " budget=" << settings.frameBudgetMs << "ms";
+  }
+  if (!settings.meshFile.empty()) {
+    stream << " mesh=" << settings.meshFile;
+  }
+  if (settings.movingSpheres > 0) {
+    stream << " moving=" << settings.movingSpheres << " rebuild=" << settings.rebuildThreshold;
+  }
+  if (settings.denoise) {
+    stream << " denoise";
+  }
+  if (settings.adaptiveThreshold > 0.0f) {
+    stream << " adaptive=" << settings.adaptiveThreshold;
+  }
+  if (settings.asyncCompute) {
+    stream << " async";
+  }
+  return stream.str();
+}
+
+BenchmarkResult runBenchmark(Vulkan& vulkan, Scene& scene, const CameraPath& path, uint32_t frames,
+                             uint32_t warmupFrames) {
+  using Clock = std::chrono::steady_clock;
+
+  std::vector<double> frameTimes;
+  frameTimes.reserve(frames);
+  Camera previousCamera = path.at(0.0f);
+  std::clock_t cpuStart = 0;
+  auto start = Clock::now();
+  auto lastFrame = start;
+  for (uint32_t frame = 0; frame < warmupFrames + frames; ++frame) {
+    if (frame == warmupFrames) {
+      vkDeviceWaitIdle(vulkan.getDevice());
+      cpuStart = std::clock();
+      start = Clock::now();
+      lastFrame = start;
+    }
+
+    // Warmup frames already follow the path so the first measured frame is not a cold start
+    uint32_t pathFrame = frame < warmupFrames ? frame % std::max(1u, frames) : frame - warmupFrames;
+    Camera camera = path.at(frames > 1 ? static_cast<float>(pathFrame) / (frames - 1) : 0.0f);
+    if (camera != previousCamera) {
+      vulkan.resetAccumulation();
+      previousCamera = camera;
+    }
+    const std::vector<uint32_t>& moved = scene.animate(frame / 60.0f);
+    vulkan.moveSpheres(scene.getSpheres(), moved);
+    vulkan.pushConstants(camera);
+    vulkan.drawFrame();
+
+    if (frame >= warmupFrames) {
+      auto now = Clock::now();
+      frameTimes.push_back(std::chrono::duration<double, std::milli>(now - lastFrame).count());
+      lastFrame = now;
+    }
+  }
+  // The last frames in flight belong to the measurement as well
+  vkDeviceWaitIdle(vulkan.getDevice());
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  double cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+  BenchmarkResult result;
+  result.frames = frames;
+  if (frames == 0) {
+    return result;
+  }
+
+  std::vector<double> sorted = frameTimes;
+  std::sort(sorted.begin(), sorted.end());
+  double sum = 0.0;
+  for (double frameTime : sorted) {
+    sum += frameTime;
+  }
+  result.fps = frames / seconds;
+  result.frameTimeAverageMs = sum / frames;
+  result.frameTimeMedianMs = percentile(sorted, 0.5);
+  result.frameTimeP99Ms = percentile(sorted, 0.99);
+  result.frameTimeMaxMs = sorted.back();
+  result.cpuTimeAverageMs = cpuSeconds * 1000.0 / frames;
+  return result;
+}
+
+std::vector<std::string> findRegressions(const BenchmarkResult& result, const BenchmarkResult& baseline, float thresholdPercent) {
+  std::vector<std::string> regressions;
+  double tolerance = 1.0 + thresholdPercent / 100.0;
+
+  auto checkLower = [&](const char* name, double value, double baselineValue) {
+    if (baselineValue > 0.0 && value * tolerance < baselineValue) {
+      regressions.push_back(name);
+    }
+  };
+  auto checkHigher = [&](const char* name, double value, double baselineValue) {
+    if (baselineValue > 0.0 && value > baselineValue * tolerance) {
+      regressions.push_back(name);
+    }
+  };
+
+  checkLower("fps", result.fps, baseline.fps);
+  checkHigher("frame_time_avg_ms", result.frameTimeAverageMs, baseline.frameTimeAverageMs);
+  checkHigher("frame_time_median_ms", result.frameTimeMedianMs, baseline.frameTimeMedianMs);
+  checkHigher("frame_time_p99_ms", result.frameTimeP99Ms, baseline.frameTimeP99Ms);
+  checkHigher("cpu_time_avg_ms", result.cpuTimeAverageMs, baseline.cpuTimeAverageMs);
+  return regressions;
+}
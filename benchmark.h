@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "camera_path.h"
+#include "vulkan.h"
+
+struct BenchmarkResult {
+  std::string configuration;  // Resolution, samples, backend and scene, baselines are only comparable if it matches
+  uint32_t frames = 0;
+  double fps = 0.0;
+  double frameTimeAverageMs = 0.0;
+  double frameTimeMedianMs = 0.0;
+  double frameTimeP99Ms = 0.0;
+  double frameTimeMaxMs = 0.0;
+  double cpuTimeAverageMs = 0.0;  // Process CPU time, including driver threads
+
+  void print(std::ostream& stream) const;
+  void write(const std::string& filename) const;
+  static BenchmarkResult read(const std::string& filename);
+};
+
+std::string describeConfiguration(const Settings& settings);
+
+// Replays path over frames frames after warmupFrames unmeasured ones, drawing through pushConstants/drawFrame. The
+// moving spheres of scene are animated at 60 frames per second.
+BenchmarkResult runBenchmark(Vulkan& vulkan, Scene& scene, const CameraPath& path, uint32_t frames,
+                             uint32_t warmupFrames);
+
+// Names every metric of result that is worse than baseline by more than thresholdPercent
+std::vector<std::string> findRegressions(const BenchmarkResult& result, const BenchmarkResult& baseline, float thresholdPercent);
@@ -0,0 +1,84 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+#include "benchmark.h"
+#include "camera_path.h"
+#include "event_tracer.h"
+#include "scene.h"
+#include "settings.h"
+#include "vulkan.h"
+
+namespace {
+
+constexpr int kExitRegression = 2;
+
+int run(int argc, char** argv) {
+  Settings defaults;
+  defaults.frames = 300;
+  Settings settings = parseSettings(argc, argv, defaults);
+  // Replays are rendered offscreen so neither a compositor nor the display refresh rate skews them
+  settings.headless = true;
+  if (!settings.traceOutput.empty()) {
+    EventTracer::get().enable();
+    EventTracer::get().setThreadName("main");
+  }
+
+  CameraPath path = settings.cameraPath.empty() ? CameraPath::makeDefault() : CameraPath::load(settings.cameraPath);
+  Scene scene = settings.randomSpheres > 0 ? Scene::makeRandom(settings.randomSpheres, settings.seed) : Scene::makeDefault();
+  if (!settings.meshFile.empty()) {
+    auto start = std::chrono::steady_clock::now();
+    Mesh mesh = loadMesh(settings.meshFile, getThreadCount(settings));
+    std::cout << "loaded " << mesh.indices.size() / 3 << " triangles in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms"
+              << std::endl;
+    scene.addMesh(mesh, scene.addMaterial(kDiffuseMaterial, glm::vec3(0.8f), 0.0f));
+  }
+  scene.addRandomMotion(settings.movingSpheres, settings.seed);
+  Vulkan vulkan(nullptr, settings, scene);
+
+  BenchmarkResult result = runBenchmark(vulkan, scene, path, settings.frames, settings.warmupFrames);
+  result.configuration = describeConfiguration(settings);
+  result.print(std::cout);
+  if (!settings.traceOutput.empty()) {
+    vulkan.flushProfiler();
+    EventTracer::get().write(settings.traceOutput);
+  }
+
+  if (!settings.saveBaseline.empty()) {
+    result.write(settings.saveBaseline);
+  }
+  if (settings.baseline.empty()) {
+    return EXIT_SUCCESS;
+  }
+
+  BenchmarkResult baseline = BenchmarkResult::read(settings.baseline);
+  if (baseline.configuration != result.configuration) {
+    std::cerr << "warning: baseline was recorded with " << baseline.configuration << std::endl;
+  }
+  auto regressions = findRegressions(result, baseline, settings.regressionThreshold);
+  if (regressions.empty()) {
+    std::cout << "no regressions against " << settings.baseline << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  std::cout << "regressions beyond " << settings.regressionThreshold << "% against " << settings.baseline << ":";
+  for (const auto& regression : regressions) {
+    std::cout << " " << regression;
+  }
+  std::cout << std::endl;
+  baseline.print(std::cout);
+  return kExitRegression;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  try {
+    return run(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,233 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+
+void Aabb::grow(const glm::vec3& point) {
+  min = glm::min(min, point);
+  max = glm::max(max, point);
+}
+
+void Aabb::grow(const Aabb& other) {
+  min = glm::min(min, other.min);
+  max = glm::max(max, other.max);
+}
+
+float Aabb::area() const {
+  glm::vec3 extent = max - min;
+  if (extent.x < 0 || extent.y < 0 || extent.z < 0) {
+    return 0.0f;
+  }
+  return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+glm::vec3 Aabb::center() const {
+  return (min + max) * 0.5f;
+}
+
+void Bvh::build(const std::vector<Aabb>& bounds) {
+  _nodes.clear();
+  _nodes.reserve(std::max<size_t>(1, 2 * bounds.size()));
+  _primitiveIndices.resize(bounds.size());
+  std::iota(_primitiveIndices.begin(), _primitiveIndices.end(), 0);
+
+  std::vector<glm::vec3> centers(bounds.size());
+  for (size_t i = 0; i < bounds.size(); ++i) {
+    centers[i] = bounds[i].center();
+  }
+
+  BvhNode root{};
+  root.leftOrFirst = 0;
+  root.count = bounds.size();
+  _nodes.push_back(root);
+
+  updateBounds(0, bounds);
+  subdivide(0, bounds, centers, 0);
+
+  _parents.assign(_nodes.size(), kNoParent);
+  _primitiveLeaves.resize(bounds.size());
+  _refitting.assign(_nodes.size(), false);
+  _weightedAreas = 0.0;
+  for (uint32_t index = 0; index < _nodes.size(); ++index) {
+    const BvhNode& node = _nodes[index];
+    if (node.count == 0) {
+      _parents[node.leftOrFirst] = index;
+      _parents[node.leftOrFirst + 1] = index;
+    } else {
+      for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+        _primitiveLeaves[_primitiveIndices[i]] = index;
+      }
+    }
+    _weightedAreas += getWeightedArea(node);
+  }
+}
+
+std::vector<uint32_t> Bvh::refit(const std::vector<Aabb>& bounds, const std::vector<uint32_t>& primitives) {
+  // Ancestors shared by several primitives are only collected once
+  std::vector<uint32_t> visited;
+  for (uint32_t primitive : primitives) {
+    uint32_t index = _primitiveLeaves[primitive];
+    for (; index != kNoParent && !_refitting[index]; index = _parents[index]) {
+      _refitting[index] = true;
+      visited.push_back(index);
+    }
+  }
+
+  // Children are stored after their parents, so descending order refits them first
+  if (visited.size() * 16 > _nodes.size()) {
+    // Sweeping the marks of every node is cheaper than sorting this many
+    visited.clear();
+    for (uint32_t index = _nodes.size(); index-- > 0;) {
+      if (_refitting[index]) {
+        visited.push_back(index);
+      }
+    }
+  } else {
+    std::sort(visited.begin(), visited.end(), std::greater<uint32_t>());
+  }
+  std::vector<uint32_t> changed;
+  for (uint32_t index : visited) {
+    _refitting[index] = false;
+    BvhNode& node = _nodes[index];
+    BvhNode previous = node;
+    if (node.count > 0) {
+      updateBounds(index, bounds);
+    } else {
+      const BvhNode& left = _nodes[node.leftOrFirst];
+      const BvhNode& right = _nodes[node.leftOrFirst + 1];
+      node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+      node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+    }
+    if (node.boundsMin != previous.boundsMin || node.boundsMax != previous.boundsMax) {
+      _weightedAreas += getWeightedArea(node) - getWeightedArea(previous);
+      changed.push_back(index);
+    }
+  }
+
+  std::reverse(changed.begin(), changed.end());
+  return changed;
+}
+
+const std::vector<BvhNode>& Bvh::getNodes() const {
+  return _nodes;
+}
+
+const std::vector<uint32_t>& Bvh::getPrimitiveIndices() const {
+  return _primitiveIndices;
+}
+
+float Bvh::getCost() const {
+  double rootArea = _nodes.empty() ? 0.0 : Aabb{_nodes[0].boundsMin, _nodes[0].boundsMax}.area();
+  return rootArea > 0.0 ? static_cast<float>(_weightedAreas / rootArea) : 0.0f;
+}
+
+double Bvh::getWeightedArea(const BvhNode& node) const {
+  double area = Aabb{node.boundsMin, node.boundsMax}.area();
+  return node.count > 0 ? area * node.count : area * kTraversalCost;
+}
+
+void Bvh::updateBounds(uint32_t nodeIndex, const std::vector<Aabb>& bounds) {
+  BvhNode& node = _nodes[nodeIndex];
+
+  Aabb nodeBounds;
+  for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+    nodeBounds.grow(bounds[_primitiveIndices[i]]);
+  }
+
+  node.boundsMin = nodeBounds.min;
+  node.boundsMax = nodeBounds.max;
+}
+
+void Bvh::subdivide(uint32_t nodeIndex, const std::vector<Aabb>& bounds, const std::vector<glm::vec3>& centers, int depth) {
+  uint32_t first = _nodes[nodeIndex].leftOrFirst;
+  uint32_t count = _nodes[nodeIndex].count;
+  if (count <= 1 || depth >= kMaxDepth) {
+    return;
+  }
+
+  Aabb nodeBounds{_nodes[nodeIndex].boundsMin, _nodes[nodeIndex].boundsMax};
+  Aabb centerBounds;
+  for (uint32_t i = first; i < first + count; ++i) {
+    centerBounds.grow(centers[_primitiveIndices[i]]);
+  }
+
+  int bestAxis = -1;
+  int bestSplit = 0;
+  float bestCost = std::numeric_limits<float>::infinity();
+  for (int axis = 0; axis < 3; ++axis) {
+    float axisMin = centerBounds.min[axis];
+    float axisExtent = centerBounds.max[axis] - axisMin;
+    if (axisExtent <= 0.0f) {
+      continue;
+    }
+    float scale = kBins / axisExtent;
+
+    Aabb binBounds[kBins];
+    uint32_t binCounts[kBins] = {};
+    for (uint32_t i = first; i < first + count; ++i) {
+      uint32_t primitive = _primitiveIndices[i];
+      int bin = std::min(kBins - 1, static_cast<int>((centers[primitive][axis] - axisMin) * scale));
+      binBounds[bin].grow(bounds[primitive]);
+      ++binCounts[bin];
+    }
+
+    // leftCost[i] and rightCost[i] describe the split between bin i and bin i + 1
+    float leftCost[kBins - 1];
+    Aabb leftBounds;
+    uint32_t leftCount = 0;
+    for (int i = 0; i < kBins - 1; ++i) {
+      leftBounds.grow(binBounds[i]);
+      leftCount += binCounts[i];
+      leftCost[i] = leftCount * leftBounds.area();
+    }
+
+    Aabb rightBounds;
+    uint32_t rightCount = 0;
+    for (int i = kBins - 1; i > 0; --i) {
+      rightBounds.grow(binBounds[i]);
+      rightCount += binCounts[i];
+      float cost = leftCost[i - 1] + rightCount * rightBounds.area();
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestSplit = i;
+      }
+    }
+  }
+
+  float area = nodeBounds.area();
+  if (bestAxis < 0 || area <= 0.0f || kTraversalCost + bestCost / area >= count) {
+    return;
+  }
+
+  float axisMin = centerBounds.min[bestAxis];
+  float scale = kBins / (centerBounds.max[bestAxis] - axisMin);
+  auto middle = std::partition(_primitiveIndices.begin() + first, _primitiveIndices.begin() + first + count,
+                               [&](uint32_t primitive) {
+                                 int bin = std::min(kBins - 1, static_cast<int>((centers[primitive][bestAxis] - axisMin) * scale));
+                                 return bin < bestSplit;
+                               });
+  uint32_t leftCount = middle - (_primitiveIndices.begin() + first);
+  if (leftCount == 0 || leftCount == count) {
+    return;
+  }
+
+  uint32_t leftIndex = _nodes.size();
+  BvhNode left{};
+  left.leftOrFirst = first;
+  left.count = leftCount;
+  BvhNode right{};
+  right.leftOrFirst = first + leftCount;
+  right.count = count - leftCount;
+  _nodes.push_back(left);
+  _nodes.push_back(right);
+
+  _nodes[nodeIndex].leftOrFirst = leftIndex;
+  _nodes[nodeIndex].count = 0;
+
+  updateBounds(leftIndex, bounds);
+  updateBounds(leftIndex + 1, bounds);
+  subdivide(leftIndex, bounds, centers, depth + 1);
+  subdivide(leftIndex + 1, bounds, centers, depth + 1);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+struct Aabb {
+  glm::vec3 min = glm::vec3(std::numeric_limits<float>::infinity());
+  glm::vec3 max = glm::vec3(-std::numeric_limits<float>::infinity());
+
+  void grow(const glm::vec3& point);
+  void grow(const Aabb& other);
+  float area() const;
+  glm::vec3 center() const;
+};
+
+// Mirrors BvhNode of tracer.glsl (std430). Interior nodes have count == 0 and their children stored
+// at leftOrFirst and leftOrFirst + 1, leaves reference count primitives starting at leftOrFirst.
+struct BvhNode {
+  glm::vec3 boundsMin;
+  uint32_t leftOrFirst;
+  glm::vec3 boundsMax;
+  uint32_t count;
+};
+static_assert(sizeof(BvhNode) == 32, "BvhNode must match the std430 layout of the shader");
+
+// Binned surface area heuristic BVH over arbitrary primitive bounds
+class Bvh {
+ public:
+  void build(const std::vector<Aabb>& bounds);
+  // Recomputes the bounds of the leaves holding primitives, and of their ancestors, from bounds, which hold the
+  // current bounds of every primitive. The topology is kept. Returns the nodes whose bounds changed, ascending.
+  std::vector<uint32_t> refit(const std::vector<Aabb>& bounds, const std::vector<uint32_t>& primitives);
+
+  const std::vector<BvhNode>& getNodes() const;
+  // Leaves reference primitives in this order, primitives should be uploaded reordered by it
+  const std::vector<uint32_t>& getPrimitiveIndices() const;
+  // Expected cost of a ray that hits the root under the surface area heuristic, grows as refitting loosens the tree
+  float getCost() const;
+
+ private:
+  static constexpr int kBins = 16;
+  static constexpr int kMaxDepth = 63;  // Keeps the 64 entry traversal stack of the shader from overflowing
+  static constexpr float kTraversalCost = 1.0f;  // Relative to the cost of one primitive intersection
+  static constexpr uint32_t kNoParent = ~0u;
+
+  void updateBounds(uint32_t nodeIndex, const std::vector<Aabb>& bounds);
+  void subdivide(uint32_t nodeIndex, const std::vector<Aabb>& bounds, const std::vector<glm::vec3>& centers, int depth);
+  // Area of the node weighted by what a ray entering it costs, the cost sums it over all nodes
+  double getWeightedArea(const BvhNode& node) const;
+
+  std::vector<BvhNode> _nodes;
+  std::vector<uint32_t> _primitiveIndices;
+  // Kept for refitting
+  std::vector<uint32_t> _parents;
+  std::vector<uint32_t> _primitiveLeaves;
+  std::vector<bool> _refitting;  // Marks the nodes a refit visits
+  double _weightedAreas = 0.0;
+};
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "bvh.h"
+#include "scene.h"
+#include "sphere_bvh.h"
+
+namespace {
+
+constexpr uint32_t kSphereCount = 100000;
+constexpr uint32_t kFrames = 60;  // One second of animation
+constexpr int kRebuilds = 5;
+
+using Clock = std::chrono::steady_clock;
+
+double millisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+}  // namespace
+
+// Prints how long refitting the sphere BVH and collecting its dirty ranges takes per frame as more of the spheres of a
+// large random scene move, next to a full rebuild, with how much of the buffers is uploaded and how far the tree's cost
+// drifted after a second. Refitting never rebuilds here.
+int main() {
+  Scene scene = Scene::makeRandom(kSphereCount, 1);
+  std::vector<Aabb> bounds = scene.getSphereBounds();
+
+  std::vector<double> rebuildTimes;
+  for (int i = 0; i < kRebuilds; ++i) {
+    auto start = Clock::now();
+    Bvh bvh;
+    bvh.build(bounds);
+    rebuildTimes.push_back(millisecondsSince(start));
+  }
+  std::sort(rebuildTimes.begin(), rebuildTimes.end());
+  double rebuildMs = rebuildTimes[kRebuilds / 2];
+  size_t fullBytes = SphereBvh(scene.getSpheres(), 1.0f).getNodes().size() * sizeof(BvhNode) +
+                     scene.getSpheres().size() * sizeof(Sphere);
+
+  std::cout << kSphereCount + 1 << " spheres, full rebuild " << rebuildMs << " ms, full upload "
+            << fullBytes / 1024 << " KiB" << std::endl
+            << std::setw(8) << "moving" << std::setw(12) << "refit ms" << std::setw(12) << "speedup" << std::setw(14)
+            << "dirty nodes" << std::setw(12) << "upload KiB" << std::setw(12) << "cost 1 s" << std::endl
+            << std::fixed;
+  for (uint32_t moving = 10; moving <= kSphereCount; moving *= 10) {
+    Scene animated = scene;
+    animated.addRandomMotion(moving, 2);
+    SphereBvh bvh(animated.getSpheres(), std::numeric_limits<float>::infinity());
+
+    double refitMs = 0.0;
+    size_t dirtyNodes = 0;
+    size_t uploadBytes = 0;
+    for (uint32_t frame = 1; frame <= kFrames; ++frame) {
+      const std::vector<uint32_t>& moved = animated.animate(frame / 60.0f);
+      auto start = Clock::now();
+      bvh.update(animated.getSpheres(), moved);
+      std::vector<SphereBvh::Range> spheres = bvh.takeDirtySpheres();
+      std::vector<SphereBvh::Range> nodes = bvh.takeDirtyNodes();
+      refitMs += millisecondsSince(start);
+
+      for (const SphereBvh::Range& range : spheres) {
+        uploadBytes += range.count * sizeof(Sphere);
+      }
+      for (const SphereBvh::Range& range : nodes) {
+        dirtyNodes += range.count;
+        uploadBytes += range.count * sizeof(BvhNode);
+      }
+    }
+
+    refitMs /= kFrames;
+    std::cout << std::setw(8) << moving << std::setprecision(3) << std::setw(12) << refitMs << std::setprecision(1)
+              << std::setw(11) << rebuildMs / refitMs << "x" << std::setw(14) << dirtyNodes / kFrames
+              << std::setw(12) << uploadBytes / kFrames / 1024.0 << std::setprecision(2) << std::setw(12)
+              << bvh.getDegradation() << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
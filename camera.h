@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+struct Camera {
+  glm::vec3 origin;
+  float yaw;
+  float pitch;
+};
+
+inline bool operator==(const Camera& lhs, const Camera& rhs) {
+  return lhs.origin == rhs.origin && lhs.yaw == rhs.yaw && lhs.pitch == rhs.pitch;
+}
+
+inline bool operator!=(const Camera& lhs, const Camera& rhs) {
+  return !(lhs == rhs);
+}
@@ -0,0 +1,73 @@
+#include "camera_path.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+CameraPath CameraPath::makeDefault() {
+  CameraPath path;
+  path.addKeyframe(0.00f, {glm::vec3( 0.0f, 0.0f, 0.0f),  0.0f,  0.0f});
+  path.addKeyframe(0.25f, {glm::vec3( 0.0f, 0.0f, 0.5f),  0.4f,  0.1f});
+  path.addKeyframe(0.50f, {glm::vec3( 0.5f, 0.0f, 0.3f), -0.4f, -0.1f});
+  path.addKeyframe(0.75f, {glm::vec3(-0.5f, 0.2f, 0.2f),  0.2f,  0.0f});
+  path.addKeyframe(1.00f, {glm::vec3( 0.0f, 0.0f, 0.0f),  0.0f,  0.0f});
+  return path;
+}
+
+CameraPath CameraPath::load(const std::string& filename) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open " + filename + "!");
+  }
+
+  CameraPath path;
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream stream(line);
+    std::string first;
+    if (!(stream >> first) || first[0] == '#') {
+      continue;
+    }
+
+    float time;
+    Camera camera{};
+    std::istringstream values(line);
+    if (!(values >> time >> camera.origin.x >> camera.origin.y >> camera.origin.z >> camera.yaw >> camera.pitch)) {
+      throw std::runtime_error("invalid keyframe '" + line + "' in " + filename + "!");
+    }
+    path.addKeyframe(time, camera);
+  }
+
+  if (path._keyframes.empty()) {
+    throw std::runtime_error("camera path " + filename + " has no keyframes!");
+  }
+  return path;
+}
+
+Camera CameraPath::at(float time) const {
+  if (time <= _keyframes.front().time) {
+    return _keyframes.front().camera;
+  }
+  if (time >= _keyframes.back().time) {
+    return _keyframes.back().camera;
+  }
+
+  auto next = std::upper_bound(_keyframes.begin(), _keyframes.end(), time,
+                               [](float value, const Keyframe& keyframe) { return value < keyframe.time; });
+  auto previous = next - 1;
+  float weight = (time - previous->time) / (next->time - previous->time);
+
+  Camera camera;
+  camera.origin = glm::mix(previous->camera.origin, next->camera.origin, weight);
+  camera.yaw = glm::mix(previous->camera.yaw, next->camera.yaw, weight);
+  camera.pitch = glm::mix(previous->camera.pitch, next->camera.pitch, weight);
+  return camera;
+}
+
+void CameraPath::addKeyframe(float time, const Camera& camera) {
+  if (!_keyframes.empty() && time <= _keyframes.back().time) {
+    throw std::runtime_error("camera path keyframes must have increasing times!");
+  }
+  _keyframes.push_back({time, camera});
+}
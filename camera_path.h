@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "camera.h"
+
+// Camera keyframes over normalized time, linearly interpolated in between
+class CameraPath {
+ public:
+  struct Keyframe {
+    float time;  // 0 is the first and 1 the last frame of a replay
+    Camera camera;
+  };
+
+  // A short walk between the spheres of the default world
+  static CameraPath makeDefault();
+  // One keyframe per line: time origin.x origin.y origin.z yaw pitch, lines starting with # are ignored.
+  // Times must be increasing.
+  static CameraPath load(const std::string& filename);
+
+  Camera at(float time) const;
+
+ private:
+  void addKeyframe(float time, const Camera& camera);
+
+  std::vector<Keyframe> _keyframes;
+};
@@ -0,0 +1,149 @@
+#include "capture_writer.h"
+
+#include <cstdio>
+#include <iomanip>
+#include <stdexcept>
+
+#include "event_tracer.h"
+#include "ppm.h"
+
+CaptureWriter::CaptureWriter(const std::string& prefix, CaptureFormat format, uint32_t slotCount)
+    : _prefix(prefix), _format(format), _slotsInUse(slotCount, false) {
+  _thread = std::thread(&CaptureWriter::run, this);
+}
+
+CaptureWriter::~CaptureWriter() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _queued.notify_one();
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+}
+
+uint32_t CaptureWriter::acquire() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  checkError();
+  auto findFree = [this] {
+    for (uint32_t slot = 0; slot < _slotsInUse.size(); ++slot) {
+      if (!_slotsInUse[slot]) {
+        return static_cast<int64_t>(slot);
+      }
+    }
+    return int64_t{-1};
+  };
+
+  int64_t slot = findFree();
+  if (slot < 0) {
+    // The disk can't keep up, rendering waits for the writer
+    auto start = Clock::now();
+    _written.wait(lock, [&] { return (slot = findFree()) >= 0 || _error; });
+    ++_stalls;
+    _stallTime += Clock::now() - start;
+    checkError();
+  }
+  _slotsInUse[slot] = true;
+  return static_cast<uint32_t>(slot);
+}
+
+void CaptureWriter::submit(uint32_t slot, const uint8_t* pixels, uint32_t width, uint32_t height, bool bgra) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    checkError();
+    _queue.push_back({slot, pixels, width, height, bgra});
+  }
+  _queued.notify_one();
+}
+
+void CaptureWriter::flush() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _written.wait(lock, [this] { return (_queue.empty() && !_writing) || _error; });
+  checkError();
+}
+
+void CaptureWriter::print(std::ostream& stream) const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  double writeSeconds = std::chrono::duration<double>(_writeTime).count();
+  double stallMs = std::chrono::duration<double, std::milli>(_stallTime).count();
+  stream << std::fixed << std::setprecision(1) << "capture: " << _framesWritten << " frames, "
+         << _bytesWritten / double(1 << 20) << " MiB written at "
+         << (writeSeconds > 0.0 ? _bytesWritten / double(1 << 20) / writeSeconds : 0.0) << " MiB/s, "
+         << _queue.size() << " queued; rendering waited " << _stalls << " times for a full ring, " << stallMs
+         << " ms in total" << std::defaultfloat << std::endl;
+}
+
+void CaptureWriter::run() {
+  EventTracer::get().setThreadName("capture writer");
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    _queued.wait(lock, [this] { return !_queue.empty() || _stop; });
+    if (_queue.empty()) {
+      return;
+    }
+    Frame frame = _queue.front();
+    _queue.pop_front();
+    _writing = true;
+    // After a failure the remaining frames are dropped, only their slots are freed
+    bool failed = _error != nullptr;
+    lock.unlock();
+
+    auto start = Clock::now();
+    std::exception_ptr error;
+    if (!failed) {
+      try {
+        write(frame);
+      } catch (const std::exception&) {
+        error = std::current_exception();
+      }
+    }
+    auto writeTime = Clock::now() - start;
+
+    lock.lock();
+    _writing = false;
+    _slotsInUse[frame.slot] = false;
+    if (error) {
+      _error = error;
+    } else if (!_error) {
+      ++_framesWritten;
+      _bytesWritten += static_cast<uint64_t>(frame.width) * frame.height * (_format == CaptureFormat::Raw ? 4 : 3);
+      _writeTime += writeTime;
+    }
+    _written.notify_all();
+  }
+}
+
+void CaptureWriter::write(const Frame& frame) {
+  TraceScope scope("write capture");
+  if (_format == CaptureFormat::Ppm) {
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), "_%06llu.ppm", static_cast<unsigned long long>(_frameIndex++));
+    writePpm(_prefix + suffix, frame.width, frame.height, frame.pixels, frame.bgra);
+    return;
+  }
+
+  if (!_rawFile.is_open() || frame.width != _rawWidth || frame.height != _rawHeight) {
+    std::string filename = _prefix + "_" + std::to_string(frame.width) + "x" + std::to_string(frame.height) +
+                           (frame.bgra ? ".bgra" : ".rgba");
+    // Frames of a resolution seen before in this capture go to the end of its file
+    bool reopened = !_rawFilenames.insert(filename).second;
+    _rawFile = std::ofstream(filename, std::ios::binary | (reopened ? std::ios::app : std::ios::trunc));
+    if (!_rawFile.is_open()) {
+      throw std::runtime_error("failed to open " + filename + "!");
+    }
+    _rawWidth = frame.width;
+    _rawHeight = frame.height;
+  }
+  _rawFile.write(reinterpret_cast<const char*>(frame.pixels),
+                 static_cast<std::streamsize>(frame.width) * frame.height * 4);
+  if (!_rawFile) {
+    throw std::runtime_error("failed to write raw capture!");
+  }
+}
+
+void CaptureWriter::checkError() {
+  if (_error) {
+    std::rethrow_exception(_error);
+  }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "settings.h"
+
+// Writes captured frames to disk on a thread of its own, straight from the mapped staging buffers the GPU copied them
+// to. Every slot of the ring is free, being copied to by the GPU or queued for writing, and it is free again once its
+// frame was written. The renderer only waits for the writer when it needs a slot and none is free.
+class CaptureWriter {
+ public:
+  // PPM frames are written to prefix_000000.ppm, ...; raw frames are appended to prefix_WxH.rgba or .bgra, a new file
+  // for every resolution
+  CaptureWriter(const std::string& prefix, CaptureFormat format, uint32_t slotCount);
+  // Writes every frame still queued
+  ~CaptureWriter();
+  CaptureWriter(const CaptureWriter&) = delete;
+  CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+  // Returns a free slot, waiting for the writer while every slot is in use
+  uint32_t acquire();
+  // Queues the frame the GPU finished copying into the slot. The tightly packed 8-bit pixels are read in place, so
+  // they must stay mapped until the slot is acquired again.
+  void submit(uint32_t slot, const uint8_t* pixels, uint32_t width, uint32_t height, bool bgra);
+  // Waits until every queued frame was written
+  void flush();
+
+  void print(std::ostream& stream) const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Frame {
+    uint32_t slot;
+    const uint8_t* pixels;
+    uint32_t width;
+    uint32_t height;
+    bool bgra;
+  };
+
+  void run();
+  void write(const Frame& frame);
+  // Rethrows on the caller's thread what the writer failed with
+  void checkError();
+
+  std::string _prefix;
+  CaptureFormat _format;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _queued;  // Signaled for the writer
+  std::condition_variable _written;  // Signaled for the renderer
+  std::vector<bool> _slotsInUse;
+  std::deque<Frame> _queue;
+  bool _writing = false;
+  bool _stop = false;
+  std::exception_ptr _error;
+
+  // Only touched by the writer thread
+  std::ofstream _rawFile;
+  std::set<std::string> _rawFilenames;
+  uint32_t _rawWidth = 0;
+  uint32_t _rawHeight = 0;
+  uint64_t _frameIndex = 0;
+
+  // Guarded by _mutex
+  uint64_t _framesWritten = 0;
+  uint64_t _bytesWritten = 0;
+  Clock::duration _writeTime{};
+  uint64_t _stalls = 0;  // Times acquire() found the ring full
+  Clock::duration _stallTime{};
+
+  std::thread _thread;
+};
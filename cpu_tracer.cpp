@@ -0,0 +1,398 @@
+#include "cpu_tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+constexpr float kInfinity = std::numeric_limits<float>::infinity();
+constexpr float kEps = 1e-8f;
+constexpr float kFocalLength = 1.0f;
+
+glm::vec3 normalized(const glm::vec3& vector) {
+  return vector / glm::length(vector);
+}
+
+bool nearZero(const glm::vec3& vector) {
+  return std::abs(vector.x) < kEps && std::abs(vector.y) < kEps && std::abs(vector.z) < kEps;
+}
+
+float luminance(const glm::vec3& color) {
+  return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+}  // namespace
+
+CpuTracer::CpuTracer(const Scene& scene, uint32_t width, uint32_t height, uint32_t threadCount, Sampler sampler)
+    : _width(width),
+      _height(height),
+      _sampler(sampler),
+      _blueNoise(makeBlueNoise()),
+      _accumulation(static_cast<size_t>(width) * height),
+      _materials(scene.getMaterials()),
+      _scheduler(width, height, kTileSize, threadCount) {
+  Bvh bvh;
+  bvh.build(scene.getSphereBounds());
+  _nodes = bvh.getNodes();
+
+  const auto& spheres = scene.getSpheres();
+  for (uint32_t index : bvh.getPrimitiveIndices()) {
+    _spheres.push_back(spheres[index]);
+  }
+}
+
+const std::vector<glm::vec4>& CpuTracer::render(const Camera& camera, uint32_t samples,
+                                                const TracerConstants& constants) {
+  _camera = camera;
+  _maxDepth = constants.maxDepth;
+  CameraBasis basis = makeCameraBasis(camera, constants.verticalFov);
+  _convergedPixels = 0;
+  _tracedSamples = 0;
+
+  _scheduler.run([&](const Tile& tile) {
+    renderTile(tile, basis, samples);
+  });
+
+  ++_accumulatedFrames;
+  ++_frame;
+  return _accumulation;
+}
+
+void CpuTracer::resetAccumulation() {
+  _accumulatedFrames = 0;
+}
+
+void CpuTracer::setAdaptiveSampling(float threshold, uint32_t minSamples) {
+  _adaptiveThreshold = threshold;
+  _adaptiveMinSamples = minSamples;
+  _meanSquares.assign(threshold > 0.0f ? _accumulation.size() : 0, 0.0f);
+}
+
+uint32_t CpuTracer::getConvergedPixels() const {
+  return _convergedPixels;
+}
+
+uint64_t CpuTracer::getTracedSamples() const {
+  return _tracedSamples;
+}
+
+bool CpuTracer::hasConverged(const glm::vec4& accumulated, float meanSquare) const {
+  if (_adaptiveThreshold <= 0.0f || _accumulatedFrames == 0 || accumulated.w < _adaptiveMinSamples) {
+    return false;
+  }
+  float mean = luminance(glm::vec3(accumulated));
+  float variance = std::max(meanSquare - mean * mean, 0.0f);
+  return std::sqrt(variance / accumulated.w) <= _adaptiveThreshold * std::max(mean, kMinAdaptiveLuminance);
+}
+
+CpuTracer::CameraBasis CpuTracer::makeCameraBasis(const Camera& camera, float verticalFov) const {
+  glm::vec3 cameraDirection(std::sin(camera.yaw) * std::cos(camera.pitch), std::sin(camera.pitch),
+                            std::cos(camera.yaw) * std::cos(camera.pitch));
+  glm::vec3 u = normalized(glm::cross(glm::vec3(0, 1, 0), cameraDirection));
+  glm::vec3 v = glm::cross(cameraDirection, u);
+
+  float aspectRatio = static_cast<float>(_width) / _height;
+  float viewportHeight = 2.0f * std::tan(verticalFov * static_cast<float>(M_PI) / 180.0f / 2);
+  float viewportWidth = aspectRatio * viewportHeight;
+
+  CameraBasis basis;
+  basis.origin = camera.origin;
+  basis.horizontal = viewportWidth * u;
+  basis.vertical = viewportHeight * v;
+  basis.lowerLeftCorner = camera.origin - (basis.horizontal / 2.0f + basis.vertical / 2.0f - kFocalLength * cameraDirection);
+  return basis;
+}
+
+glm::vec3 CpuTracer::randomVec3(Lane& lane, float min, float max) const {
+  float x = min + (max - min) * lane.sampler.next();
+  float y = min + (max - min) * lane.sampler.next();
+  float z = min + (max - min) * lane.sampler.next();
+  return glm::vec3(x, y, z);
+}
+
+void CpuTracer::renderTile(const Tile& tile, const CameraBasis& basis, uint32_t samples) {
+  uint32_t convergedPixels = 0;
+  uint64_t tracedSamples = 0;
+  for (uint32_t y = tile.y; y < tile.y + tile.height; ++y) {
+    for (uint32_t x = tile.x; x < tile.x + tile.width; x += kPacketWidth) {
+      int laneCount = std::min<int>(kPacketWidth, tile.x + tile.width - x);
+      int laneBits = 0;
+
+      Lane lanes[kPacketWidth] = {};
+      glm::vec3 colors[kPacketWidth] = {};
+      float squares[kPacketWidth] = {};
+      for (int i = 0; i < laneCount; ++i) {
+        size_t index = static_cast<size_t>(y) * _width + x + i;
+        if (!_meanSquares.empty() && hasConverged(_accumulation[index], _meanSquares[index])) {
+          ++convergedPixels;
+          continue;
+        }
+        laneBits |= 1 << i;
+        tracedSamples += samples;
+        lanes[i].fragCoord = glm::vec2(x + i + 0.5f, y + 0.5f);
+        float firstSample = _accumulatedFrames > 0 ? _accumulation[index].w : 0.0f;
+        lanes[i].sampler = PixelSampler(_sampler, &_blueNoise, glm::ivec2(x + i, y), _frame, _accumulatedFrames,
+                                        static_cast<uint32_t>(firstSample));
+      }
+
+      if (laneBits == 0) {
+        continue;
+      }
+
+      for (uint32_t sample = 0; sample < samples; ++sample) {
+        for (int i = 0; i < laneCount; ++i) {
+          if ((laneBits & (1 << i)) == 0) {
+            continue;
+          }
+          Lane& lane = lanes[i];
+          float u = (lane.fragCoord.x + lane.sampler.next()) / (_width - 1.0f);
+          float v = 1.0f - (lane.fragCoord.y + lane.sampler.next()) / (_height - 1.0f);
+          lane.origin = basis.origin;
+          lane.direction = normalized(basis.lowerLeftCorner + u * basis.horizontal + v * basis.vertical - basis.origin);
+          lane.color = glm::vec3(1, 1, 1);
+          lane.depth = 0;
+          lane.reflective = false;
+        }
+
+        glm::vec3 results[kPacketWidth];
+        tracePacket(lanes, laneBits, results);
+        for (int i = 0; i < laneCount; ++i) {
+          if ((laneBits & (1 << i)) == 0) {
+            continue;
+          }
+          colors[i] += results[i];
+          squares[i] += luminance(results[i]) * luminance(results[i]);
+          lanes[i].sampler.nextSample();
+        }
+      }
+
+      for (int i = 0; i < laneCount; ++i) {
+        if ((laneBits & (1 << i)) == 0) {
+          continue;
+        }
+        size_t index = static_cast<size_t>(y) * _width + x + i;
+        glm::vec4& accumulated = _accumulation[index];
+        glm::vec3 color = colors[i];
+        float square = squares[i];
+        float sampleCount = static_cast<float>(samples);
+        if (_accumulatedFrames > 0) {
+          color += glm::vec3(accumulated) * accumulated.w;
+          if (!_meanSquares.empty()) {
+            square += _meanSquares[index] * accumulated.w;
+          }
+          sampleCount += accumulated.w;
+        }
+        color /= sampleCount;
+        accumulated = glm::vec4(color, sampleCount);
+        if (!_meanSquares.empty()) {
+          _meanSquares[index] = square / sampleCount;
+        }
+      }
+    }
+  }
+  _convergedPixels += convergedPixels;
+  _tracedSamples += tracedSamples;
+}
+
+void CpuTracer::tracePacket(Lane* lanes, int laneBits, glm::vec3* results) const {
+  int active = laneBits;
+  while (active != 0) {
+    Hits hits;
+    intersect(lanes, maskFromBits(active), hits);
+    float t[kPacketWidth];
+    hits.t.store(t);
+
+    for (int i = 0; i < kPacketWidth; ++i) {
+      if (!((active >> i) & 1)) {
+        continue;
+      }
+      Lane& lane = lanes[i];
+
+      if (hits.sphere[i] == kNoHit) {
+        float skyCoefficient = (lane.direction.y + 1.0f) / 2.0f;
+        glm::vec3 skyColor = glm::vec3(1, 1, 1) - skyCoefficient * glm::vec3(1, 0, 0);
+        if (lane.depth == 0) {
+          results[i] = skyColor;
+        } else if (lane.reflective) {
+          results[i] = lane.color * skyColor;
+        } else {
+          results[i] = lane.color;
+        }
+        active &= ~(1 << i);
+        continue;
+      }
+
+      if (lane.depth >= _maxDepth) {
+        results[i] = glm::vec3(0, 0, 0);
+        active &= ~(1 << i);
+        continue;
+      }
+
+      Sphere sphere{};
+      if (hits.sphere[i] == kCameraSphere) {
+        sphere.center = _camera.origin;
+        sphere.radius = kCameraRadius;
+        sphere.material = Scene::kCameraMaterial;
+      } else {
+        sphere = _spheres[hits.sphere[i]];
+      }
+      const Material& material = _materials[sphere.material];
+      glm::vec3 point = lane.origin + t[i] * lane.direction;
+      glm::vec3 normal = (point - sphere.center) / sphere.radius;
+      lane.reflective = material.type == kReflectiveMaterial;
+
+      glm::vec3 attenuation;
+      if (scatter(lane, point, normal, material, attenuation)) {
+        lane.color *= attenuation;
+      } else {
+        results[i] = glm::vec3(0, 0, 0);
+        active &= ~(1 << i);
+        continue;
+      }
+
+      ++lane.depth;
+    }
+  }
+}
+
+void CpuTracer::intersect(const Lane* lanes, Mask active, Hits& hits) const {
+  float values[6][kPacketWidth] = {};
+  for (int i = 0; i < kPacketWidth; ++i) {
+    for (int axis = 0; axis < 3; ++axis) {
+      values[axis][i] = lanes[i].origin[axis];
+      values[3 + axis][i] = lanes[i].direction[axis];
+    }
+  }
+  Packet origin[3];
+  Packet direction[3];
+  Packet inverseDirection[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    origin[axis] = Packet::load(values[axis]);
+    direction[axis] = Packet::load(values[3 + axis]);
+    inverseDirection[axis] = Packet(1.0f) / direction[axis];
+  }
+
+  hits.t = Packet(kInfinity);
+  std::fill(hits.sphere, hits.sphere + kPacketWidth, kNoHit);
+
+  // The sphere following the camera is not part of the BVH, just like in the shader
+  Sphere cameraSphere{};
+  cameraSphere.center = _camera.origin;
+  cameraSphere.radius = kCameraRadius;
+  intersectSphere(origin, direction, active, cameraSphere, kCameraSphere, hits);
+
+  // Node order only depends on the first active lane, the others follow it
+  int firstLane = __builtin_ctz(bits(active));
+  const Lane& guide = lanes[firstLane];
+
+  uint32_t stack[kBvhStackSize];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    const BvhNode& node = _nodes[stack[--stackSize]];
+
+    Packet entry(0.001f);
+    Packet exit = hits.t;
+    for (int axis = 0; axis < 3; ++axis) {
+      Packet t0 = (Packet(node.boundsMin[axis]) - origin[axis]) * inverseDirection[axis];
+      Packet t1 = (Packet(node.boundsMax[axis]) - origin[axis]) * inverseDirection[axis];
+      entry = max(entry, min(t0, t1));
+      exit = min(exit, max(t0, t1));
+    }
+    if (!any(active & (entry <= exit))) {
+      continue;
+    }
+
+    if (node.count > 0) {
+      for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+        intersectSphere(origin, direction, active, _spheres[i], i, hits);
+      }
+      continue;
+    }
+
+    uint32_t nearChild = node.leftOrFirst;
+    uint32_t farChild = node.leftOrFirst + 1;
+    const BvhNode& left = _nodes[nearChild];
+    const BvhNode& right = _nodes[farChild];
+    float leftDistance = glm::dot((left.boundsMin + left.boundsMax) * 0.5f - guide.origin, guide.direction);
+    float rightDistance = glm::dot((right.boundsMin + right.boundsMax) * 0.5f - guide.origin, guide.direction);
+    if (rightDistance < leftDistance) {
+      std::swap(nearChild, farChild);
+    }
+    stack[stackSize++] = farChild;
+    stack[stackSize++] = nearChild;
+  }
+}
+
+void CpuTracer::intersectSphere(const Packet* origin, const Packet* direction, Mask active, const Sphere& sphere,
+                                int32_t index, Hits& hits) const {
+  Packet oc[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    oc[axis] = origin[axis] - Packet(sphere.center[axis]);
+  }
+
+  Packet radius(sphere.radius);
+  Packet a = direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2];
+  Packet halfB = oc[0] * direction[0] + oc[1] * direction[1] + oc[2] * direction[2];
+  Packet ocLengthSquared = oc[0] * oc[0] + oc[1] * oc[1] + oc[2] * oc[2];
+  Packet c = ocLengthSquared - radius * radius;
+  Packet discriminant = halfB * halfB - a * c;
+
+  // Rays starting inside a sphere ignore it, just like sphereHit of the shader
+  Mask outside = radius <= sqrt(ocLengthSquared);
+  Mask valid = active & outside & (Packet(0.0f) <= discriminant);
+  if (!any(valid)) {
+    return;
+  }
+
+  Packet sqrtDiscriminant = sqrt(max(discriminant, Packet(0.0f)));
+  Packet tMin(0.001f);
+  Packet nearRoot = (Packet(0.0f) - halfB - sqrtDiscriminant) / a;
+  Packet farRoot = (Packet(0.0f) - halfB + sqrtDiscriminant) / a;
+  Mask nearValid = (tMin <= nearRoot) & (nearRoot <= hits.t);
+  Mask farValid = (tMin <= farRoot) & (farRoot <= hits.t);
+  Packet root = select(nearValid, nearRoot, farRoot);
+  Mask hit = valid & (nearValid | farValid);
+
+  int hitBits = bits(hit);
+  if (hitBits == 0) {
+    return;
+  }
+  hits.t = select(hit, root, hits.t);
+  for (int i = 0; i < kPacketWidth; ++i) {
+    if ((hitBits >> i) & 1) {
+      hits.sphere[i] = index;
+    }
+  }
+}
+
+bool CpuTracer::scatter(Lane& lane, const glm::vec3& point, const glm::vec3& normal, const Material& material,
+                        glm::vec3& attenuation) const {
+  switch (material.type) {
+    case kDiffuseMaterial: {
+      glm::vec3 scatterDirection = normal + randomVec3(lane, -1.0f, 1.0f);
+      if (nearZero(scatterDirection)) {
+        scatterDirection = normal;
+      }
+      lane.origin = point;
+      lane.direction = scatterDirection;
+      attenuation = material.albedo;
+      return true;
+    }
+    case kReflectiveMaterial: {
+      float cosAlpha = glm::dot(lane.direction, normal) / (glm::length(lane.direction) * glm::length(normal));
+      glm::vec3 inHemisphere = randomVec3(lane, -1.0f, 1.0f);
+      if (glm::dot(inHemisphere, normal) <= 0.0f) {
+        inHemisphere = -inHemisphere;
+      }
+      lane.origin = point;
+      lane.direction = normalized(lane.direction - 2.0f * normal * cosAlpha + material.fuzz * inHemisphere);
+      attenuation = glm::vec3(1, 1, 1) * 0.9f;
+      return true;
+    }
+    default: {
+      return false;
+    }
+  }
+}
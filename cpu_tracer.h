@@ -0,0 +1,95 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "bvh.h"
+#include "camera.h"
+#include "sampling.h"
+#include "scene.h"
+#include "settings.h"
+#include "simd.h"
+#include "tile_scheduler.h"
+
+// CPU implementation of tracer.glsl: same camera basis, samplers, BVH and material model, so its
+// output can be compared against the GPU. Rays of kPacketWidth neighbouring pixels are traced together.
+class CpuTracer {
+ public:
+  CpuTracer(const Scene& scene, uint32_t width, uint32_t height, uint32_t threadCount, Sampler sampler);
+
+  // Traces one frame and blends it into the accumulation buffer exactly like the shader does, with the constants the
+  // GPU path specializes its pipelines with. Returns linear colors in rgb and the accumulated sample count in a, top
+  // row first.
+  const std::vector<glm::vec4>& render(const Camera& camera, uint32_t samples, const TracerConstants& constants);
+  void resetAccumulation();
+  // Pixels whose accumulated mean converged, see Settings::adaptiveThreshold, are no longer traced. 0 disables it.
+  void setAdaptiveSampling(float threshold, uint32_t minSamples);
+  // Of the last frame: pixels it skipped because they had converged, and samples it traced
+  uint32_t getConvergedPixels() const;
+  uint64_t getTracedSamples() const;
+
+ private:
+  static constexpr int kBvhStackSize = 64;
+  static constexpr uint32_t kTileSize = 32;
+  static constexpr int32_t kNoHit = -1;
+  static constexpr int32_t kCameraSphere = -2;
+  static constexpr float kCameraRadius = 0.25f;
+  static constexpr float kMinAdaptiveLuminance = 0.05f;  // The error of darker pixels is measured against this
+
+  struct CameraBasis {
+    glm::vec3 origin;
+    glm::vec3 lowerLeftCorner;
+    glm::vec3 horizontal;
+    glm::vec3 vertical;
+  };
+
+  // Per pixel state of one lane, mirrors the globals and locals of the shader
+  struct Lane {
+    glm::vec2 fragCoord;
+    PixelSampler sampler;
+    glm::vec3 origin;
+    glm::vec3 direction;
+    glm::vec3 color;
+    int depth;
+    bool reflective;
+  };
+
+  struct Hits {
+    Packet t;
+    int32_t sphere[kPacketWidth];
+  };
+
+  CameraBasis makeCameraBasis(const Camera& camera, float verticalFov) const;
+  bool hasConverged(const glm::vec4& accumulated, float meanSquare) const;
+  glm::vec3 randomVec3(Lane& lane, float min, float max) const;
+
+  void renderTile(const Tile& tile, const CameraBasis& basis, uint32_t samples);
+  void tracePacket(Lane* lanes, int laneBits, glm::vec3* results) const;
+  void intersect(const Lane* lanes, Mask active, Hits& hits) const;
+  void intersectSphere(const Packet* origin, const Packet* direction, Mask active, const Sphere& sphere,
+                       int32_t index, Hits& hits) const;
+  bool scatter(Lane& lane, const glm::vec3& point, const glm::vec3& normal, const Material& material,
+               glm::vec3& attenuation) const;
+
+  uint32_t _width;
+  uint32_t _height;
+  Camera _camera{};
+  int _maxDepth = 0;
+  uint32_t _accumulatedFrames = 0;
+  uint32_t _frame = 0;  // Like the push constant of the same name
+  Sampler _sampler;
+  std::vector<float> _blueNoise;
+  std::vector<glm::vec4> _accumulation;
+  float _adaptiveThreshold = 0.0f;
+  uint32_t _adaptiveMinSamples = 0;
+  std::vector<float> _meanSquares;  // Running mean of every sample's squared luminance, only with adaptive sampling
+  std::atomic<uint32_t> _convergedPixels{0};
+  std::atomic<uint64_t> _tracedSamples{0};
+  std::vector<Material> _materials;
+  std::vector<Sphere> _spheres;  // In BVH leaf order
+  std::vector<BvhNode> _nodes;
+  TileScheduler _scheduler;
+};
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+#include "cpu_tracer.h"
+#include "ppm.h"
+#include "settings.h"
+
+namespace {
+
+// Same encoding the R8G8B8A8_SRGB target of the GPU path applies on store
+uint8_t toSrgb(float linear) {
+  linear = std::clamp(linear, 0.0f, 1.0f);
+  float encoded = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+  return static_cast<uint8_t>(std::lround(encoded * 255.0f));
+}
+
+void run(const Settings& settings) {
+  if (!settings.meshFile.empty()) {
+    throw std::runtime_error("the CPU tracer does not trace meshes!");
+  }
+  if (settings.movingSpheres > 0) {
+    throw std::runtime_error("the CPU tracer does not animate spheres!");
+  }
+  Scene scene = settings.randomSpheres > 0 ? Scene::makeRandom(settings.randomSpheres, settings.seed) : Scene::makeDefault();
+  uint32_t threadCount = getThreadCount(settings);
+  CpuTracer tracer(scene, settings.width, settings.height, threadCount, settings.sampler);
+  tracer.setAdaptiveSampling(settings.adaptiveThreshold, settings.adaptiveMinSamples);
+
+  // Renders the same frames as the headless GPU path, which keeps the camera at its start position
+  auto start = std::chrono::high_resolution_clock::now();
+  uint64_t samples = 0;
+  for (uint32_t frame = 0; frame < settings.frames; ++frame) {
+    if (!settings.accumulate) {
+      tracer.resetAccumulation();
+    }
+    bool moving = settings.accumulate && frame == 0;
+    uint32_t frameSamples = moving ? settings.movingSamples : settings.samples;
+    TracerConstants constants = getTracerConstants(moving ? settings.movingQuality : settings.quality, settings.verticalFov);
+    const std::vector<glm::vec4>& image = tracer.render(Camera{}, frameSamples, constants);
+    samples += tracer.getTracedSamples();
+
+    if (!settings.outputPrefix.empty()) {
+      std::vector<uint8_t> pixels(image.size() * 4);
+      for (size_t i = 0; i < image.size(); ++i) {
+        pixels[i * 4 + 0] = toSrgb(image[i].x);
+        pixels[i * 4 + 1] = toSrgb(image[i].y);
+        pixels[i * 4 + 2] = toSrgb(image[i].z);
+        pixels[i * 4 + 3] = 255;
+      }
+
+      char filename[32];
+      std::snprintf(filename, sizeof(filename), "_%04u.ppm", frame);
+      writePpm(settings.outputPrefix + filename, settings.width, settings.height, pixels.data());
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+  double pathsPerSecond = static_cast<double>(samples) / seconds;
+  std::cout << settings.frames << " frames in " << seconds << " s (" << settings.frames / seconds << " fps, "
+            << pathsPerSecond / 1e6 << " Mpaths/s, " << threadCount << " threads, " << kPacketWidth << " wide packets)"
+            << std::endl;
+  if (settings.adaptiveThreshold > 0.0f) {
+    double pixels = static_cast<double>(settings.width) * settings.height;
+    std::cout << tracer.getConvergedPixels() << " of " << pixels << " pixels converged, " << samples / pixels
+              << " samples per pixel traced" << std::endl;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  try {
+    run(parseSettings(argc, argv));
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
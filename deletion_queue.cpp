@@ -0,0 +1,62 @@
+#include "deletion_queue.h"
+
+DeletionQueue::DeletionQueue(uint32_t framesInFlight) : _frames(framesInFlight) {}
+
+DeletionQueue::~DeletionQueue() {
+  flush();
+}
+
+void DeletionQueue::retire(MemoryAllocation& allocation) {
+  MemoryAllocator* allocator = allocation.getAllocator();
+  VkDeviceMemory memory = allocation.getMemory();
+  Entry entry{};
+  entry.offset = allocation.getOffset();
+  allocation.release();
+  // Transient allocations are reclaimed with their arena
+  if (allocator == nullptr || memory == VK_NULL_HANDLE) {
+    return;
+  }
+  std::memcpy(&entry.parent, &allocator, sizeof(allocator));
+  std::memcpy(&entry.handle, &memory, sizeof(memory));
+  entry.destroy = [](const Entry& entry) {
+    MemoryAllocator* allocator;
+    VkDeviceMemory memory;
+    std::memcpy(&allocator, &entry.parent, sizeof(allocator));
+    std::memcpy(&memory, &entry.handle, sizeof(memory));
+    allocator->free(memory, entry.offset);
+  };
+  retire(entry);
+}
+
+void DeletionQueue::retire(std::vector<MemoryAllocation>& allocations) {
+  for (auto& allocation : allocations) {
+    retire(allocation);
+  }
+  allocations.clear();
+}
+
+void DeletionQueue::submitted(uint32_t frame) {
+  _lastSubmitted = frame;
+}
+
+void DeletionQueue::collect(uint32_t frame) {
+  for (const Entry& entry : _frames[frame]) {
+    entry.destroy(entry);
+  }
+  _frames[frame].clear();
+}
+
+void DeletionQueue::flush() {
+  for (uint32_t frame = 0; frame < _frames.size(); ++frame) {
+    collect(frame);
+  }
+}
+
+void DeletionQueue::retire(const Entry& entry) {
+  if (_lastSubmitted < 0) {
+    // Nothing was submitted that could use it
+    entry.destroy(entry);
+    return;
+  }
+  _frames[_lastSubmitted].push_back(entry);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "memory_allocator.h"
+#include "vk_wrapper.h"
+
+// Defers destroying objects that submitted frames may still use. An object retired after a frame was submitted
+// is destroyed once that frame's fence signaled, which is when its slot is waited on before being reused.
+class DeletionQueue {
+ public:
+  explicit DeletionQueue(uint32_t framesInFlight);
+  // The owner waits for the device to go idle first
+  ~DeletionQueue();
+
+  template<class Handle, class Parent, auto Destroy>
+  void retire(VkChildHandle<Handle, Parent, Destroy>& object) {
+    static_assert(sizeof(Handle) <= sizeof(uint64_t) && sizeof(Parent) <= sizeof(uint64_t));
+    Entry entry{};
+    Parent parent = object.getParent();
+    Handle handle = object.release();
+    if (handle == Handle{}) {
+      return;
+    }
+    std::memcpy(&entry.parent, &parent, sizeof(Parent));
+    std::memcpy(&entry.handle, &handle, sizeof(Handle));
+    entry.destroy = [](const Entry& entry) {
+      Parent parent;
+      Handle handle;
+      std::memcpy(&parent, &entry.parent, sizeof(Parent));
+      std::memcpy(&handle, &entry.handle, sizeof(Handle));
+      VkChildHandle<Handle, Parent, Destroy>::destroy(parent, handle);
+    };
+    retire(entry);
+  }
+  template<class Handle, class Parent, auto Destroy>
+  void retire(std::vector<VkChildHandle<Handle, Parent, Destroy>>& objects) {
+    for (auto& object : objects) {
+      retire(object);
+    }
+    objects.clear();
+  }
+  void retire(MemoryAllocation& allocation);
+  void retire(std::vector<MemoryAllocation>& allocations);
+
+  // Call after submitting a frame in slot frame
+  void submitted(uint32_t frame);
+  // Call once the fence of slot frame has been waited on, destroys what was retired while it was the last submission
+  void collect(uint32_t frame);
+  void flush();
+
+ private:
+  struct Entry {
+    void (*destroy)(const Entry& entry);
+    uint64_t parent;
+    uint64_t handle;
+    uint64_t offset;  // Of memory allocations
+  };
+
+  void retire(const Entry& entry);
+
+  std::vector<std::vector<Entry>> _frames;  // Objects retired while the slot held the last submitted frame
+  int64_t _lastSubmitted = -1;  // Slot of the last submitted frame, -1 before the first one
+};
@@ -0,0 +1,35 @@
+// Shared by the denoiser passes gbuffer.comp, temporal.comp and atrous.comp, included after tracer.glsl
+
+// The denoiser's images are of the target's size, the traced region is in their top left corner
+layout(binding = 6, rgba32f) uniform image2D normalDepthImage;  // Normal and distance of the surface a pixel sees
+layout(binding = 7, rgba16f) uniform image2D albedoImage;
+layout(binding = 8, rgba32f) uniform image2D previousNormalDepthImage;  // normalDepthImage of the previous frame
+layout(binding = 9, rgba16f) uniform image2D historyImage;  // rgb holds the filtered color, a the frames it averages
+layout(binding = 10, rgba16f) uniform image2D pingImage;
+layout(binding = 11, rgba16f) uniform image2D pongImage;
+
+const float kSkyDepth = 1e4;  // Distance stored for pixels that see the sky
+
+// Ray through the center of the pixel, the mean of the tracer's jittered samples
+vec3 primaryDirection(in ivec2 pixel) {
+    float x = (float(pixel.x) + 1.0) / (float(p.width) - 1.0);
+    float y = 1.0 - (float(pixel.y) + 1.0) / (float(p.height) - 1.0);
+    return normalized(lowerLeftCorner + x * horizontal + y * vertical - p.camera);
+}
+
+// Inverse of primaryDirection() for the previous camera, negative when the point was behind it
+vec2 previousPixelPosition(in vec3 point) {
+    vec3 direction = vec3(sin(p.previousYaw) * cos(p.previousPitch), sin(p.previousPitch),
+                          cos(p.previousYaw) * cos(p.previousPitch));
+    vec3 right = normalized(cross(vec3(0, 1, 0), direction));
+    vec3 up = cross(direction, right);
+
+    vec3 offset = point - p.previousCamera;
+    float forward = dot(offset, direction);
+    if (forward <= 0.0) {
+        return vec2(-1.0);
+    }
+    float x = 0.5 + dot(offset, right) / (forward * viewportWidth);
+    float y = 0.5 + dot(offset, up) / (forward * viewportHeight);
+    return vec2(x * (float(p.width) - 1.0) - 1.0, (1.0 - y) * (float(p.height) - 1.0) - 1.0);
+}
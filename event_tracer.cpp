@@ -0,0 +1,140 @@
+#include "event_tracer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <tuple>
+
+namespace {
+
+constexpr int kCpuProcess = 1;
+constexpr int kGpuProcess = 2;
+
+}  // namespace
+
+EventTracer& EventTracer::get() {
+  static EventTracer tracer;
+  return tracer;
+}
+
+EventTracer::EventTracer() : _epoch(Clock::now()) {}
+
+void EventTracer::enable() {
+  _enabled.store(true, std::memory_order_relaxed);
+}
+
+bool EventTracer::isEnabled() const {
+  return _enabled.load(std::memory_order_relaxed);
+}
+
+int64_t EventTracer::now() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _epoch).count();
+}
+
+void EventTracer::record(const char* name, int64_t begin, int64_t end) {
+  getThreadRing().push(name, begin, end);
+}
+
+void EventTracer::setThreadName(const std::string& name) {
+  if (!isEnabled()) {
+    return;
+  }
+  Ring& ring = getThreadRing();
+  std::lock_guard<std::mutex> lock(_mutex);
+  ring.name = name;
+}
+
+void EventTracer::recordGpu(const char* name, int64_t begin, int64_t end) {
+  _gpuRing.push(name, begin, end);
+}
+
+void EventTracer::write(const std::string& filename) const {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open " + filename + "!");
+  }
+
+  file << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+  for (int process : {kCpuProcess, kGpuProcess}) {
+    file << (process == kCpuProcess ? "" : ",\n") << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": "
+         << process << ", \"args\": {\"name\": \"" << (process == kCpuProcess ? "CPU" : "GPU") << "\"}}";
+  }
+
+  auto writeRing = [&file](const Ring& ring, int process) {
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    uint64_t first = head > kRingSize ? head - kRingSize : 0;
+    std::vector<std::tuple<const char*, int64_t, int64_t>> events;
+    events.reserve(head - first);
+    for (uint64_t i = first; i < head; ++i) {
+      const Event& event = ring.events[i % kRingSize];
+      events.emplace_back(event.name.load(std::memory_order_relaxed), event.begin.load(std::memory_order_relaxed),
+                          event.end.load(std::memory_order_relaxed));
+    }
+    // Events the owner pushed while they were copied, or is pushing now, replaced the oldest ones. The fence keeps
+    // the copies from being read after the head below.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t valid = ring.head.load(std::memory_order_relaxed) + 1;
+    valid = valid > kRingSize ? valid - kRingSize : 0;
+    for (size_t i = valid > first ? std::min<uint64_t>(valid - first, events.size()) : 0; i < events.size(); ++i) {
+      const auto& [name, begin, end] = events[i];
+      file << ",\n  {\"name\": \"" << name << "\", \"ph\": \"X\", \"pid\": " << process << ", \"tid\": " << ring.id
+           << ", \"ts\": " << begin / 1e3 << ", \"dur\": " << (end - begin) / 1e3 << "}";
+    }
+  };
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto& ring : _rings) {
+      std::string name = ring->name.empty() ? "thread " + std::to_string(ring->id) : ring->name;
+      file << ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << kCpuProcess << ", \"tid\": " << ring->id
+           << ", \"args\": {\"name\": \"" << name << "\"}}";
+      writeRing(*ring, kCpuProcess);
+    }
+  }
+  writeRing(_gpuRing, kGpuProcess);
+  file << "\n]}\n";
+
+  if (!file) {
+    throw std::runtime_error("failed to write " + filename + "!");
+  }
+}
+
+void EventTracer::Ring::push(const char* name, int64_t begin, int64_t end) {
+  uint64_t index = head.load(std::memory_order_relaxed);
+  Event& event = events[index % kRingSize];
+  event.name.store(name, std::memory_order_relaxed);
+  event.begin.store(begin, std::memory_order_relaxed);
+  event.end.store(end, std::memory_order_relaxed);
+  head.store(index + 1, std::memory_order_release);
+}
+
+EventTracer::Ring& EventTracer::getThreadRing() {
+  // Rings stay registered after their thread exited, so its events are still written
+  thread_local Ring* ring = nullptr;
+  if (ring == nullptr) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _rings.push_back(std::make_unique<Ring>(static_cast<uint32_t>(_rings.size()) + 1));
+    ring = _rings.back().get();
+  }
+  return *ring;
+}
+
+TraceScope::TraceScope(const char* name) : _name(name) {
+  EventTracer& tracer = EventTracer::get();
+  if (tracer.isEnabled()) {
+    _begin = tracer.now();
+  }
+}
+
+TraceScope::~TraceScope() {
+  end();
+}
+
+void TraceScope::end() {
+  if (_begin >= 0) {
+    EventTracer& tracer = EventTracer::get();
+    tracer.record(_name, _begin, tracer.now());
+    _begin = -1;
+  }
+}
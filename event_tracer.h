@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Records named intervals of CPU work with nanosecond timestamps and writes them as Chrome trace JSON, which
+// chrome://tracing and ui.perfetto.dev open. Every thread records into a ring of its own that keeps its latest
+// kRingSize events, so recording takes no lock and never allocates after a thread's first event. Event names must
+// outlive the tracer, string literals in practice.
+class EventTracer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Everything records into the one process wide tracer, which starts disabled
+  static EventTracer& get();
+
+  void enable();
+  bool isEnabled() const;
+  // Nanoseconds since the tracer was created
+  int64_t now() const;
+
+  void record(const char* name, int64_t begin, int64_t end);
+  // Names the calling thread in the trace, if the tracer is enabled
+  void setThreadName(const std::string& name);
+  // Events of the GPU timeline, already converted to the tracer's clock. Only one thread may record them.
+  void recordGpu(const char* name, int64_t begin, int64_t end);
+
+  // Can be called while other threads record, events they overwrite meanwhile are left out
+  void write(const std::string& filename) const;
+
+ private:
+  static constexpr uint64_t kRingSize = 1 << 16;
+
+  // Fields are atomic so write() may read them while the owning thread records
+  struct Event {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t> begin{0};
+    std::atomic<int64_t> end{0};
+  };
+
+  struct Ring {
+    explicit Ring(uint32_t id) : id(id), events(kRingSize) {}
+
+    void push(const char* name, int64_t begin, int64_t end);
+
+    uint32_t id;
+    std::string name;  // Guarded by _mutex
+    std::vector<Event> events;
+    std::atomic<uint64_t> head{0};  // Events ever pushed, the latest kRingSize of them are kept
+  };
+
+  EventTracer();
+  Ring& getThreadRing();
+
+  Clock::time_point _epoch;
+  std::atomic<bool> _enabled{false};
+  mutable std::mutex _mutex;  // Guards registering rings and naming them, never taken to record
+  std::vector<std::unique_ptr<Ring>> _rings;
+  Ring _gpuRing{0};
+};
+
+// Records the time from its construction to its destruction, if the tracer is enabled
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name);
+  ~TraceScope();
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+  // Records the event now instead of when the scope ends
+  void end();
+
+ private:
+  const char* _name;
+  int64_t _begin = -1;  // -1 while the tracer was disabled
+};
@@ -0,0 +1,58 @@
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+
+FrameScheduler::FrameScheduler(Pacing pacing, float targetFrameTimeMs)
+    : _pacing(pacing),
+      _targetFrameTime(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float, std::milli>(targetFrameTimeMs))),
+      _nextFrame(Clock::now()),
+      _lastFrame(Clock::now()) {}
+
+void FrameScheduler::waitForFrame(bool idle) {
+  if (idle) {
+    glfwWaitEvents();
+  }
+
+  if (_pacing == Pacing::TargetFrameTime) {
+    for (auto now = Clock::now(); now < _nextFrame; now = Clock::now()) {
+      glfwWaitEventsTimeout(std::chrono::duration<double>(_nextFrame - now).count());
+    }
+  }
+  glfwPollEvents();
+
+  auto now = Clock::now();
+  // A late frame moves the schedule instead of rendering a burst of frames to catch up
+  _nextFrame = std::max(_nextFrame + _targetFrameTime, now);
+  _frameDelta = std::min(kMaxFrameDelta, std::chrono::duration<float>(now - _lastFrame).count());
+  _lastFrame = now;
+}
+
+float FrameScheduler::getFrameDelta() const {
+  return _frameDelta;
+}
+
+void LatencyStatistics::add(FrameScheduler::Clock::duration latency) {
+  _samples.push_back(std::chrono::duration<double, std::milli>(latency).count());
+  if (_samples.size() > kHistorySize) {
+    _samples.pop_front();
+  }
+}
+
+void LatencyStatistics::print(std::ostream& stream) const {
+  if (_samples.empty()) {
+    return;
+  }
+
+  std::vector<double> sorted(_samples.begin(), _samples.end());
+  std::sort(sorted.begin(), sorted.end());
+  double sum = 0.0;
+  for (double sample : sorted) {
+    sum += sample;
+  }
+
+  stream << std::fixed << std::setprecision(3) << "input to present: avg " << sum / sorted.size() << " ms, p99 "
+         << sorted[std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * 0.99))] << " ms, max "
+         << sorted.back() << " ms (" << sorted.size() << " frames)" << std::defaultfloat << std::endl;
+}
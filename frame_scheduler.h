@@ -0,0 +1,46 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <ostream>
+
+#include "settings.h"
+
+// Decides when the next frame starts and waits for it inside glfwWaitEvents*, so the thread sleeps instead of
+// spinning. Uncapped and vsync pacing start a frame right away and leave the blocking to the present mode.
+class FrameScheduler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  FrameScheduler(Pacing pacing, float targetFrameTimeMs);
+
+  // Processes window events until the next frame is due. An idle caller sleeps until any event arrives.
+  void waitForFrame(bool idle);
+  // Seconds between the starts of the last two frames
+  float getFrameDelta() const;
+
+ private:
+  static constexpr float kMaxFrameDelta = 0.25f;  // Keeps a stall from teleporting the camera
+
+  Pacing _pacing;
+  Clock::duration _targetFrameTime;
+  Clock::time_point _nextFrame;
+  Clock::time_point _lastFrame;
+  float _frameDelta = 0.0f;
+};
+
+// Rolling input-to-present latencies
+class LatencyStatistics {
+ public:
+  void add(FrameScheduler::Clock::duration latency);
+  void print(std::ostream& stream) const;
+
+ private:
+  static constexpr size_t kHistorySize = 256;
+
+  std::deque<double> _samples;  // In milliseconds
+};
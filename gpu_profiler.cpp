@@ -0,0 +1,170 @@
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+GpuProfiler::GpuProfiler(VkDevice device, uint32_t framesInFlight, uint32_t validBits, float period)
+    : _device(device), _frames(framesInFlight) {
+  if (validBits == 0) {
+    return;
+  }
+  _validMask = validBits >= 64 ? UINT64_MAX : (uint64_t(1) << validBits) - 1;
+  _periodMs = period / 1e6;
+
+  VkQueryPoolCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  createInfo.queryCount = framesInFlight * kMaxPasses * 2;
+
+  if (vkCreateQueryPool(_device, &createInfo, nullptr, _queryPool.put(_device)) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create timestamp query pool!");
+  }
+}
+
+bool GpuProfiler::isEnabled() const {
+  return _validMask != 0;
+}
+
+int64_t GpuProfiler::toNanoseconds(uint64_t timestamp) const {
+  return static_cast<int64_t>((timestamp & _validMask) * _periodMs * 1e6);
+}
+
+void GpuProfiler::setPassCallback(PassCallback callback) {
+  _passCallback = std::move(callback);
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frame) {
+  if (!isEnabled()) {
+    return;
+  }
+
+  _recordingFrame = frame;
+  _frames[frame].passNames.clear();
+  _frames[frame].pending = true;
+  vkCmdResetQueryPool(commandBuffer, *_queryPool, frame * kMaxPasses * 2, kMaxPasses * 2);
+}
+
+uint32_t GpuProfiler::beginPass(VkCommandBuffer commandBuffer, const char* name) {
+  auto& passNames = _frames[_recordingFrame].passNames;
+  if (!isEnabled() || passNames.size() >= kMaxPasses) {
+    return kMaxPasses;
+  }
+
+  auto pass = static_cast<uint32_t>(passNames.size());
+  passNames.push_back(name);
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, *_queryPool,
+                      (_recordingFrame * kMaxPasses + pass) * 2);
+  return pass;
+}
+
+void GpuProfiler::endPass(VkCommandBuffer commandBuffer, uint32_t pass) {
+  if (!isEnabled() || pass >= kMaxPasses) {
+    return;
+  }
+
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, *_queryPool,
+                      (_recordingFrame * kMaxPasses + pass) * 2 + 1);
+}
+
+bool GpuProfiler::collect(uint32_t frame) {
+  FrameQueries& queries = _frames[frame];
+  if (!isEnabled() || !queries.pending || queries.passNames.empty()) {
+    return false;
+  }
+  queries.pending = false;
+
+  std::vector<uint64_t> timestamps(queries.passNames.size() * 2);
+  // No WAIT flag: the fence already signaled, anything not available yet is dropped instead of blocking
+  VkResult result = vkGetQueryPoolResults(_device, *_queryPool, frame * kMaxPasses * 2, timestamps.size(),
+                                          timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t),
+                                          VK_QUERY_RESULT_64_BIT);
+  if (result != VK_SUCCESS) {
+    return false;
+  }
+
+  for (size_t pass = 0; pass < queries.passNames.size(); ++pass) {
+    std::string name = queries.passNames[pass];
+    if (_history.find(name) == _history.end()) {
+      _passOrder.push_back(name);
+    }
+    auto& history = _history[name];
+
+    uint64_t ticks = ((timestamps[pass * 2 + 1] & _validMask) - (timestamps[pass * 2] & _validMask)) & _validMask;
+    history.push_back(ticks * _periodMs);
+    if (history.size() > kHistorySize) {
+      history.pop_front();
+    }
+    if (_passCallback) {
+      int64_t begin = toNanoseconds(timestamps[pass * 2]);
+      _passCallback(queries.passNames[pass], begin, begin + static_cast<int64_t>(ticks * _periodMs * 1e6));
+    }
+  }
+  return true;
+}
+
+std::vector<GpuProfiler::PassStatistics> GpuProfiler::getStatistics() const {
+  std::vector<PassStatistics> statistics;
+  for (const auto& name : _passOrder) {
+    const auto& history = _history.at(name);
+    if (history.empty()) {
+      continue;
+    }
+
+    std::vector<double> sorted(history.begin(), history.end());
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (double value : sorted) {
+      sum += value;
+    }
+
+    PassStatistics pass;
+    pass.name = name;
+    pass.count = sorted.size();
+    pass.minMs = sorted.front();
+    pass.averageMs = sum / sorted.size();
+    pass.p99Ms = sorted[std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * 0.99))];
+    statistics.push_back(pass);
+  }
+  return statistics;
+}
+
+double GpuProfiler::getLatestMs(const std::string& name) const {
+  auto history = _history.find(name);
+  return history == _history.end() || history->second.empty() ? 0.0 : history->second.back();
+}
+
+void GpuProfiler::print(std::ostream& stream) const {
+  for (const auto& pass : getStatistics()) {
+    stream << std::fixed << std::setprecision(3) << pass.name << ": min " << pass.minMs << " ms, avg "
+           << pass.averageMs << " ms, p99 " << pass.p99Ms << " ms (" << pass.count << " frames)" << std::endl;
+  }
+  stream << std::defaultfloat;
+}
+
+void GpuProfiler::write(const std::string& filename) const {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open " + filename + "!");
+  }
+
+  auto statistics = getStatistics();
+  bool csv = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
+  if (csv) {
+    file << "pass,frames,min_ms,avg_ms,p99_ms\n";
+    for (const auto& pass : statistics) {
+      file << pass.name << "," << pass.count << "," << pass.minMs << "," << pass.averageMs << "," << pass.p99Ms << "\n";
+    }
+    return;
+  }
+
+  file << "{\n  \"passes\": [";
+  for (size_t i = 0; i < statistics.size(); ++i) {
+    const auto& pass = statistics[i];
+    file << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << pass.name << "\", \"frames\": " << pass.count
+         << ", \"min_ms\": " << pass.minMs << ", \"avg_ms\": " << pass.averageMs << ", \"p99_ms\": " << pass.p99Ms
+         << "}";
+  }
+  file << "\n  ]\n}\n";
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "vk_wrapper.h"
+
+// Timestamp queries around the passes of every frame in flight. Results of a frame are collected the next time
+// its slot is used, after its fence was waited on, so reading them never stalls.
+class GpuProfiler {
+ public:
+  struct PassStatistics {
+    std::string name;
+    size_t count;
+    double minMs;
+    double averageMs;
+    double p99Ms;
+  };
+
+  // Receives every collected pass with its timestamps in nanoseconds of the GPU clock
+  using PassCallback = std::function<void(const char* name, int64_t begin, int64_t end)>;
+
+  // Timestamps are disabled when validBits is zero, every call is a no-op then
+  GpuProfiler(VkDevice device, uint32_t framesInFlight, uint32_t validBits, float period);
+
+  bool isEnabled() const;
+  // Converts a raw timestamp to nanoseconds
+  int64_t toNanoseconds(uint64_t timestamp) const;
+  void setPassCallback(PassCallback callback);
+
+  // Must be recorded outside of a render pass before the first pass of the frame
+  void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+  uint32_t beginPass(VkCommandBuffer commandBuffer, const char* name);
+  void endPass(VkCommandBuffer commandBuffer, uint32_t pass);
+  // Call once the fence of the frame has been waited on, returns whether timings of the frame were added
+  bool collect(uint32_t frame);
+
+  // Rolling statistics over the last kHistorySize frames, in the order the passes were first seen
+  std::vector<PassStatistics> getStatistics() const;
+  // Duration of the pass in the most recently collected frame, zero if it was never measured
+  double getLatestMs(const std::string& name) const;
+  void print(std::ostream& stream) const;
+  // Format is chosen by the extension, .csv or anything else for JSON
+  void write(const std::string& filename) const;
+
+ private:
+  static constexpr uint32_t kMaxPasses = 8;
+  static constexpr size_t kHistorySize = 256;
+
+  struct FrameQueries {
+    std::vector<const char*> passNames;
+    bool pending = false;
+  };
+
+  VkDevice _device;
+  uint64_t _validMask = 0;
+  double _periodMs = 0.0;
+  uint32_t _recordingFrame = 0;
+  std::vector<FrameQueries> _frames;
+  std::vector<std::string> _passOrder;
+  std::map<std::string, std::deque<double>> _history;
+  PassCallback _passCallback;
+  VkDeviceChild<VkQueryPool, vkDestroyQueryPool> _queryPool;
+};
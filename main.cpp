@@ -4,10 +4,9 @@
 
 #include "application.h"
 
-int main() {
-  Application app;
-
+int main(int argc, char** argv) {
   try {
+    Application app(parseSettings(argc, argv));
     app.run();
   } catch (const std::exception& e) {
     std::cerr << e.what() << std::endl;
@@ -0,0 +1,362 @@
+#include "memory_allocator.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+namespace {
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+double toMiB(VkDeviceSize bytes) {
+  return static_cast<double>(bytes) / (1 << 20);
+}
+
+}  // namespace
+
+MemoryAllocation::MemoryAllocation(MemoryAllocation&& other) noexcept
+    : _allocator(other._allocator), _memory(other._memory), _offset(other._offset), _size(other._size),
+      _mapped(other._mapped) {
+  other.release();
+}
+
+MemoryAllocation& MemoryAllocation::operator=(MemoryAllocation&& other) noexcept {
+  if (this != &other) {
+    reset();
+    _allocator = other._allocator;
+    _memory = other._memory;
+    _offset = other._offset;
+    _size = other._size;
+    _mapped = other._mapped;
+    other.release();
+  }
+  return *this;
+}
+
+MemoryAllocation::~MemoryAllocation() {
+  reset();
+}
+
+VkDeviceMemory MemoryAllocation::getMemory() const {
+  return _memory;
+}
+
+VkDeviceSize MemoryAllocation::getOffset() const {
+  return _offset;
+}
+
+VkDeviceSize MemoryAllocation::getSize() const {
+  return _size;
+}
+
+void* MemoryAllocation::getMapped() const {
+  return _mapped;
+}
+
+MemoryAllocator* MemoryAllocation::getAllocator() const {
+  return _allocator;
+}
+
+void MemoryAllocation::release() {
+  _allocator = nullptr;
+  _memory = VK_NULL_HANDLE;
+  _offset = 0;
+  _size = 0;
+  _mapped = nullptr;
+}
+
+void MemoryAllocation::reset() {
+  if (_allocator != nullptr && _memory != VK_NULL_HANDLE) {
+    _allocator->free(_memory, _offset);
+  }
+  release();
+}
+
+MemoryAllocator::MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight)
+    : _device(device), _arenas(framesInFlight) {
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &_memoryProperties);
+
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+  _bufferImageGranularity = deviceProperties.limits.bufferImageGranularity;
+  _maxAllocationCount = deviceProperties.limits.maxMemoryAllocationCount;
+}
+
+MemoryAllocator::~MemoryAllocator() {
+  for (const auto& block : _blocks) {
+    vkFreeMemory(_device, block->memory, nullptr);
+  }
+  for (const auto& arenas : _arenas) {
+    for (const auto& [memoryType, arena] : arenas) {
+      vkFreeMemory(_device, arena.memory, nullptr);
+      for (VkDeviceMemory memory : arena.fullMemory) {
+        vkFreeMemory(_device, memory, nullptr);
+      }
+    }
+  }
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+  auto cached = _memoryTypes.find({typeFilter, properties});
+  if (cached != _memoryTypes.end()) {
+    return cached->second;
+  }
+
+  for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; i++) {
+    if ((typeFilter & (1 << i)) && (_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+      _memoryTypes[{typeFilter, properties}] = i;
+      return i;
+    }
+  }
+
+  throw std::runtime_error("failed to find suitable memory type!");
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties) {
+  uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+  VkDeviceSize alignment = getAlignment(requirements);
+
+  // Best fit over every free range of the memory type
+  Block* bestBlock = nullptr;
+  VkDeviceSize bestRangeOffset = 0;
+  VkDeviceSize bestRangeSize = 0;
+  for (const auto& block : _blocks) {
+    if (block->memoryType != memoryType) {
+      continue;
+    }
+    for (const auto& [offset, size] : block->freeRanges) {
+      VkDeviceSize padding = alignUp(offset, alignment) - offset;
+      if (size >= padding + requirements.size && (bestBlock == nullptr || size < bestRangeSize)) {
+        bestBlock = block.get();
+        bestRangeOffset = offset;
+        bestRangeSize = size;
+      }
+    }
+  }
+
+  if (bestBlock == nullptr) {
+    // A block for a resource larger than half the default size is sized to fit it, not to leave a hard to use rest
+    VkDeviceSize blockSize = requirements.size > kBlockSize / 2 ? requirements.size : kBlockSize;
+    auto block = std::make_unique<Block>();
+    block->memory = allocateDeviceMemory(blockSize, memoryType, &block->mapped);
+    block->size = blockSize;
+    block->memoryType = memoryType;
+    block->freeRanges[0] = blockSize;
+    bestBlock = block.get();
+    bestRangeOffset = 0;
+    bestRangeSize = blockSize;
+    _blocksByMemory[block->memory] = block.get();
+    _blocks.push_back(std::move(block));
+  }
+
+  VkDeviceSize offset = alignUp(bestRangeOffset, alignment);
+  bestBlock->freeRanges.erase(bestRangeOffset);
+  if (offset > bestRangeOffset) {
+    bestBlock->freeRanges[bestRangeOffset] = offset - bestRangeOffset;
+  }
+  VkDeviceSize end = offset + requirements.size;
+  if (end < bestRangeOffset + bestRangeSize) {
+    bestBlock->freeRanges[end] = bestRangeOffset + bestRangeSize - end;
+  }
+  bestBlock->allocations[offset] = requirements.size;
+
+  MemoryAllocation allocation;
+  allocation._allocator = this;
+  allocation._memory = bestBlock->memory;
+  allocation._offset = offset;
+  allocation._size = requirements.size;
+  allocation._mapped = bestBlock->mapped != nullptr ? static_cast<char*>(bestBlock->mapped) + offset : nullptr;
+  return allocation;
+}
+
+MemoryAllocation MemoryAllocator::allocateTransient(uint32_t frame, const VkMemoryRequirements& requirements,
+                                                    VkMemoryPropertyFlags properties) {
+  uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+  auto& arenas = _arenas.at(frame);
+  auto found = arenas.find(memoryType);
+  if (found == arenas.end()) {
+    Arena arena{};
+    arena.memory = allocateDeviceMemory(kArenaSize, memoryType, &arena.mapped);
+    arena.size = kArenaSize;
+    found = arenas.emplace(memoryType, arena).first;
+  }
+
+  Arena& arena = found->second;
+  VkDeviceSize offset = alignUp(arena.head, getAlignment(requirements));
+  if (offset + requirements.size > arena.size) {
+    // Twice as large, so a frame that needs more keeps fitting into one arena after the reset
+    arena.fullMemory.push_back(arena.memory);
+    arena.size = std::max(arena.size * 2, requirements.size);
+    arena.memory = allocateDeviceMemory(arena.size, memoryType, &arena.mapped);
+    arena.head = 0;
+    offset = 0;
+  }
+  arena.used += offset + requirements.size - arena.head;
+  arena.head = offset + requirements.size;
+  arena.peak = std::max(arena.peak, arena.used);
+
+  MemoryAllocation allocation;
+  allocation._memory = arena.memory;
+  allocation._offset = offset;
+  allocation._size = requirements.size;
+  allocation._mapped = arena.mapped != nullptr ? static_cast<char*>(arena.mapped) + offset : nullptr;
+  return allocation;
+}
+
+void MemoryAllocator::free(VkDeviceMemory memory, VkDeviceSize offset) {
+  Block* block = _blocksByMemory.at(memory);
+  auto allocation = block->allocations.find(offset);
+  if (allocation == block->allocations.end()) {
+    throw std::runtime_error("freeing memory that was not allocated!");
+  }
+  VkDeviceSize size = allocation->second;
+  block->allocations.erase(allocation);
+
+  // Merge with the free neighbours, so ranges never fragment into adjacent pieces
+  auto next = block->freeRanges.lower_bound(offset);
+  if (next != block->freeRanges.end() && next->first == offset + size) {
+    size += next->second;
+    next = block->freeRanges.erase(next);
+  }
+  auto previous = next != block->freeRanges.begin() ? std::prev(next) : block->freeRanges.end();
+  if (previous != block->freeRanges.end() && previous->first + previous->second == offset) {
+    previous->second += size;
+  } else {
+    block->freeRanges[offset] = size;
+  }
+
+  if (block->allocations.empty()) {
+    releaseEmptyBlock(block);
+  }
+}
+
+void MemoryAllocator::resetFrame(uint32_t frame) {
+  for (auto& [memoryType, arena] : _arenas.at(frame)) {
+    for (VkDeviceMemory memory : arena.fullMemory) {
+      freeDeviceMemory(memory);
+    }
+    arena.fullMemory.clear();
+    arena.head = 0;
+    arena.used = 0;
+  }
+}
+
+MemoryAllocation MemoryAllocator::allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties) {
+  VkMemoryRequirements memoryRequirements;
+  vkGetBufferMemoryRequirements(_device, buffer, &memoryRequirements);
+  MemoryAllocation allocation = allocate(memoryRequirements, properties);
+  vkBindBufferMemory(_device, buffer, allocation.getMemory(), allocation.getOffset());
+  return allocation;
+}
+
+MemoryAllocation MemoryAllocator::allocateTransientForBuffer(uint32_t frame, VkBuffer buffer,
+                                                             VkMemoryPropertyFlags properties) {
+  VkMemoryRequirements memoryRequirements;
+  vkGetBufferMemoryRequirements(_device, buffer, &memoryRequirements);
+  MemoryAllocation allocation = allocateTransient(frame, memoryRequirements, properties);
+  vkBindBufferMemory(_device, buffer, allocation.getMemory(), allocation.getOffset());
+  return allocation;
+}
+
+MemoryAllocation MemoryAllocator::allocateForImage(VkImage image, VkMemoryPropertyFlags properties) {
+  VkMemoryRequirements memoryRequirements;
+  vkGetImageMemoryRequirements(_device, image, &memoryRequirements);
+  MemoryAllocation allocation = allocate(memoryRequirements, properties);
+  vkBindImageMemory(_device, image, allocation.getMemory(), allocation.getOffset());
+  return allocation;
+}
+
+void MemoryAllocator::printStatistics(std::ostream& stream) const {
+  stream << std::fixed << std::setprecision(1);
+  for (uint32_t memoryType = 0; memoryType < _memoryProperties.memoryTypeCount; ++memoryType) {
+    size_t blocks = 0;
+    size_t allocations = 0;
+    VkDeviceSize reserved = 0;
+    VkDeviceSize used = 0;
+    VkDeviceSize largestFree = 0;
+    size_t freeRanges = 0;
+    for (const auto& block : _blocks) {
+      if (block->memoryType != memoryType) {
+        continue;
+      }
+      ++blocks;
+      reserved += block->size;
+      allocations += block->allocations.size();
+      for (const auto& [offset, size] : block->allocations) {
+        used += size;
+      }
+      freeRanges += block->freeRanges.size();
+      for (const auto& [offset, size] : block->freeRanges) {
+        largestFree = std::max(largestFree, size);
+      }
+    }
+    if (blocks == 0) {
+      continue;
+    }
+    stream << "memory type " << memoryType << ": " << blocks << " blocks, " << toMiB(reserved) << " MiB reserved, "
+           << toMiB(used) << " MiB used by " << allocations << " allocations, " << freeRanges
+           << " free ranges, largest " << toMiB(largestFree) << " MiB" << std::endl;
+  }
+
+  for (uint32_t frame = 0; frame < _arenas.size(); ++frame) {
+    for (const auto& [memoryType, arena] : _arenas[frame]) {
+      stream << "frame " << frame << " arena of memory type " << memoryType << ": " << toMiB(arena.size)
+             << " MiB, peak " << toMiB(arena.peak) << " MiB" << std::endl;
+    }
+  }
+  stream << std::defaultfloat << _deviceAllocationCount << " of " << _maxAllocationCount
+         << " device memory allocations in use" << std::endl;
+}
+
+VkDeviceMemory MemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped) {
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = memoryType;
+
+  VkDeviceMemory memory;
+  if (vkAllocateMemory(_device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate device memory!");
+  }
+  ++_deviceAllocationCount;
+
+  *mapped = nullptr;
+  if (_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    if (vkMapMemory(_device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+      throw std::runtime_error("failed to map device memory!");
+    }
+  }
+  return memory;
+}
+
+void MemoryAllocator::freeDeviceMemory(VkDeviceMemory memory) {
+  vkFreeMemory(_device, memory, nullptr);
+  --_deviceAllocationCount;
+}
+
+void MemoryAllocator::releaseEmptyBlock(Block* block) {
+  bool keep = block->size == kBlockSize;
+  for (const auto& other : _blocks) {
+    if (other.get() != block && other->memoryType == block->memoryType && other->allocations.empty() &&
+        other->size == kBlockSize) {
+      keep = false;
+    }
+  }
+  if (keep) {
+    return;
+  }
+
+  freeDeviceMemory(block->memory);
+  _blocksByMemory.erase(block->memory);
+  _blocks.erase(std::find_if(_blocks.begin(), _blocks.end(), [block](const auto& other) {
+    return other.get() == block;
+  }));
+}
+
+VkDeviceSize MemoryAllocator::getAlignment(const VkMemoryRequirements& requirements) const {
+  // Buffers and optimally tiled images share blocks, keeping every resource on its own granularity page is
+  // simpler than tracking which neighbours are linear
+  return std::max(requirements.alignment, _bufferImageGranularity);
+}
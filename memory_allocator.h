@@ -0,0 +1,116 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+class MemoryAllocator;
+
+// A range of device memory. Allocations from the block pools free their range when destroyed, transient ones are
+// released all at once when their frame's arena is reset.
+class MemoryAllocation {
+ public:
+  MemoryAllocation() = default;
+  MemoryAllocation(const MemoryAllocation&) = delete;
+  MemoryAllocation& operator=(const MemoryAllocation&) = delete;
+  MemoryAllocation(MemoryAllocation&& other) noexcept;
+  MemoryAllocation& operator=(MemoryAllocation&& other) noexcept;
+  ~MemoryAllocation();
+
+  VkDeviceMemory getMemory() const;
+  VkDeviceSize getOffset() const;
+  VkDeviceSize getSize() const;
+  // Persistently mapped pointer to the start of the range, null unless the memory is host visible
+  void* getMapped() const;
+  MemoryAllocator* getAllocator() const;
+
+  // Hands ownership of the range to the caller, who frees it with MemoryAllocator::free()
+  void release();
+  void reset();
+
+ private:
+  friend class MemoryAllocator;
+
+  MemoryAllocator* _allocator = nullptr;  // Null for transient allocations
+  VkDeviceMemory _memory = VK_NULL_HANDLE;
+  VkDeviceSize _offset = 0;
+  VkDeviceSize _size = 0;
+  void* _mapped = nullptr;
+};
+
+// Sub-allocates device memory, so resources don't each need their own vkAllocateMemory call:
+// - long-lived buffers and images come from pools of large blocks per memory type, placed best fit and coalesced
+//   when freed, so allocation cost stays predictable and fragmentation low
+// - transient per-frame data comes from linear arenas that are reset once the frame's fence signaled. An arena that
+//   runs full continues in a larger one, the full one is freed with the next reset.
+// Host visible blocks are mapped once when they are created. Empty blocks are freed, except one of the default size
+// per memory type.
+class MemoryAllocator {
+ public:
+  MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight);
+  // Every allocation must be freed before
+  ~MemoryAllocator();
+  MemoryAllocator(const MemoryAllocator&) = delete;
+  MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+  uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+
+  MemoryAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties);
+  MemoryAllocation allocateTransient(uint32_t frame, const VkMemoryRequirements& requirements,
+                                     VkMemoryPropertyFlags properties);
+  void free(VkDeviceMemory memory, VkDeviceSize offset);
+  // Call once the fence of the frame has been waited on
+  void resetFrame(uint32_t frame);
+
+  // Convenience wrappers that allocate and bind
+  MemoryAllocation allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+  MemoryAllocation allocateTransientForBuffer(uint32_t frame, VkBuffer buffer, VkMemoryPropertyFlags properties);
+  MemoryAllocation allocateForImage(VkImage image, VkMemoryPropertyFlags properties);
+
+  void printStatistics(std::ostream& stream) const;
+
+ private:
+  static constexpr VkDeviceSize kBlockSize = 64ull << 20;
+  static constexpr VkDeviceSize kArenaSize = 16ull << 20;
+
+  struct Block {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint32_t memoryType;
+    void* mapped;
+    std::map<VkDeviceSize, VkDeviceSize> freeRanges;  // Offset to size, never adjacent
+    std::map<VkDeviceSize, VkDeviceSize> allocations;  // Offset to size
+  };
+
+  struct Arena {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    void* mapped;
+    VkDeviceSize head = 0;
+    VkDeviceSize used = 0;  // By the frame, including what it took from full arenas
+    VkDeviceSize peak = 0;
+    std::vector<VkDeviceMemory> fullMemory;  // Still used by the frame, freed with the next reset
+  };
+
+  VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped);
+  void freeDeviceMemory(VkDeviceMemory memory);
+  // Frees the block if another empty one of its memory type is kept already, or if it is larger than the default
+  void releaseEmptyBlock(Block* block);
+  VkDeviceSize getAlignment(const VkMemoryRequirements& requirements) const;
+
+  VkDevice _device;
+  VkPhysicalDeviceMemoryProperties _memoryProperties;
+  VkDeviceSize _bufferImageGranularity;
+  uint32_t _maxAllocationCount;
+  std::map<std::pair<uint32_t, VkMemoryPropertyFlags>, uint32_t> _memoryTypes;  // Cached findMemoryType() results
+  std::vector<std::unique_ptr<Block>> _blocks;
+  std::map<VkDeviceMemory, Block*> _blocksByMemory;
+  std::vector<std::map<uint32_t, Arena>> _arenas;  // Per frame in flight and memory type
+  uint32_t _deviceAllocationCount = 0;
+};
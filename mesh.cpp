@@ -0,0 +1,464 @@
+#include "mesh.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <thread>
+
+#include "event_tracer.h"
+
+namespace {
+
+constexpr char kBinaryMagic[4] = {'M', 'E', 'S', 'H'};
+constexpr uint32_t kBinaryVersion = 1;
+constexpr float kQuantizationSteps = 65535.0f;
+constexpr uint32_t kUnusedVertex = ~0u;
+
+// Read only mapping of a whole file, the kernel reads pages in as the parsers touch them
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& filename) {
+    int descriptor = open(filename.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+      throw std::runtime_error("failed to open " + filename + "!");
+    }
+    struct stat status {};
+    if (fstat(descriptor, &status) != 0) {
+      close(descriptor);
+      throw std::runtime_error("failed to stat " + filename + "!");
+    }
+    _size = static_cast<size_t>(status.st_size);
+    if (_size > 0) {
+      void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+      if (data == MAP_FAILED) {
+        close(descriptor);
+        throw std::runtime_error("failed to map " + filename + "!");
+      }
+      // Every chunk is read front to back, so aggressive read ahead pays off
+      madvise(data, _size, MADV_SEQUENTIAL);
+      _data = static_cast<const char*>(data);
+    }
+    close(descriptor);
+  }
+
+  ~MappedFile() {
+    if (_data != nullptr) {
+      munmap(const_cast<char*>(_data), _size);
+    }
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* getData() const {
+    return _data;
+  }
+
+  size_t getSize() const {
+    return _size;
+  }
+
+ private:
+  const char* _data = nullptr;
+  size_t _size = 0;
+};
+
+// Calls function(worker, begin, end) for one contiguous range of [0, count) per thread and rethrows the first
+// exception a thread failed with
+template <typename Function>
+void parallelFor(size_t count, uint32_t threadCount, const Function& function) {
+  threadCount = static_cast<uint32_t>(std::clamp<size_t>(count, 1, std::max(1u, threadCount)));
+  std::vector<std::exception_ptr> errors(threadCount);
+  std::vector<std::thread> threads;
+  for (uint32_t worker = 0; worker < threadCount; ++worker) {
+    size_t begin = count * worker / threadCount;
+    size_t end = count * (worker + 1) / threadCount;
+    threads.emplace_back([&function, &errors, worker, begin, end] {
+      try {
+        function(worker, begin, end);
+      } catch (const std::exception&) {
+        errors[worker] = std::current_exception();
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (const std::exception_ptr& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+// Calls function(index) for every index of [0, count), each thread takes the next index once it is done with one
+template <typename Function>
+void parallelForEach(size_t count, uint32_t threadCount, const Function& function) {
+  std::atomic<size_t> next{0};
+  parallelFor(std::min<size_t>(count, std::max(1u, threadCount)), threadCount, [&](uint32_t, size_t, size_t) {
+    for (size_t index = next++; index < count; index = next++) {
+      function(index);
+    }
+  });
+}
+
+bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// Moves p to the next whitespace separated token of the line, false at its end or at a comment
+bool findToken(const char*& p, const char* lineEnd) {
+  while (p < lineEnd && (*p == ' ' || *p == '\t' || *p == '\r')) {
+    ++p;
+  }
+  return p < lineEnd && *p != '#';
+}
+
+void skipToken(const char*& p, const char* lineEnd) {
+  while (p < lineEnd && *p != ' ' && *p != '\t' && *p != '\r') {
+    ++p;
+  }
+}
+
+bool parseInt(const char*& p, const char* end, int64_t& value) {
+  bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) {
+    ++p;
+  }
+  if (p == end || !isDigit(*p)) {
+    return false;
+  }
+  value = 0;
+  while (p < end && isDigit(*p)) {
+    value = std::min<int64_t>(value * 10 + (*p - '0'), int64_t{1} << 40);
+    ++p;
+  }
+  value = negative ? -value : value;
+  return true;
+}
+
+// Plain decimal and scientific notation, without the locale lookups and the null terminator strtof needs
+bool parseFloat(const char*& p, const char* end, float& value) {
+  bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) {
+    ++p;
+  }
+  double mantissa = 0.0;
+  int exponent = 0;
+  bool digits = false;
+  for (; p < end && isDigit(*p); ++p) {
+    mantissa = mantissa * 10.0 + (*p - '0');
+    digits = true;
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && isDigit(*p); ++p) {
+      mantissa = mantissa * 10.0 + (*p - '0');
+      --exponent;
+      digits = true;
+    }
+  }
+  if (!digits) {
+    return false;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    ++p;
+    int64_t written;
+    if (!parseInt(p, end, written)) {
+      return false;
+    }
+    exponent += static_cast<int>(std::clamp<int64_t>(written, -1000, 1000));
+  }
+  value = static_cast<float>((negative ? -mantissa : mantissa) * std::pow(10.0, exponent));
+  return true;
+}
+
+enum class ObjLine {
+  Other,
+  Vertex,
+  Face,
+};
+
+// Moves p past the keyword of a vertex or face line
+ObjLine classifyLine(const char*& p, const char* lineEnd) {
+  while (p < lineEnd && (*p == ' ' || *p == '\t')) {
+    ++p;
+  }
+  if (lineEnd - p < 2 || (p[1] != ' ' && p[1] != '\t')) {
+    return ObjLine::Other;
+  }
+  ObjLine line = p[0] == 'v' ? ObjLine::Vertex : p[0] == 'f' ? ObjLine::Face : ObjLine::Other;
+  if (line != ObjLine::Other) {
+    p += 2;
+  }
+  return line;
+}
+
+template <typename Function>
+void forEachLine(const char* begin, const char* end, const Function& function) {
+  for (const char* p = begin; p < end;) {
+    const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    lineEnd = lineEnd != nullptr ? lineEnd : end;
+    function(p, lineEnd);
+    p = lineEnd < end ? lineEnd + 1 : end;
+  }
+}
+
+// Chunks are counted first, so that every thread knows where its vertices and triangles go and resolves relative
+// indices, then parsed straight into the result
+Mesh loadObj(const MappedFile& file, const std::string& filename, uint32_t threadCount) {
+  const char* data = file.getData();
+  size_t size = file.getSize();
+
+  // Several chunks per thread, taken by whichever thread is free, even out dense and sparse parts of the file. Chunks
+  // start at the beginning of a line.
+  size_t chunkCount = std::clamp<size_t>(size / (1 << 20), 1, std::max(1u, threadCount) * 4);
+  std::vector<size_t> boundaries(chunkCount + 1, size);
+  boundaries[0] = 0;
+  for (size_t chunk = 1; chunk < chunkCount; ++chunk) {
+    size_t boundary = std::max(boundaries[chunk - 1], size * chunk / chunkCount);
+    if (boundary > 0 && boundary < size && data[boundary - 1] != '\n') {
+      const char* newline = static_cast<const char*>(std::memchr(data + boundary, '\n', size - boundary));
+      boundary = newline != nullptr ? newline - data + 1 : size;
+    }
+    boundaries[chunk] = boundary;
+  }
+
+  std::vector<size_t> vertexOffsets(chunkCount + 1, 0);
+  std::vector<size_t> triangleOffsets(chunkCount + 1, 0);
+  parallelForEach(chunkCount, threadCount, [&](size_t chunk) {
+    forEachLine(data + boundaries[chunk], data + boundaries[chunk + 1], [&](const char* p, const char* lineEnd) {
+      ObjLine line = classifyLine(p, lineEnd);
+      if (line == ObjLine::Vertex) {
+        ++vertexOffsets[chunk + 1];
+      } else if (line == ObjLine::Face) {
+        size_t corners = 0;
+        for (; findToken(p, lineEnd); skipToken(p, lineEnd)) {
+          ++corners;
+        }
+        triangleOffsets[chunk + 1] += corners >= 3 ? corners - 2 : 0;
+      }
+    });
+  });
+  for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+    vertexOffsets[chunk + 1] += vertexOffsets[chunk];
+    triangleOffsets[chunk + 1] += triangleOffsets[chunk];
+  }
+
+  size_t vertexCount = vertexOffsets[chunkCount];
+  size_t triangleCount = triangleOffsets[chunkCount];
+  if (vertexCount > kUnusedVertex || triangleCount > kUnusedVertex) {
+    throw std::runtime_error(filename + " is too large!");
+  }
+  Mesh mesh;
+  mesh.positions.resize(vertexCount);
+  mesh.indices.resize(triangleCount * 3);
+
+  parallelForEach(chunkCount, threadCount, [&](size_t chunk) {
+    std::vector<uint32_t> corners;
+    size_t vertex = vertexOffsets[chunk];
+    uint32_t* indices = mesh.indices.data() + triangleOffsets[chunk] * 3;
+    forEachLine(data + boundaries[chunk], data + boundaries[chunk + 1], [&](const char* p, const char* lineEnd) {
+      ObjLine line = classifyLine(p, lineEnd);
+      if (line == ObjLine::Vertex) {
+        glm::vec3& position = mesh.positions[vertex++];
+        for (int axis = 0; axis < 3; ++axis) {
+          if (!findToken(p, lineEnd) || !parseFloat(p, lineEnd, position[axis])) {
+            throw std::runtime_error("invalid vertex in " + filename + "!");
+          }
+        }
+      } else if (line == ObjLine::Face) {
+        // Corners are v, v/vt, v//vn or v/vt/vn, counted from 1 or, if negative, back from the latest vertex
+        corners.clear();
+        for (; findToken(p, lineEnd); skipToken(p, lineEnd)) {
+          int64_t index;
+          if (!parseInt(p, lineEnd, index) || index == 0) {
+            throw std::runtime_error("invalid face in " + filename + "!");
+          }
+          index = index > 0 ? index - 1 : static_cast<int64_t>(vertex) + index;
+          if (index < 0 || index >= static_cast<int64_t>(vertexCount)) {
+            throw std::runtime_error("face references a missing vertex in " + filename + "!");
+          }
+          corners.push_back(static_cast<uint32_t>(index));
+        }
+        for (size_t corner = 2; corner < corners.size(); ++corner) {
+          *indices++ = corners[0];
+          *indices++ = corners[corner - 1];
+          *indices++ = corners[corner];
+        }
+      }
+    });
+  });
+
+  return mesh;
+}
+
+// Little endian hosts only, like the files it reads
+Mesh loadBinary(const MappedFile& file, const std::string& filename, uint32_t threadCount) {
+  BinaryMeshHeader header;
+  if (file.getSize() < sizeof(header)) {
+    throw std::runtime_error(filename + " is not a binary mesh!");
+  }
+  std::memcpy(&header, file.getData(), sizeof(header));
+  if (std::memcmp(header.magic, kBinaryMagic, sizeof(kBinaryMagic)) != 0 || header.version != kBinaryVersion) {
+    throw std::runtime_error(filename + " is not a binary mesh of version " + std::to_string(kBinaryVersion) + "!");
+  }
+  size_t positionsSize = static_cast<size_t>(header.vertexCount) * sizeof(glm::vec3);
+  size_t indicesSize = static_cast<size_t>(header.triangleCount) * 3 * sizeof(uint32_t);
+  if (file.getSize() != sizeof(header) + positionsSize + indicesSize) {
+    throw std::runtime_error(filename + " is truncated!");
+  }
+
+  Mesh mesh;
+  mesh.positions.resize(header.vertexCount);
+  mesh.indices.resize(static_cast<size_t>(header.triangleCount) * 3);
+  const char* positions = file.getData() + sizeof(header);
+  const char* indices = positions + positionsSize;
+  parallelFor(mesh.positions.size(), threadCount, [&](uint32_t, size_t begin, size_t end) {
+    std::memcpy(mesh.positions.data() + begin, positions + begin * sizeof(glm::vec3),
+                (end - begin) * sizeof(glm::vec3));
+  });
+  parallelFor(mesh.indices.size(), threadCount, [&](uint32_t, size_t begin, size_t end) {
+    std::memcpy(mesh.indices.data() + begin, indices + begin * sizeof(uint32_t), (end - begin) * sizeof(uint32_t));
+    for (size_t i = begin; i < end; ++i) {
+      if (mesh.indices[i] >= header.vertexCount) {
+        throw std::runtime_error("face references a missing vertex in " + filename + "!");
+      }
+    }
+  });
+  return mesh;
+}
+
+bool endsWith(const std::string& string, const std::string& suffix) {
+  return string.size() >= suffix.size() && string.compare(string.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}  // namespace
+
+Mesh loadMesh(const std::string& filename, uint32_t threadCount) {
+  TraceScope scope("loadMesh");
+  MappedFile file(filename);
+  if (endsWith(filename, ".obj")) {
+    return loadObj(file, filename, threadCount);
+  }
+  if (endsWith(filename, ".mesh")) {
+    return loadBinary(file, filename, threadCount);
+  }
+  throw std::runtime_error("unknown mesh format of " + filename + "!");
+}
+
+void writeBinaryMesh(const std::string& filename, const Mesh& mesh) {
+  std::ofstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open " + filename + "!");
+  }
+
+  BinaryMeshHeader header{};
+  std::memcpy(header.magic, kBinaryMagic, sizeof(kBinaryMagic));
+  header.version = kBinaryVersion;
+  header.vertexCount = static_cast<uint32_t>(mesh.positions.size());
+  header.triangleCount = static_cast<uint32_t>(mesh.indices.size() / 3);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(mesh.positions.data()), mesh.positions.size() * sizeof(glm::vec3));
+  file.write(reinterpret_cast<const char*>(mesh.indices.data()), header.triangleCount * 3 * sizeof(uint32_t));
+
+  if (!file) {
+    throw std::runtime_error("failed to write " + filename + "!");
+  }
+}
+
+CompactMesh compactMesh(const std::vector<glm::vec3>& positions, const std::vector<MeshTriangle>& triangles,
+                        uint32_t threadCount) {
+  TraceScope scope("compactMesh");
+  CompactMesh mesh{};
+  mesh.header.triangleCount = static_cast<uint32_t>(triangles.size());
+  if (triangles.empty()) {
+    return mesh;
+  }
+
+  std::vector<Aabb> workerBounds(std::max(1u, threadCount));
+  parallelFor(positions.size(), threadCount, [&](uint32_t worker, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      workerBounds[worker].grow(positions[i]);
+    }
+  });
+  Aabb bounds;
+  for (const Aabb& partial : workerBounds) {
+    bounds.grow(partial);
+  }
+  glm::vec3 origin = bounds.min;
+  glm::vec3 scale = (bounds.max - bounds.min) / kQuantizationSteps;
+  glm::vec3 inverseScale(0.0f);
+  for (int axis = 0; axis < 3; ++axis) {
+    inverseScale[axis] = scale[axis] > 0.0f ? 1.0f / scale[axis] : 0.0f;
+  }
+  mesh.header.origin = origin;
+  mesh.header.scale = scale;
+
+  std::vector<MeshVertex> quantized(positions.size());
+  parallelFor(positions.size(), threadCount, [&](uint32_t, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      glm::vec3 steps = (positions[i] - origin) * inverseScale;
+      auto quantize = [](float step) {
+        return static_cast<uint16_t>(std::lround(std::clamp(step, 0.0f, kQuantizationSteps)));
+      };
+      quantized[i] = {quantize(steps.x), quantize(steps.y), quantize(steps.z), 0};
+    }
+  });
+
+  // Bounds of the triangles the shader intersects. Half a quantization step of padding keeps the rounding of its own
+  // dequantization inside them.
+  glm::vec3 padding = 0.5f * scale;
+  std::vector<Aabb> triangleBounds(triangles.size());
+  parallelFor(triangles.size(), threadCount, [&](uint32_t, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      for (uint32_t vertex : triangles[i].vertices) {
+        const MeshVertex& q = quantized[vertex];
+        triangleBounds[i].grow(origin + scale * glm::vec3(q.x, q.y, q.z));
+      }
+      triangleBounds[i].min -= padding;
+      triangleBounds[i].max += padding;
+    }
+  });
+
+  Bvh bvh;
+  bvh.build(triangleBounds);
+  mesh.nodes = bvh.getNodes();
+
+  const std::vector<uint32_t>& order = bvh.getPrimitiveIndices();
+  mesh.triangles.resize(triangles.size());
+  parallelFor(triangles.size(), threadCount, [&](uint32_t, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      mesh.triangles[i] = triangles[order[i]];
+    }
+  });
+
+  // Serial, every vertex takes the index of its first use
+  std::vector<uint32_t> remap(positions.size(), kUnusedVertex);
+  uint32_t vertexCount = 0;
+  for (MeshTriangle& triangle : mesh.triangles) {
+    for (uint32_t& vertex : triangle.vertices) {
+      if (remap[vertex] == kUnusedVertex) {
+        remap[vertex] = vertexCount++;
+      }
+      vertex = remap[vertex];
+    }
+  }
+
+  mesh.vertices.resize(vertexCount);
+  parallelFor(positions.size(), threadCount, [&](uint32_t, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      if (remap[i] != kUnusedVertex) {
+        mesh.vertices[remap[i]] = quantized[i];
+      }
+    }
+  });
+  return mesh;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bvh.h"
+
+// Triangle soup as it is loaded, indices are three per triangle
+struct Mesh {
+  std::vector<glm::vec3> positions;
+  std::vector<uint32_t> indices;
+};
+
+// Loads a Wavefront OBJ (.obj) or binary mesh (.mesh) file. The file is memory mapped and split into chunks that
+// threadCount threads parse in parallel, OBJ faces with more than three vertices are split into fans. Only positions
+// and faces are read.
+Mesh loadMesh(const std::string& filename, uint32_t threadCount);
+// The binary format is a BinaryMeshHeader followed by the positions as three floats each and the indices as three
+// uint32 per triangle, little endian. It loads without parsing.
+void writeBinaryMesh(const std::string& filename, const Mesh& mesh);
+
+struct BinaryMeshHeader {
+  char magic[4];  // "MESH"
+  uint32_t version;
+  uint32_t vertexCount;
+  uint32_t triangleCount;
+};
+
+// Mirrors the vertices of tracer.glsl: every axis is quantized to 16 bits within the bounds of all mesh vertices
+struct MeshVertex {
+  uint16_t x;
+  uint16_t y;
+  uint16_t z;
+  uint16_t padding;
+};
+static_assert(sizeof(MeshVertex) == 8, "MeshVertex must match the std430 layout of the shader");
+
+// Mirrors Triangle of tracer.glsl (std430)
+struct MeshTriangle {
+  uint32_t vertices[3];
+  uint32_t material;
+};
+static_assert(sizeof(MeshTriangle) == 16, "MeshTriangle must match the std430 layout of the shader");
+
+// Mirrors the header of MeshVertices in tracer.glsl (std430). Vertex positions are origin + scale * (x, y, z).
+struct MeshHeader {
+  glm::vec3 origin;
+  uint32_t root;  // Root of the triangle BVH in the node buffer shared with the spheres
+  glm::vec3 scale;
+  uint32_t triangleCount;
+};
+static_assert(sizeof(MeshHeader) == 32, "MeshHeader must match the std430 layout of the shader");
+
+// The layout the GPU traces: triangles are ordered by their BVH leaves and vertices by their first use in that order,
+// so neighbouring triangles read neighbouring memory
+struct CompactMesh {
+  MeshHeader header;
+  std::vector<MeshVertex> vertices;
+  std::vector<MeshTriangle> triangles;
+  std::vector<BvhNode> nodes;  // Rooted at 0, leaves reference ranges of triangles
+};
+
+// Quantizes the vertices, builds the BVH over the quantized triangles and reorders both, on threadCount threads.
+// Vertices no triangle references are dropped.
+CompactMesh compactMesh(const std::vector<glm::vec3>& positions, const std::vector<MeshTriangle>& triangles,
+                        uint32_t threadCount);
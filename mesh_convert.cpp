@@ -0,0 +1,52 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "mesh.h"
+#include "settings.h"
+
+// Converts an OBJ or binary mesh to the binary format, which loads without parsing, and prints how long loading took
+// and how much memory the loaded and the compacted mesh take
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "usage: mesh_convert INPUT.obj OUTPUT.mesh [--threads N]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    // Options follow the file names, parseSettings() skips the output name like a program name
+    uint32_t threadCount = getThreadCount(parseSettings(argc - 2, argv + 2));
+
+    auto start = std::chrono::steady_clock::now();
+    Mesh mesh = loadMesh(argv[1], threadCount);
+    auto loaded = std::chrono::steady_clock::now();
+
+    std::vector<MeshTriangle> triangles(mesh.indices.size() / 3);
+    for (size_t i = 0; i < triangles.size(); ++i) {
+      triangles[i] = {{mesh.indices[i * 3], mesh.indices[i * 3 + 1], mesh.indices[i * 3 + 2]}, 0};
+    }
+    auto converted = std::chrono::steady_clock::now();
+    CompactMesh compact = compactMesh(mesh.positions, triangles, threadCount);
+    auto compacted = std::chrono::steady_clock::now();
+
+    writeBinaryMesh(argv[2], mesh);
+
+    auto milliseconds = [](auto duration) { return std::chrono::duration<double, std::milli>(duration).count(); };
+    double loadedSize = mesh.positions.size() * sizeof(glm::vec3) + mesh.indices.size() * sizeof(uint32_t);
+    double compactSize = sizeof(MeshHeader) + compact.vertices.size() * sizeof(MeshVertex) +
+                         compact.triangles.size() * sizeof(MeshTriangle) + compact.nodes.size() * sizeof(BvhNode);
+    std::cout << mesh.positions.size() << " vertices, " << triangles.size() << " triangles on " << threadCount
+              << " threads" << std::endl
+              << "loaded in " << milliseconds(loaded - start) << " ms, " << loadedSize / (1 << 20) << " MiB"
+              << std::endl
+              << "compacted in " << milliseconds(compacted - converted) << " ms, " << compactSize / (1 << 20)
+              << " MiB including " << compact.nodes.size() << " BVH nodes" << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+#include "pipeline_variants.h"
+
+#include <chrono>
+#include <stdexcept>
+
+#include "event_tracer.h"
+
+PipelineVariants::PipelineVariants(VkDevice device, Factory factory) : _device(device), _factory(std::move(factory)) {}
+
+PipelineVariants::~PipelineVariants() {
+  for (auto& [quality, pending] : _pending) {
+    try {
+      _pipelines[quality] = pending.get();
+    } catch (const std::exception&) {
+      // Was never used, nothing to destroy
+    }
+  }
+  for (const auto& [quality, pipeline] : _pipelines) {
+    vkDestroyPipeline(_device, pipeline, nullptr);
+  }
+}
+
+void PipelineVariants::build(Quality quality) {
+  if (_pipelines.count(quality) == 0 && _pending.count(quality) == 0) {
+    _pipelines[quality] = _factory(quality);
+  }
+}
+
+void PipelineVariants::request(Quality quality) {
+  if (_pipelines.count(quality) == 0 && _pending.count(quality) == 0) {
+    _pending[quality] = std::async(std::launch::async, [this, quality] {
+      TraceScope scope("build pipeline variant");
+      return _factory(quality);
+    });
+  }
+}
+
+VkPipeline PipelineVariants::get(Quality quality) {
+  auto pending = _pending.find(quality);
+  if (pending != _pending.end() && pending->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+    std::future<VkPipeline> future = std::move(pending->second);
+    _pending.erase(pending);
+    _pipelines[quality] = future.get();
+  }
+
+  auto pipeline = _pipelines.find(quality);
+  return pipeline != _pipelines.end() ? pipeline->second : VK_NULL_HANDLE;
+}
+
+VkPipeline PipelineVariants::getAny() const {
+  if (_pipelines.empty()) {
+    throw std::runtime_error("no pipeline variant was built!");
+  }
+  return _pipelines.begin()->second;
+}
+
+std::vector<VkDeviceChild<VkPipeline, vkDestroyPipeline>> PipelineVariants::takePipelines() {
+  std::vector<VkDeviceChild<VkPipeline, vkDestroyPipeline>> pipelines(_pipelines.size());
+  size_t i = 0;
+  for (const auto& [quality, pipeline] : _pipelines) {
+    *pipelines.at(i++).put(_device) = pipeline;
+  }
+  _pipelines.clear();
+  return pipelines;
+}
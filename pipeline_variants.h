@@ -0,0 +1,45 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <functional>
+#include <future>
+#include <map>
+#include <vector>
+
+#include "settings.h"
+#include "vk_wrapper.h"
+
+// Pipelines of the tracer, one per quality preset it was asked for. Variants other than the first are compiled on a
+// background thread, so switching presets never stalls a frame: until the new variant is ready the caller keeps
+// drawing with one that is.
+class PipelineVariants {
+ public:
+  // Runs on background threads, so it may only use thread-safe Vulkan calls, like creating shader modules and
+  // pipelines with an internally synchronized cache
+  using Factory = std::function<VkPipeline(Quality quality)>;
+
+  PipelineVariants(VkDevice device, Factory factory);
+  // Waits for the compilations still running, the pipelines must no longer be in use
+  ~PipelineVariants();
+  PipelineVariants(const PipelineVariants&) = delete;
+  PipelineVariants& operator=(const PipelineVariants&) = delete;
+
+  // Compiles the variant on the calling thread, for the one the first frame can't do without
+  void build(Quality quality);
+  // Starts compiling the variant in the background unless it exists or is already being compiled
+  void request(Quality quality);
+  // Null until the variant is compiled, rethrows the errors of its compilation
+  VkPipeline get(Quality quality);
+  // Any compiled variant, for tracing while the wanted one is still being compiled
+  VkPipeline getAny() const;
+  // Hands the compiled variants over, for retiring them while submitted frames may still use them
+  std::vector<VkDeviceChild<VkPipeline, vkDestroyPipeline>> takePipelines();
+
+ private:
+  VkDevice _device;
+  Factory _factory;
+  std::map<Quality, VkPipeline> _pipelines;
+  std::map<Quality, std::future<VkPipeline>> _pending;
+};
@@ -0,0 +1,32 @@
+#include "ppm.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+void writePpm(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* rgba, bool bgra) {
+  std::ofstream file(filename, std::ios::binary);
+
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open " + filename + "!");
+  }
+
+  file << "P6\n" << width << " " << height << "\n255\n";
+
+  int red = bgra ? 2 : 0;
+  int blue = bgra ? 0 : 2;
+  std::vector<uint8_t> row(width * 3);
+  for (uint32_t y = 0; y < height; ++y) {
+    const uint8_t* source = rgba + static_cast<size_t>(y) * width * 4;
+    for (uint32_t x = 0; x < width; ++x) {
+      row[x * 3 + 0] = source[x * 4 + red];
+      row[x * 3 + 1] = source[x * 4 + 1];
+      row[x * 3 + 2] = source[x * 4 + blue];
+    }
+    file.write(reinterpret_cast<const char*>(row.data()), row.size());
+  }
+
+  if (!file) {
+    throw std::runtime_error("failed to write " + filename + "!");
+  }
+}
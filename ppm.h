@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Writes tightly packed 8-bit RGBA pixels, or BGRA ones if bgra is set, as a binary (P6) PPM, dropping alpha.
+void writePpm(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* rgba, bool bgra = false);
@@ -0,0 +1,44 @@
+#include "resolution_controller.h"
+
+#include <algorithm>
+#include <cmath>
+
+ResolutionController::ResolutionController(float budgetMs, float minScale)
+    : _budgetMs(budgetMs), _minScale(std::ceil(minScale * kScaleSteps) / kScaleSteps) {}
+
+bool ResolutionController::update(double frameMs, float scale) {
+  // Frames recorded before the last change are still in flight for a while
+  if (scale != _scale) {
+    return false;
+  }
+
+  _averageMs = _frames == 0 ? frameMs : _averageMs + kSmoothing * (frameMs - _averageMs);
+  if (++_frames < kMinFrames) {
+    return false;
+  }
+
+  double factor;
+  if (_averageMs > _budgetMs) {
+    factor = std::max(kMaxDecrease, std::sqrt(_budgetMs / _averageMs));
+  } else if (_averageMs < kHeadroom * _budgetMs) {
+    factor = std::min(kMaxIncrease, std::sqrt(kHeadroom * _budgetMs / _averageMs));
+  } else {
+    return false;
+  }
+
+  // Rounded away from the current scale, so a step too small to show up still moves it
+  float target = _scale * static_cast<float>(factor) * kScaleSteps;
+  float scaled = (factor < 1.0 ? std::floor(target) : std::ceil(target)) / kScaleSteps;
+  scaled = std::clamp(scaled, _minScale, 1.0f);
+  if (scaled == _scale) {
+    return false;
+  }
+
+  _scale = scaled;
+  _frames = 0;
+  return true;
+}
+
+float ResolutionController::getScale() const {
+  return _scale;
+}
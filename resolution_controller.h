@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// Picks the fraction of the target's width and height that is traced, from measured GPU frame times. Tracing cost
+// is roughly proportional to the pixel count, so the scale moves by the square root of the budget to time ratio.
+// It drops quickly when over budget and grows slowly with headroom, so it settles instead of oscillating.
+class ResolutionController {
+ public:
+  ResolutionController(float budgetMs, float minScale);
+
+  // frameMs is the GPU time of a frame that was traced at scale. Returns true when the scale changed.
+  bool update(double frameMs, float scale);
+  float getScale() const;
+
+ private:
+  static constexpr uint32_t kScaleSteps = 32;  // Scales are multiples of 1 / kScaleSteps
+  static constexpr uint32_t kMinFrames = 4;  // Frames measured at a scale before it is changed again
+  static constexpr double kSmoothing = 0.25;  // Weight of the newest frame in the average
+  static constexpr double kHeadroom = 0.85;  // Grows only while frames take less than this fraction of the budget
+  static constexpr double kMaxDecrease = 0.75;
+  static constexpr double kMaxIncrease = 1.1;
+
+  double _budgetMs;
+  float _minScale;
+  float _scale = 1.0f;
+  double _averageMs = 0.0;
+  uint32_t _frames = 0;  // Measured since the last change
+};
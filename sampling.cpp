@@ -0,0 +1,197 @@
+#include "sampling.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+uint32_t reverseBits(uint32_t value) {
+  value = ((value >> 1) & 0x55555555u) | ((value & 0x55555555u) << 1);
+  value = ((value >> 2) & 0x33333333u) | ((value & 0x33333333u) << 2);
+  value = ((value >> 4) & 0x0f0f0f0fu) | ((value & 0x0f0f0f0fu) << 4);
+  value = ((value >> 8) & 0x00ff00ffu) | ((value & 0x00ff00ffu) << 8);
+  return (value >> 16) | (value << 16);
+}
+
+// 24 bits are exactly representable, so the result is below 1 and the same as the shader's
+float toUnitFloat(uint32_t value) {
+  return static_cast<float>(value >> 8) / 16777216.0f;
+}
+
+}  // namespace
+
+uint32_t pcgHash(uint32_t value) {
+  uint32_t state = value * 747796405u + 2891336453u;
+  uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+uint32_t nestedUniformScramble(uint32_t value, uint32_t seed) {
+  value = reverseBits(value);
+  value += seed;
+  value ^= value * 0x6c50b47cu;
+  value ^= value * 0xb82f1e52u;
+  value ^= value * 0xc7afe638u;
+  value ^= value * 0x8d22f6e6u;
+  return reverseBits(value);
+}
+
+glm::vec2 sobol2D(uint32_t index, uint32_t seed) {
+  index = nestedUniformScramble(index, seed);
+  uint32_t x = reverseBits(index);
+  uint32_t y = 0;
+  for (uint32_t direction = 1u << 31; index != 0; index >>= 1, direction ^= direction >> 1) {
+    if (index & 1) {
+      y ^= direction;
+    }
+  }
+  x = nestedUniformScramble(x, pcgHash(seed));
+  y = nestedUniformScramble(y, pcgHash(seed + 1));
+  return glm::vec2(toUnitFloat(x), toUnitFloat(y));
+}
+
+PixelSampler::PixelSampler(Sampler sampler, const std::vector<float>* blueNoise, glm::ivec2 pixel, uint32_t frame,
+                           uint32_t accumulatedFrames, uint32_t firstSample)
+    : _sampler(sampler), _blueNoise(blueNoise), _pixel(pixel), _sampleIndex(firstSample) {
+  uint32_t x = static_cast<uint32_t>(pixel.x);
+  uint32_t y = static_cast<uint32_t>(pixel.y);
+  uint32_t sequence = pcgHash(frame - accumulatedFrames);
+  _rngState = pcgHash(x + pcgHash(y + pcgHash(frame)));
+  _sampleSeed = sampler == Sampler::BlueNoise ? sequence : pcgHash(x + pcgHash(y + sequence));
+}
+
+float PixelSampler::next() {
+  if (_sampler == Sampler::Random) {
+    _rngState = _rngState * 747796405u + 2891336453u;
+    uint32_t word = ((_rngState >> ((_rngState >> 28u) + 4u)) ^ _rngState) * 277803737u;
+    return toUnitFloat((word >> 22u) ^ word);
+  }
+
+  if ((_sampleDimension & 1) == 0) {
+    uint32_t pair = _sampleDimension >> 1;
+    _samplePair = sobol2D(_sampleIndex, pcgHash(_sampleSeed ^ pcgHash(pair)));
+    if (_sampler == Sampler::BlueNoise) {
+      glm::vec2 shifted = _samplePair + glm::vec2(blueNoiseAt(2 * pair), blueNoiseAt(2 * pair + 1));
+      _samplePair = shifted - glm::floor(shifted);
+    }
+  }
+  float value = _samplePair[_sampleDimension & 1];
+  ++_sampleDimension;
+  return value;
+}
+
+void PixelSampler::nextSample() {
+  ++_sampleIndex;
+  _sampleDimension = 0;
+}
+
+float PixelSampler::blueNoiseAt(uint32_t dimension) const {
+  // Every dimension reads the tiled texture at another offset, so the dimensions' shifts don't correlate
+  uint32_t x = (static_cast<uint32_t>(_pixel.x) + dimension * 37u) % kBlueNoiseSize;
+  uint32_t y = (static_cast<uint32_t>(_pixel.y) + dimension * 23u) % kBlueNoiseSize;
+  return (*_blueNoise)[y * kBlueNoiseSize + x];
+}
+
+std::vector<float> makeBlueNoise() {
+  constexpr uint32_t kPixels = kBlueNoiseSize * kBlueNoiseSize;
+  constexpr float kSigma = 1.5f;
+
+  // Energy a set pixel adds at every toroidal offset
+  std::vector<float> kernel(kPixels);
+  for (uint32_t y = 0; y < kBlueNoiseSize; ++y) {
+    for (uint32_t x = 0; x < kBlueNoiseSize; ++x) {
+      float dx = static_cast<float>(std::min(x, kBlueNoiseSize - x));
+      float dy = static_cast<float>(std::min(y, kBlueNoiseSize - y));
+      kernel[y * kBlueNoiseSize + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * kSigma * kSigma));
+    }
+  }
+
+  std::vector<bool> pattern(kPixels, false);
+  std::vector<float> energy(kPixels, 0.0f);
+  auto toggle = [&](uint32_t pixel) {
+    pattern[pixel] = !pattern[pixel];
+    float sign = pattern[pixel] ? 1.0f : -1.0f;
+    uint32_t px = pixel % kBlueNoiseSize;
+    uint32_t py = pixel / kBlueNoiseSize;
+    for (uint32_t y = 0; y < kBlueNoiseSize; ++y) {
+      for (uint32_t x = 0; x < kBlueNoiseSize; ++x) {
+        uint32_t offset = (y + kBlueNoiseSize - py) % kBlueNoiseSize * kBlueNoiseSize + (x + kBlueNoiseSize - px) % kBlueNoiseSize;
+        energy[y * kBlueNoiseSize + x] += sign * kernel[offset];
+      }
+    }
+  };
+  // Set pixel with the most set neighbours and unset pixel with the fewest
+  auto tightestCluster = [&]() {
+    uint32_t best = 0;
+    for (uint32_t i = 0; i < kPixels; ++i) {
+      if (pattern[i] && (!pattern[best] || energy[i] > energy[best])) {
+        best = i;
+      }
+    }
+    return best;
+  };
+  auto largestVoid = [&]() {
+    uint32_t best = 0;
+    for (uint32_t i = 0; i < kPixels; ++i) {
+      if (!pattern[i] && (pattern[best] || energy[i] < energy[best])) {
+        best = i;
+      }
+    }
+    return best;
+  };
+
+  // Initial pattern of a tenth of the pixels, spread by moving its tightest clusters into its largest voids
+  uint32_t initialCount = kPixels / 10;
+  for (uint32_t i = 0, set = 0; set < initialCount; ++i) {
+    uint32_t pixel = pcgHash(i) % kPixels;
+    if (!pattern[pixel]) {
+      toggle(pixel);
+      ++set;
+    }
+  }
+  while (true) {
+    uint32_t cluster = tightestCluster();
+    toggle(cluster);
+    uint32_t hole = largestVoid();
+    toggle(hole);
+    if (hole == cluster) {
+      break;
+    }
+  }
+  std::vector<bool> initialPattern = pattern;
+  std::vector<float> initialEnergy = energy;
+
+  // Ranks below the initial count remove clusters, the ones above fill voids
+  std::vector<uint32_t> ranks(kPixels);
+  for (uint32_t rank = initialCount; rank > 0; --rank) {
+    uint32_t cluster = tightestCluster();
+    toggle(cluster);
+    ranks[cluster] = rank - 1;
+  }
+  pattern = initialPattern;
+  energy = initialEnergy;
+  for (uint32_t rank = initialCount; rank < kPixels; ++rank) {
+    uint32_t hole = largestVoid();
+    toggle(hole);
+    ranks[hole] = rank;
+  }
+
+  std::vector<float> values(kPixels);
+  for (uint32_t i = 0; i < kPixels; ++i) {
+    values[i] = (static_cast<float>(ranks[i]) + 0.5f) / kPixels;
+  }
+  return values;
+}
+
+double starDiscrepancy(const std::vector<glm::vec2>& points) {
+  double n = static_cast<double>(points.size());
+  double single = 0.0;
+  double pairs = 0.0;
+  for (const auto& a : points) {
+    single += (1.0 - double(a.x) * a.x) * (1.0 - double(a.y) * a.y);
+    for (const auto& b : points) {
+      pairs += (1.0 - std::max(a.x, b.x)) * (1.0 - std::max(a.y, b.y));
+    }
+  }
+  return std::sqrt(1.0 / 9.0 - single / (2.0 * n) + pairs / (n * n));
+}
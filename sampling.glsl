@@ -0,0 +1,95 @@
+// Random numbers of tracer.glsl, mirrored by PixelSampler in sampling.cpp. Every sample of a pixel draws its numbers
+// from consecutive dimensions, the Sobol samplers take them in pairs of one 2D point each.
+
+const uint kRandomSampling = 0u;  // Independent PCG random numbers per pixel
+const uint kSobolSampling = 1u;  // Owen scrambled Sobol points, decorrelated per pixel
+const uint kBlueNoiseSampling = 2u;  // One scrambled Sobol sequence shared by all pixels, shifted per pixel by blue noise
+
+const uint kBlueNoiseSize = 64u;
+layout(std430, binding = 12) readonly buffer BlueNoise {
+    float blueNoise[];  // Tiled over the image, generated by makeBlueNoise()
+};
+
+uint pcgHash(uint value) {
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// 24 bits are exactly representable, so the result stays below 1
+float toUnitFloat(uint value) {
+    return float(value >> 8u) / 16777216.0;
+}
+
+uint nestedUniformScramble(uint value, uint seed) {
+    value = bitfieldReverse(value);
+    value += seed;
+    value ^= value * 0x6c50b47cu;
+    value ^= value * 0xb82f1e52u;
+    value ^= value * 0xc7afe638u;
+    value ^= value * 0x8d22f6e6u;
+    return bitfieldReverse(value);
+}
+
+vec2 sobol2D(uint index, uint seed) {
+    index = nestedUniformScramble(index, seed);
+    uint x = bitfieldReverse(index);
+    uint y = 0u;
+    for (uint direction = 1u << 31; index != 0u; index >>= 1, direction ^= direction >> 1) {
+        if ((index & 1u) != 0u) {
+            y ^= direction;
+        }
+    }
+    x = nestedUniformScramble(x, pcgHash(seed));
+    y = nestedUniformScramble(y, pcgHash(seed + 1u));
+    return vec2(toUnitFloat(x), toUnitFloat(y));
+}
+
+ivec2 samplePixel;
+uint rngState;
+uint sampleSeed;
+uint sampleIndex;
+uint sampleDimension;
+vec2 samplePair;
+
+// Call before the first random() of a pixel. Accumulated frames pass their sample count, so they continue the
+// sequence of the frames before.
+void beginPixel(in ivec2 pixel, in uint firstSample) {
+    uint sequence = pcgHash(p.frame - p.accumulatedFrames);
+    samplePixel = pixel;
+    rngState = pcgHash(uint(pixel.x) + pcgHash(uint(pixel.y) + pcgHash(p.frame)));
+    sampleSeed = p.sampling == kBlueNoiseSampling ? sequence : pcgHash(uint(pixel.x) + pcgHash(uint(pixel.y) + sequence));
+    sampleIndex = firstSample;
+    sampleDimension = 0u;
+}
+
+void nextSample() {
+    ++sampleIndex;
+    sampleDimension = 0u;
+}
+
+float blueNoiseAt(in uint dimension) {
+    // Every dimension reads the tiled texture at another offset, so the dimensions' shifts don't correlate
+    uint x = (uint(samplePixel.x) + dimension * 37u) % kBlueNoiseSize;
+    uint y = (uint(samplePixel.y) + dimension * 23u) % kBlueNoiseSize;
+    return blueNoise[y * kBlueNoiseSize + x];
+}
+
+float random() {
+    if (p.sampling == kRandomSampling) {
+        rngState = rngState * 747796405u + 2891336453u;
+        uint word = ((rngState >> ((rngState >> 28u) + 4u)) ^ rngState) * 277803737u;
+        return toUnitFloat((word >> 22u) ^ word);
+    }
+
+    if ((sampleDimension & 1u) == 0u) {
+        uint pair = sampleDimension >> 1;
+        samplePair = sobol2D(sampleIndex, pcgHash(sampleSeed ^ pcgHash(pair)));
+        if (p.sampling == kBlueNoiseSampling) {
+            samplePair = fract(samplePair + vec2(blueNoiseAt(2u * pair), blueNoiseAt(2u * pair + 1u)));
+        }
+    }
+    float value = samplePair[sampleDimension & 1u];
+    ++sampleDimension;
+    return value;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "settings.h"
+
+// C++ side of sampling.glsl: the CPU tracer draws the same numbers as the shader, and the blue noise the shader
+// rotates its samples with is generated here
+constexpr uint32_t kBlueNoiseSize = 64;  // Width and height of the tiled blue noise texture
+
+uint32_t pcgHash(uint32_t value);
+// Random permutation of value that keeps its lower bits' order, Laine and Karras' hash of Owen scrambling
+uint32_t nestedUniformScramble(uint32_t value, uint32_t seed);
+// Point index of the first two Sobol dimensions, Owen scrambled and shuffled by seed (Burley 2020)
+glm::vec2 sobol2D(uint32_t index, uint32_t seed);
+
+// Per-pixel generator, mirrors the sampling state of sampling.glsl
+class PixelSampler {
+ public:
+  PixelSampler() = default;
+  // frame counts every frame ever traced, sequences restart with the accumulation
+  PixelSampler(Sampler sampler, const std::vector<float>* blueNoise, glm::ivec2 pixel, uint32_t frame,
+               uint32_t accumulatedFrames, uint32_t firstSample);
+
+  float next();
+  void nextSample();
+
+ private:
+  float blueNoiseAt(uint32_t dimension) const;
+
+  Sampler _sampler = Sampler::Random;
+  const std::vector<float>* _blueNoise = nullptr;
+  glm::ivec2 _pixel{};
+  uint32_t _rngState = 0;
+  uint32_t _sampleSeed = 0;
+  uint32_t _sampleIndex = 0;
+  uint32_t _sampleDimension = 0;
+  glm::vec2 _samplePair{};
+};
+
+// kBlueNoiseSize x kBlueNoiseSize values in (0, 1), generated with Ulichney's void and cluster method, so neighbouring
+// pixels get very different values while every value is equally common
+std::vector<float> makeBlueNoise();
+
+// L2 star discrepancy of points in [0, 1)^2 (Warnock's formula), lower means more evenly spread
+double starDiscrepancy(const std::vector<glm::vec2>& points);
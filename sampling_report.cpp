@@ -0,0 +1,130 @@
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "sampling.h"
+
+namespace {
+
+constexpr uint32_t kWidth = 1600;
+constexpr uint32_t kHeight = 800;
+constexpr uint32_t kPixels = 8;  // Pixels each discrepancy is averaged over
+constexpr uint32_t kMaxSamples = 4096;
+
+// The fract(sin()) hash tracer.glsl used before the samplers, for comparison
+std::vector<glm::vec2> sinHashPoints(glm::ivec2 pixel, uint32_t count) {
+  glm::vec2 fragCoord(pixel.x + 0.5f, pixel.y + 0.5f);
+  float seed = glm::dot(glm::vec2(fragCoord.x / kWidth, fragCoord.y / kHeight), glm::vec2(12.9898f, 78.233f));
+  float r = 1.0f;
+  auto next = [&]() {
+    float value = std::sin(r * seed) * 43758.5453123f;
+    r = value - std::floor(value);
+    return r;
+  };
+
+  std::vector<glm::vec2> points;
+  for (uint32_t i = 0; i < count; ++i) {
+    float x = next();
+    points.emplace_back(x, next());
+  }
+  return points;
+}
+
+// Points of the dimension pair starting at firstDimension, so later pairs show how well the padding holds up
+std::vector<glm::vec2> samplerPoints(Sampler sampler, const std::vector<float>& blueNoise, glm::ivec2 pixel,
+                                     uint32_t count, uint32_t firstDimension) {
+  PixelSampler pixelSampler(sampler, &blueNoise, pixel, 0, 0, 0);
+  std::vector<glm::vec2> points;
+  for (uint32_t i = 0; i < count; ++i) {
+    for (uint32_t dimension = 0; dimension < firstDimension; ++dimension) {
+      pixelSampler.next();
+    }
+    float x = pixelSampler.next();
+    points.emplace_back(x, pixelSampler.next());
+    pixelSampler.nextSample();
+  }
+  return points;
+}
+
+}  // namespace
+
+// Prints the L2 star discrepancy of the 2D points each sampler gives one pixel, averaged over a few pixels. Random
+// points converge like 1/sqrt(N), the Sobol samplers close to 1/N, so they need fewer samples for the same error.
+// Fails if a low-discrepancy sampler does not do better than random, so it can run as a test.
+int main() {
+  std::vector<float> blueNoise = makeBlueNoise();
+  std::vector<glm::ivec2> pixels;
+  for (uint32_t i = 0; i < kPixels; ++i) {
+    pixels.emplace_back(pcgHash(2 * i) % kWidth, pcgHash(2 * i + 1) % kHeight);
+  }
+
+  struct Column {
+    std::string name;
+    Sampler sampler;
+    uint32_t firstDimension;
+  };
+  const std::vector<Column> columns = {
+      {"random", Sampler::Random, 0},
+      {"sobol", Sampler::Sobol, 0},
+      {"sobol dims 8-9", Sampler::Sobol, 8},
+      {"blue-noise", Sampler::BlueNoise, 0},
+  };
+
+  std::cout << std::setw(8) << "samples" << std::setw(16) << "sin hash";
+  for (const auto& column : columns) {
+    std::cout << std::setw(16) << column.name;
+  }
+  std::cout << std::endl << std::scientific << std::setprecision(3);
+
+  // Discrepancies of the sin hash and each column, by sample count
+  std::vector<double> sinHashes;
+  std::vector<std::vector<double>> discrepancies(columns.size());
+  for (uint32_t count = 16; count <= kMaxSamples; count *= 4) {
+    double sinHash = 0.0;
+    for (const auto& pixel : pixels) {
+      sinHash += starDiscrepancy(sinHashPoints(pixel, count)) / kPixels;
+    }
+    sinHashes.push_back(sinHash);
+    std::cout << std::setw(8) << count << std::setw(16) << sinHash;
+
+    for (size_t i = 0; i < columns.size(); ++i) {
+      double discrepancy = 0.0;
+      for (const auto& pixel : pixels) {
+        auto points = samplerPoints(columns[i].sampler, blueNoise, pixel, count, columns[i].firstDimension);
+        discrepancy += starDiscrepancy(points) / kPixels;
+      }
+      discrepancies[i].push_back(discrepancy);
+      std::cout << std::setw(16) << discrepancy;
+    }
+    std::cout << std::endl;
+  }
+
+  // The low-discrepancy samplers must beat both random sources at the most samples, and Sobol must keep converging
+  bool passed = true;
+  const double random = discrepancies[0].back();
+  for (size_t i = 0; i < columns.size(); ++i) {
+    if (columns[i].sampler == Sampler::Random) {
+      continue;
+    }
+    double discrepancy = discrepancies[i].back();
+    if (discrepancy >= random || discrepancy >= sinHashes.back()) {
+      std::cerr << columns[i].name << " is no better than random at " << kMaxSamples << " samples!" << std::endl;
+      passed = false;
+    }
+    if (columns[i].sampler != Sampler::Sobol) {
+      continue;
+    }
+    for (size_t j = 1; j < discrepancies[i].size(); ++j) {
+      if (discrepancies[i][j] >= discrepancies[i][j - 1]) {
+        std::cerr << columns[i].name << " does not converge as the sample count grows!" << std::endl;
+        passed = false;
+        break;
+      }
+    }
+  }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
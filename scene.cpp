@@ -0,0 +1,169 @@
+#include "scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+const glm::vec3 kMeshBase(0.0f, -0.5f, 3.0f);  // Center of the bottom of added meshes
+constexpr float kMeshSize = 1.0f;
+
+}  // namespace
+
+Scene::Scene() {
+  addMaterial(kDiffuseMaterial, glm::vec3(0.0, 0.0, 0.0), 0.0);
+}
+
+Scene Scene::makeDefault() {
+  Scene scene;
+
+  uint32_t ground = scene.addMaterial(kDiffuseMaterial, glm::vec3(0.1, 0.5, 0.0), 0.0);
+  uint32_t diffuse = scene.addMaterial(kDiffuseMaterial, glm::vec3(1.0, 0.0, 0.0), 0.0);
+  uint32_t reflective = scene.addMaterial(kReflectiveMaterial, glm::vec3(0.7, 0.3, 0.3), 0.025);
+  uint32_t reflectiveFuzzed = scene.addMaterial(kReflectiveMaterial, glm::vec3(0.7, 0.3, 0.3), 1.0);
+
+  scene.addSphere(glm::vec3( 0.0, -100.5, 1.5), 100, ground);
+  scene.addSphere(glm::vec3( 0.0,    0.0, 1.5), 0.5, diffuse);
+  scene.addSphere(glm::vec3(-1.0,    0.0, 1.5), 0.5, reflective);
+  scene.addSphere(glm::vec3( 1.0,    0.0, 1.5), 0.5, reflectiveFuzzed);
+
+  return scene;
+}
+
+Scene Scene::makeRandom(uint32_t sphereCount, uint32_t seed) {
+  Scene scene;
+
+  uint32_t ground = scene.addMaterial(kDiffuseMaterial, glm::vec3(0.1, 0.5, 0.0), 0.0);
+  scene.addSphere(glm::vec3(0.0, -1000.5, 0.0), 1000, ground);
+
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  // Keeps the density of spheres on the ground roughly constant
+  float halfSize = std::max(2.0f, std::sqrt(static_cast<float>(sphereCount)) * 0.6f);
+  std::uniform_real_distribution<float> position(-halfSize, halfSize);
+
+  for (uint32_t i = 0; i < sphereCount; ++i) {
+    float radius = 0.1f + 0.15f * unit(generator);
+    glm::vec3 center(position(generator), radius - 0.5f, position(generator));
+    glm::vec3 albedo(unit(generator), unit(generator), unit(generator));
+
+    float choice = unit(generator);
+    uint32_t material;
+    if (choice < 0.6f) {
+      material = scene.addMaterial(kDiffuseMaterial, albedo, 0.0f);
+    } else if (choice < 0.85f) {
+      material = scene.addMaterial(kReflectiveMaterial, albedo, 0.5f * unit(generator));
+    } else {
+      material = scene.addMaterial(kReflectiveMaterial, albedo, 1.0f);
+    }
+
+    scene.addSphere(center, radius, material);
+  }
+
+  return scene;
+}
+
+uint32_t Scene::addMaterial(MaterialType type, const glm::vec3& albedo, float fuzz) {
+  Material material{};
+  material.albedo = albedo;
+  material.fuzz = fuzz;
+  material.type = type;
+  _materials.push_back(material);
+  return _materials.size() - 1;
+}
+
+void Scene::addSphere(const glm::vec3& center, float radius, uint32_t material) {
+  Sphere sphere{};
+  sphere.center = center;
+  sphere.radius = radius;
+  sphere.material = material;
+  _spheres.push_back(sphere);
+}
+
+void Scene::addMesh(const Mesh& mesh, uint32_t material) {
+  Aabb bounds;
+  for (const glm::vec3& position : mesh.positions) {
+    bounds.grow(position);
+  }
+  glm::vec3 extent = bounds.max - bounds.min;
+  float largestExtent = std::max(extent.x, std::max(extent.y, extent.z));
+  float scale = largestExtent > 0.0f ? kMeshSize / largestExtent : 1.0f;
+  glm::vec3 anchor((bounds.min.x + bounds.max.x) * 0.5f, bounds.min.y, (bounds.min.z + bounds.max.z) * 0.5f);
+
+  uint32_t firstVertex = _meshPositions.size();
+  _meshPositions.reserve(_meshPositions.size() + mesh.positions.size());
+  for (const glm::vec3& position : mesh.positions) {
+    _meshPositions.push_back(kMeshBase + (position - anchor) * scale);
+  }
+  _meshTriangles.reserve(_meshTriangles.size() + mesh.indices.size() / 3);
+  for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+    MeshTriangle triangle{};
+    for (int corner = 0; corner < 3; ++corner) {
+      triangle.vertices[corner] = firstVertex + mesh.indices[i + corner];
+    }
+    triangle.material = material;
+    _meshTriangles.push_back(triangle);
+  }
+}
+
+void Scene::addRandomMotion(uint32_t count, uint32_t seed) {
+  std::vector<uint32_t> candidates;
+  for (uint32_t i = 1; i < _spheres.size(); ++i) {
+    if (std::find(_movingSpheres.begin(), _movingSpheres.end(), i) == _movingSpheres.end()) {
+      candidates.push_back(i);
+    }
+  }
+
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::shuffle(candidates.begin(), candidates.end(), generator);
+  candidates.resize(std::min<size_t>(count, candidates.size()));
+  for (uint32_t sphere : candidates) {
+    SphereMotion motion;
+    motion.radius = 0.25f + 1.25f * unit(generator);
+    motion.angularSpeed = (0.25f + 0.75f * unit(generator)) * (unit(generator) < 0.5f ? -1.0f : 1.0f);
+    motion.phase = 6.2831853f * unit(generator);
+    // The sphere starts on the circle where it stands now
+    motion.origin = _spheres[sphere].center -
+                    motion.radius * glm::vec3(std::cos(motion.phase), 0.0f, std::sin(motion.phase));
+    _movingSpheres.push_back(sphere);
+    _motions.push_back(motion);
+  }
+}
+
+const std::vector<uint32_t>& Scene::animate(float time) {
+  for (size_t i = 0; i < _movingSpheres.size(); ++i) {
+    const SphereMotion& motion = _motions[i];
+    float angle = motion.phase + motion.angularSpeed * time;
+    glm::vec3 offset(std::cos(angle), 0.0f, std::sin(angle));
+    _spheres[_movingSpheres[i]].center = motion.origin + motion.radius * offset;
+  }
+  return _movingSpheres;
+}
+
+const std::vector<Material>& Scene::getMaterials() const {
+  return _materials;
+}
+
+const std::vector<Sphere>& Scene::getSpheres() const {
+  return _spheres;
+}
+
+std::vector<Aabb> Scene::getSphereBounds() const {
+  std::vector<Aabb> bounds(_spheres.size());
+  for (size_t i = 0; i < _spheres.size(); ++i) {
+    bounds[i].min = _spheres[i].center - glm::vec3(_spheres[i].radius);
+    bounds[i].max = _spheres[i].center + glm::vec3(_spheres[i].radius);
+  }
+  return bounds;
+}
+
+const std::vector<glm::vec3>& Scene::getMeshPositions() const {
+  return _meshPositions;
+}
+
+const std::vector<MeshTriangle>& Scene::getMeshTriangles() const {
+  return _meshTriangles;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "bvh.h"
+#include "mesh.h"
+
+enum MaterialType : int32_t {
+  kDiffuseMaterial = 1,
+  kReflectiveMaterial = 2,
+};
+
+// Mirrors Material of tracer.glsl (std430)
+struct Material {
+  glm::vec3 albedo;
+  float fuzz;
+  int32_t type;
+  int32_t padding[3];
+};
+static_assert(sizeof(Material) == 32, "Material must match the std430 layout of the shader");
+
+// Mirrors Sphere of tracer.glsl (std430)
+struct Sphere {
+  glm::vec3 center;
+  float radius;
+  uint32_t material;
+  uint32_t padding[3];
+};
+static_assert(sizeof(Sphere) == 32, "Sphere must match the std430 layout of the shader");
+
+class Scene {
+ public:
+  // The sphere following the camera is added by the shader and uses this material
+  static constexpr uint32_t kCameraMaterial = 0;
+
+  Scene();
+
+  // The original five sphere world
+  static Scene makeDefault();
+  // A large ground sphere with sphereCount small spheres of random materials scattered over it
+  static Scene makeRandom(uint32_t sphereCount, uint32_t seed);
+
+  uint32_t addMaterial(MaterialType type, const glm::vec3& albedo, float fuzz);
+  void addSphere(const glm::vec3& center, float radius, uint32_t material);
+  // Scales the mesh to fit a unit cube and stands it on the ground behind the spheres of the default world
+  void addMesh(const Mesh& mesh, uint32_t material);
+  // Sets up to count spheres, chosen at random except the first, the ground, circling around where they are
+  void addRandomMotion(uint32_t count, uint32_t seed);
+  // Moves the circling spheres to where they are at time seconds and returns their indices
+  const std::vector<uint32_t>& animate(float time);
+
+  const std::vector<Material>& getMaterials() const;
+  const std::vector<Sphere>& getSpheres() const;
+  std::vector<Aabb> getSphereBounds() const;
+  // Triangles of every added mesh, indexing into the shared positions
+  const std::vector<glm::vec3>& getMeshPositions() const;
+  const std::vector<MeshTriangle>& getMeshTriangles() const;
+
+ private:
+  struct SphereMotion {
+    glm::vec3 origin;  // Center of the circle
+    float radius;
+    float angularSpeed;  // Radians per second
+    float phase;
+  };
+
+  std::vector<Material> _materials;
+  std::vector<Sphere> _spheres;
+  std::vector<glm::vec3> _meshPositions;
+  std::vector<MeshTriangle> _meshTriangles;
+  std::vector<uint32_t> _movingSpheres;
+  std::vector<SphereMotion> _motions;  // Of each moving sphere
+};
@@ -0,0 +1,279 @@
+#include "settings.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+std::string nextArgument(int argc, char** argv, int& i) {
+  if (i + 1 >= argc) {
+    throw std::runtime_error(std::string("missing value for ") + argv[i] + "!");
+  }
+  return argv[++i];
+}
+
+uint32_t nextUint(int argc, char** argv, int& i) {
+  std::string option = argv[i];
+  std::string value = nextArgument(argc, argv, i);
+  try {
+    size_t end;
+    unsigned long result = std::stoul(value, &end);
+    if (end != value.size()) {
+      throw std::invalid_argument(value);
+    }
+    return static_cast<uint32_t>(result);
+  } catch (const std::logic_error&) {
+    throw std::runtime_error("invalid value '" + value + "' for " + option + "!");
+  }
+}
+
+float nextFloat(int argc, char** argv, int& i) {
+  std::string option = argv[i];
+  std::string value = nextArgument(argc, argv, i);
+  try {
+    size_t end;
+    float result = std::stof(value, &end);
+    if (end != value.size()) {
+      throw std::invalid_argument(value);
+    }
+    return result;
+  } catch (const std::logic_error&) {
+    throw std::runtime_error("invalid value '" + value + "' for " + option + "!");
+  }
+}
+
+Quality nextQuality(int argc, char** argv, int& i) {
+  std::string quality = nextArgument(argc, argv, i);
+  if (quality == "draft") {
+    return Quality::Draft;
+  } else if (quality == "balanced") {
+    return Quality::Balanced;
+  } else if (quality == "high") {
+    return Quality::High;
+  }
+  throw std::runtime_error("unknown quality " + quality + "!");
+}
+
+}  // namespace
+
+TracerConstants getTracerConstants(Quality quality, float verticalFov) {
+  switch (quality) {
+    case Quality::Draft:
+      return {2, verticalFov};
+    case Quality::High:
+      return {12, verticalFov};
+    default:
+      return {5, verticalFov};
+  }
+}
+
+uint32_t getThreadCount(const Settings& settings) {
+  return settings.threads > 0 ? settings.threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+Settings parseSettings(int argc, char** argv, const Settings& defaults) {
+  Settings settings = defaults;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string argument = argv[i];
+    if (argument == "--headless") {
+      settings.headless = true;
+    } else if (argument == "--frames") {
+      settings.frames = nextUint(argc, argv, i);
+    } else if (argument == "--output") {
+      settings.outputPrefix = nextArgument(argc, argv, i);
+    } else if (argument == "--width") {
+      settings.width = nextUint(argc, argv, i);
+    } else if (argument == "--height") {
+      settings.height = nextUint(argc, argv, i);
+    } else if (argument == "--offline-tile") {
+      settings.offlineTileSize = nextUint(argc, argv, i);
+    } else if (argument == "--samples") {
+      settings.samples = nextUint(argc, argv, i);
+    } else if (argument == "--accumulate") {
+      settings.accumulate = true;
+    } else if (argument == "--sampler") {
+      std::string sampler = nextArgument(argc, argv, i);
+      if (sampler == "random") {
+        settings.sampler = Sampler::Random;
+      } else if (sampler == "sobol") {
+        settings.sampler = Sampler::Sobol;
+      } else if (sampler == "blue-noise") {
+        settings.sampler = Sampler::BlueNoise;
+      } else {
+        throw std::runtime_error("unknown sampler " + sampler + "!");
+      }
+    } else if (argument == "--quality") {
+      settings.quality = nextQuality(argc, argv, i);
+    } else if (argument == "--moving-quality") {
+      settings.movingQuality = nextQuality(argc, argv, i);
+    } else if (argument == "--fov") {
+      settings.verticalFov = nextFloat(argc, argv, i);
+    } else if (argument == "--moving-samples") {
+      settings.movingSamples = nextUint(argc, argv, i);
+    } else if (argument == "--adaptive") {
+      settings.adaptiveThreshold = nextFloat(argc, argv, i);
+    } else if (argument == "--adaptive-min-samples") {
+      settings.adaptiveMinSamples = nextUint(argc, argv, i);
+    } else if (argument == "--random-spheres") {
+      settings.randomSpheres = nextUint(argc, argv, i);
+    } else if (argument == "--seed") {
+      settings.seed = nextUint(argc, argv, i);
+    } else if (argument == "--mesh") {
+      settings.meshFile = nextArgument(argc, argv, i);
+    } else if (argument == "--moving-spheres") {
+      settings.movingSpheres = nextUint(argc, argv, i);
+    } else if (argument == "--rebuild-threshold") {
+      settings.rebuildThreshold = nextFloat(argc, argv, i);
+    } else if (argument == "--backend") {
+      std::string backend = nextArgument(argc, argv, i);
+      if (backend == "fragment") {
+        settings.backend = Backend::Fragment;
+      } else if (backend == "compute") {
+        settings.backend = Backend::Compute;
+      } else {
+        throw std::runtime_error("unknown backend " + backend + "!");
+      }
+    } else if (argument == "--tile-width") {
+      settings.tileWidth = nextUint(argc, argv, i);
+    } else if (argument == "--tile-height") {
+      settings.tileHeight = nextUint(argc, argv, i);
+    } else if (argument == "--pacing") {
+      std::string pacing = nextArgument(argc, argv, i);
+      if (pacing == "uncapped") {
+        settings.pacing = Pacing::Uncapped;
+      } else if (pacing == "vsync") {
+        settings.pacing = Pacing::Vsync;
+      } else if (pacing == "target") {
+        settings.pacing = Pacing::TargetFrameTime;
+      } else {
+        throw std::runtime_error("unknown pacing " + pacing + "!");
+      }
+    } else if (argument == "--frame-time") {
+      settings.targetFrameTimeMs = nextFloat(argc, argv, i);
+    } else if (argument == "--present-mode") {
+      std::string presentMode = nextArgument(argc, argv, i);
+      if (presentMode == "auto") {
+        settings.presentMode = PresentMode::Auto;
+      } else if (presentMode == "fifo") {
+        settings.presentMode = PresentMode::Fifo;
+      } else if (presentMode == "mailbox") {
+        settings.presentMode = PresentMode::Mailbox;
+      } else if (presentMode == "immediate") {
+        settings.presentMode = PresentMode::Immediate;
+      } else {
+        throw std::runtime_error("unknown present mode " + presentMode + "!");
+      }
+    } else if (argument == "--dynamic-resolution") {
+      settings.dynamicResolution = true;
+    } else if (argument == "--frame-budget") {
+      settings.frameBudgetMs = nextFloat(argc, argv, i);
+    } else if (argument == "--min-scale") {
+      settings.minResolutionScale = nextFloat(argc, argv, i);
+    } else if (argument == "--sharpness") {
+      settings.sharpness = nextFloat(argc, argv, i);
+    } else if (argument == "--denoise") {
+      settings.denoise = true;
+    } else if (argument == "--async-compute") {
+      settings.asyncCompute = true;
+    } else if (argument == "--pipeline-cache") {
+      settings.pipelineCacheDirectory = nextArgument(argc, argv, i);
+    } else if (argument == "--hot-reload") {
+      settings.shaderDirectory = nextArgument(argc, argv, i);
+    } else if (argument == "--capture") {
+      settings.capturePrefix = nextArgument(argc, argv, i);
+    } else if (argument == "--capture-format") {
+      std::string format = nextArgument(argc, argv, i);
+      if (format == "ppm") {
+        settings.captureFormat = CaptureFormat::Ppm;
+      } else if (format == "raw") {
+        settings.captureFormat = CaptureFormat::Raw;
+      } else {
+        throw std::runtime_error("unknown capture format " + format + "!");
+      }
+    } else if (argument == "--capture-buffers") {
+      settings.captureBuffers = nextUint(argc, argv, i);
+    } else if (argument == "--profile") {
+      settings.profileOutput = nextArgument(argc, argv, i);
+    } else if (argument == "--profile-stdout") {
+      settings.profileStdout = true;
+    } else if (argument == "--trace") {
+      settings.traceOutput = nextArgument(argc, argv, i);
+    } else if (argument == "--memory-stats") {
+      settings.memoryStatistics = true;
+    } else if (argument == "--threads") {
+      settings.threads = nextUint(argc, argv, i);
+    } else if (argument == "--camera-path") {
+      settings.cameraPath = nextArgument(argc, argv, i);
+    } else if (argument == "--baseline") {
+      settings.baseline = nextArgument(argc, argv, i);
+    } else if (argument == "--save-baseline") {
+      settings.saveBaseline = nextArgument(argc, argv, i);
+    } else if (argument == "--threshold") {
+      settings.regressionThreshold = nextFloat(argc, argv, i);
+    } else if (argument == "--warmup-frames") {
+      settings.warmupFrames = nextUint(argc, argv, i);
+    } else {
+      throw std::runtime_error("unknown option " + argument + "!");
+    }
+  }
+
+  if (settings.width == 0 || settings.height == 0) {
+    throw std::runtime_error("resolution must be non-zero!");
+  }
+  if (settings.offlineTileSize > 0 && !settings.headless) {
+    throw std::runtime_error("offline tiles require headless mode!");
+  }
+  if (settings.offlineTileSize > 0 && settings.outputPrefix.empty()) {
+    throw std::runtime_error("offline tiles require an output prefix!");
+  }
+  if (settings.offlineTileSize > 0 && (settings.denoise || settings.dynamicResolution)) {
+    throw std::runtime_error("offline tiles do not support denoising or dynamic resolution!");
+  }
+  if (settings.samples == 0 || settings.movingSamples == 0) {
+    throw std::runtime_error("sample counts must be non-zero!");
+  }
+  if (!(settings.adaptiveThreshold >= 0.0f)) {
+    throw std::runtime_error("adaptive threshold must not be negative!");
+  }
+  if (settings.adaptiveThreshold > 0.0f && !settings.accumulate) {
+    throw std::runtime_error("adaptive sampling requires accumulation!");
+  }
+  if (!(settings.verticalFov > 0.0f && settings.verticalFov < 180.0f)) {
+    throw std::runtime_error("field of view must be in (0, 180) degrees!");
+  }
+  if (settings.tileWidth == 0 || settings.tileHeight == 0) {
+    throw std::runtime_error("tile size must be non-zero!");
+  }
+  if (settings.captureBuffers == 0) {
+    throw std::runtime_error("capture needs at least one staging buffer!");
+  }
+  if (!(settings.targetFrameTimeMs > 0.0f)) {
+    throw std::runtime_error("frame time must be positive!");
+  }
+  if (settings.dynamicResolution && settings.backend != Backend::Compute) {
+    throw std::runtime_error("dynamic resolution requires the compute backend!");
+  }
+  if (settings.denoise && settings.backend != Backend::Compute) {
+    throw std::runtime_error("denoising requires the compute backend!");
+  }
+  if (settings.asyncCompute && settings.backend != Backend::Compute) {
+    throw std::runtime_error("async compute requires the compute backend!");
+  }
+  if (!(settings.frameBudgetMs > 0.0f)) {
+    throw std::runtime_error("frame budget must be positive!");
+  }
+  if (!(settings.minResolutionScale > 0.0f && settings.minResolutionScale <= 1.0f)) {
+    throw std::runtime_error("minimum resolution scale must be in (0, 1]!");
+  }
+  if (!(settings.sharpness >= 0.0f && settings.sharpness <= 1.0f)) {
+    throw std::runtime_error("sharpness must be in [0, 1]!");
+  }
+  if (!(settings.rebuildThreshold >= 1.0f)) {
+    // Below 1 a freshly built tree already exceeds it and would be rebuilt every frame
+    throw std::runtime_error("rebuild threshold must be at least 1!");
+  }
+
+  return settings;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+enum class Backend {
+  Fragment,  // Fullscreen quad inside a render pass
+  Compute,  // Tiled dispatch into a storage image that is blitted to the target
+};
+
+enum class Pacing {
+  Uncapped,  // Next frame starts as soon as the previous one was submitted
+  Vsync,  // Frames are paced by a FIFO swap chain
+  TargetFrameTime,  // Frames start targetFrameTimeMs apart
+};
+
+enum class PresentMode {
+  Auto,  // FIFO for vsync pacing, otherwise mailbox or immediate when available
+  Fifo,
+  Mailbox,
+  Immediate,
+};
+
+// Values match the constants of sampling.glsl
+enum class Sampler {
+  Random,  // Independent PCG random numbers per pixel
+  Sobol,  // Owen scrambled Sobol points, decorrelated per pixel
+  BlueNoise,  // One scrambled Sobol sequence shared by all pixels, shifted per pixel by a blue noise texture
+};
+
+enum class CaptureFormat {
+  Ppm,  // One image file per frame
+  Raw,  // Frames appended to one headerless file per resolution, as ffmpeg's rawvideo reads them
+};
+
+enum class Quality {
+  Draft,
+  Balanced,
+  High,
+};
+
+// Compile time constants of tracer.glsl, specialized per quality preset
+struct TracerConstants {
+  int32_t maxDepth;  // Bounces before a path is terminated black
+  float verticalFov;  // Degrees
+};
+
+struct Settings {
+  bool headless = false;
+  uint32_t frames = 1;
+  std::string outputPrefix = "frame";
+
+  uint32_t width = 1600;
+  uint32_t height = 800;
+  // Headless frames are traced in square tiles of this size and streamed to one resumable file, 0 traces them whole
+  uint32_t offlineTileSize = 0;
+
+  uint32_t samples = 3;  // Samples per pixel and frame
+  bool accumulate = false;  // Blend frames together while the camera stands still
+  uint32_t movingSamples = 1;  // Samples per pixel of the first frame after the camera moved
+  // Accumulated pixels whose mean luminance has a standard error below this fraction of it stop being traced, 0 traces
+  // every pixel every frame
+  float adaptiveThreshold = 0.0f;
+  uint32_t adaptiveMinSamples = 16;  // Before a pixel may count as converged
+  Sampler sampler = Sampler::Sobol;
+  Quality quality = Quality::Balanced;
+  Quality movingQuality = Quality::Balanced;  // Preset of the first frame after the camera moved in accumulation mode
+  float verticalFov = 90.0f;  // Degrees
+
+  uint32_t randomSpheres = 0;  // Replaces the default world with this many random spheres when non-zero
+  uint32_t seed = 1;
+  std::string meshFile;  // OBJ or binary mesh added to the world, if non-empty
+  uint32_t movingSpheres = 0;  // Spheres circling around, the sphere BVH is refitted to them every frame
+  // A new sphere BVH is built in the background once refitting made its cost this many times what it was when built
+  float rebuildThreshold = 1.5f;
+
+  Backend backend = Backend::Fragment;
+  uint32_t tileWidth = 8;  // Compute workgroup size
+  uint32_t tileHeight = 8;
+
+  Pacing pacing = Pacing::Vsync;
+  float targetFrameTimeMs = 1000.0f / 60;
+  PresentMode presentMode = PresentMode::Auto;
+
+  bool dynamicResolution = false;  // Traces a scaled region of the target that is resized to hold frameBudgetMs
+  float frameBudgetMs = 1000.0f / 60;  // GPU time per frame the dynamic resolution aims for
+  float minResolutionScale = 0.5f;  // Smallest traced fraction of the target's width and height
+  float sharpness = 0.5f;  // Strength of the sharpening applied when upscaling, 0 is plain bilinear
+
+  bool denoise = false;  // Filters the traced image with temporal reprojection and an edge-avoiding wavelet filter
+
+  bool asyncCompute = false;  // Traces on a separate compute queue, overlapping the previous frame's blit and present
+
+  std::string pipelineCacheDirectory = ".";  // Pipeline caches are stored here, an empty path disables them
+  std::string shaderDirectory;  // Trace shaders in here are recompiled and swapped in when they change, if non-empty
+
+  std::string capturePrefix;  // Every drawn frame is copied out and written under this prefix, if non-empty
+  CaptureFormat captureFormat = CaptureFormat::Ppm;
+  uint32_t captureBuffers = 4;  // Staging buffers frames wait in for the writer before rendering has to
+
+  std::string profileOutput;  // GPU pass timings are written here on exit, as CSV for .csv and JSON otherwise
+  bool profileStdout = false;  // Also prints them periodically
+  bool memoryStatistics = false;  // Prints the device memory usage on exit
+  // CPU phases of every frame, and the GPU passes on the same timeline, are written here as Chrome trace JSON on exit
+  // and when F12 is pressed, if non-empty
+  std::string traceOutput;
+
+  uint32_t threads = 0;  // Worker threads of the CPU tracer and of mesh loading, 0 uses every core
+
+  std::string cameraPath;  // Keyframes replayed by the benchmark, empty uses the built-in path
+  std::string baseline;  // Benchmark results are compared against this file when set
+  std::string saveBaseline;  // Benchmark results are written to this file when set
+  float regressionThreshold = 5.0f;  // Percent a benchmark metric may get worse before it counts as a regression
+  uint32_t warmupFrames = 10;
+};
+
+TracerConstants getTracerConstants(Quality quality, float verticalFov);
+// Worker threads the settings ask for, every core if they leave it open
+uint32_t getThreadCount(const Settings& settings);
+
+// Options that are not given keep the values of defaults
+Settings parseSettings(int argc, char** argv, const Settings& defaults = Settings());
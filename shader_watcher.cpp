@@ -0,0 +1,176 @@
+#include "shader_watcher.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "event_tracer.h"
+
+#ifdef SHADER_HOT_RELOAD
+#include <shaderc/shaderc.hpp>
+#endif
+
+namespace {
+
+#ifdef SHADER_HOT_RELOAD
+
+bool readFile(const std::filesystem::path& path, std::string& content) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::ostringstream stream;
+  stream << file.rdbuf();
+  content = stream.str();
+  return true;
+}
+
+shaderc_shader_kind getShaderKind(const std::filesystem::path& path) {
+  if (path.extension() == ".vert") {
+    return shaderc_vertex_shader;
+  } else if (path.extension() == ".frag") {
+    return shaderc_fragment_shader;
+  } else if (path.extension() == ".comp") {
+    return shaderc_compute_shader;
+  }
+  throw std::runtime_error("unknown shader stage of " + path.string() + "!");
+}
+
+// Resolves includes relative to the including file, like glslc, and records every file it opened
+class Includer : public shaderc::CompileOptions::IncluderInterface {
+ public:
+  explicit Includer(std::vector<std::filesystem::path>* includes) : _includes(includes) {}
+
+  shaderc_include_result* GetInclude(const char* requestedSource, shaderc_include_type type,
+                                     const char* requestingSource, size_t includeDepth) override {
+    auto include = new Include();
+    include->path = std::filesystem::path(requestingSource).parent_path() / requestedSource;
+    include->name = include->path.string();
+    if (readFile(include->path, include->content)) {
+      _includes->push_back(include->path);
+    } else {
+      // An empty name tells shaderc the content is the error message
+      include->name.clear();
+      include->content = "failed to open " + include->path.string();
+    }
+    include->result.source_name = include->name.c_str();
+    include->result.source_name_length = include->name.size();
+    include->result.content = include->content.c_str();
+    include->result.content_length = include->content.size();
+    include->result.user_data = include;
+    return &include->result;
+  }
+
+  void ReleaseInclude(shaderc_include_result* data) override {
+    delete static_cast<Include*>(data->user_data);
+  }
+
+ private:
+  struct Include {
+    shaderc_include_result result;
+    std::filesystem::path path;
+    std::string name;
+    std::string content;
+  };
+
+  std::vector<std::filesystem::path>* _includes;
+};
+
+#endif
+
+}  // namespace
+
+ShaderWatcher::ShaderWatcher(std::vector<std::string> files, Callback onCompiled)
+    : _files(std::move(files)), _onCompiled(std::move(onCompiled)) {
+#ifndef SHADER_HOT_RELOAD
+  throw std::runtime_error("hot reload requires building with shaderc!");
+#endif
+  for (const std::string& file : _files) {
+    _modificationTimes.emplace(file, std::filesystem::file_time_type::min());
+  }
+  _thread = std::thread(&ShaderWatcher::run, this);
+}
+
+ShaderWatcher::~ShaderWatcher() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _stopCondition.notify_one();
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+}
+
+void ShaderWatcher::run() {
+  EventTracer::get().setThreadName("shader watcher");
+  std::vector<std::vector<uint32_t>> code;
+  compile(code);
+  poll();
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (!_stopCondition.wait_for(lock, kPollInterval, [this] { return _stop; })) {
+    lock.unlock();
+    if (poll()) {
+      std::cout << "recompiling shaders" << std::endl;
+      if (compile(code)) {
+        _onCompiled(std::move(code));
+      }
+      // Includes may have been added, their times are taken now so they don't count as a change
+      poll();
+    }
+    lock.lock();
+  }
+}
+
+bool ShaderWatcher::poll() {
+  bool changed = false;
+  for (auto& [path, time] : _modificationTimes) {
+    std::error_code error;
+    auto modificationTime = std::filesystem::last_write_time(path, error);
+    // Editors that save by replacing the file make it disappear for a moment, it is looked at again next time
+    if (!error && modificationTime != time) {
+      changed |= time != std::filesystem::file_time_type::min();
+      time = modificationTime;
+    }
+  }
+  return changed;
+}
+
+bool ShaderWatcher::compile(std::vector<std::vector<uint32_t>>& code) {
+  TraceScope scope("compile shaders");
+  code.clear();
+#ifdef SHADER_HOT_RELOAD
+  shaderc::Compiler compiler;
+  bool success = true;
+  for (const std::string& file : _files) {
+    std::vector<std::filesystem::path> includes;
+    shaderc::CompileOptions options;
+    options.SetIncluder(std::make_unique<Includer>(&includes));
+    options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+
+    std::string source;
+    if (!readFile(file, source)) {
+      std::cerr << "failed to open " << file << std::endl;
+      success = false;
+      continue;
+    }
+    shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(source, getShaderKind(file), file.c_str(), options);
+    if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+      std::cerr << result.GetErrorMessage();
+      success = false;
+    } else {
+      code.emplace_back(result.cbegin(), result.cend());
+    }
+
+    // Watched from now on, with the minimal time so adding them isn't taken for a change
+    for (const auto& include : includes) {
+      _modificationTimes.emplace(include, std::filesystem::file_time_type::min());
+    }
+  }
+  return success;
+#else
+  return false;
+#endif
+}
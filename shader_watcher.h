@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Recompiles GLSL sources whenever they or a file they include change, so shaders can be iterated on without
+// restarting. A thread polls the modification times and compiles with shaderc, the stage follows from the extension
+// (.vert, .frag or .comp). Diagnostics of failed compilations are printed and the previous SPIR-V stays in use.
+class ShaderWatcher {
+ public:
+  // SPIR-V of every file, in the order they were given
+  using Callback = std::function<void(std::vector<std::vector<uint32_t>> code)>;
+
+  // Called on the watcher's thread after every successful compilation. The sources are compiled once when watching
+  // starts, to learn what they include, but only changes are handed to the callback.
+  ShaderWatcher(std::vector<std::string> files, Callback onCompiled);
+  // Waits for a compilation and callback in progress
+  ~ShaderWatcher();
+  ShaderWatcher(const ShaderWatcher&) = delete;
+  ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+ private:
+  static constexpr std::chrono::milliseconds kPollInterval{250};
+
+  void run();
+  // Updates the modification times, true if any of them changed
+  bool poll();
+  bool compile(std::vector<std::vector<uint32_t>>& code);
+
+  std::vector<std::string> _files;
+  Callback _onCompiled;
+  std::map<std::filesystem::path, std::filesystem::file_time_type> _modificationTimes;  // Of the files and includes
+  std::mutex _mutex;
+  std::condition_variable _stopCondition;
+  bool _stop = false;
+  std::thread _thread;
+};
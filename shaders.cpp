@@ -0,0 +1,36 @@
+#include "shaders.h"
+
+namespace {
+
+// Generated by glslc -mfmt=c, every file is an initializer list of SPIR-V words
+const uint32_t kVertShader[] =
+#include "shader.vert.spv.inc"
+;
+const uint32_t kFragShader[] =
+#include "shader.frag.spv.inc"
+;
+const uint32_t kCompShader[] =
+#include "shader.comp.spv.inc"
+;
+const uint32_t kUpscaleShader[] =
+#include "upscale.comp.spv.inc"
+;
+const uint32_t kGbufferShader[] =
+#include "gbuffer.comp.spv.inc"
+;
+const uint32_t kTemporalShader[] =
+#include "temporal.comp.spv.inc"
+;
+const uint32_t kAtrousShader[] =
+#include "atrous.comp.spv.inc"
+;
+
+}  // namespace
+
+const ShaderCode kVertShaderCode{kVertShader, sizeof(kVertShader)};
+const ShaderCode kFragShaderCode{kFragShader, sizeof(kFragShader)};
+const ShaderCode kCompShaderCode{kCompShader, sizeof(kCompShader)};
+const ShaderCode kUpscaleShaderCode{kUpscaleShader, sizeof(kUpscaleShader)};
+const ShaderCode kGbufferShaderCode{kGbufferShader, sizeof(kGbufferShader)};
+const ShaderCode kTemporalShaderCode{kTemporalShader, sizeof(kTemporalShader)};
+const ShaderCode kAtrousShaderCode{kAtrousShader, sizeof(kAtrousShader)};
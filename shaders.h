@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// SPIR-V of shader.vert, shader.frag and the compute shaders, compiled by glslc and embedded at build time
+struct ShaderCode {
+  const uint32_t* code;
+  size_t size;  // In bytes
+};
+
+extern const ShaderCode kVertShaderCode;
+extern const ShaderCode kFragShaderCode;
+extern const ShaderCode kCompShaderCode;
+extern const ShaderCode kUpscaleShaderCode;
+extern const ShaderCode kGbufferShaderCode;
+extern const ShaderCode kTemporalShaderCode;
+extern const ShaderCode kAtrousShaderCode;
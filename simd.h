@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Fixed width float lanes for packet ray tracing: 8 lanes with AVX2, 4 with SSE2 and a portable 4 lane fallback
+
+#if defined(__AVX2__)
+
+constexpr int kPacketWidth = 8;
+
+struct Mask {
+  __m256 value;
+};
+
+struct Packet {
+  __m256 value;
+
+  Packet() : value(_mm256_setzero_ps()) {}
+  Packet(float scalar) : value(_mm256_set1_ps(scalar)) {}
+  explicit Packet(__m256 native) : value(native) {}
+
+  static Packet load(const float* values) { return Packet(_mm256_loadu_ps(values)); }
+  void store(float* values) const { _mm256_storeu_ps(values, value); }
+};
+
+inline Packet operator+(Packet a, Packet b) { return Packet(_mm256_add_ps(a.value, b.value)); }
+inline Packet operator-(Packet a, Packet b) { return Packet(_mm256_sub_ps(a.value, b.value)); }
+inline Packet operator*(Packet a, Packet b) { return Packet(_mm256_mul_ps(a.value, b.value)); }
+inline Packet operator/(Packet a, Packet b) { return Packet(_mm256_div_ps(a.value, b.value)); }
+inline Packet sqrt(Packet a) { return Packet(_mm256_sqrt_ps(a.value)); }
+inline Packet min(Packet a, Packet b) { return Packet(_mm256_min_ps(a.value, b.value)); }
+inline Packet max(Packet a, Packet b) { return Packet(_mm256_max_ps(a.value, b.value)); }
+
+inline Mask operator<(Packet a, Packet b) { return {_mm256_cmp_ps(a.value, b.value, _CMP_LT_OQ)}; }
+inline Mask operator<=(Packet a, Packet b) { return {_mm256_cmp_ps(a.value, b.value, _CMP_LE_OQ)}; }
+inline Mask operator&(Mask a, Mask b) { return {_mm256_and_ps(a.value, b.value)}; }
+inline Mask operator|(Mask a, Mask b) { return {_mm256_or_ps(a.value, b.value)}; }
+inline Mask andNot(Mask a, Mask b) { return {_mm256_andnot_ps(b.value, a.value)}; }  // a & ~b
+inline int bits(Mask mask) { return _mm256_movemask_ps(mask.value); }
+inline Mask maskFromBits(int laneBits) {
+  __m256i lanes = _mm256_set_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+  __m256i selected = _mm256_and_si256(_mm256_set1_epi32(laneBits), lanes);
+  return {_mm256_castsi256_ps(_mm256_cmpeq_epi32(selected, lanes))};
+}
+inline Packet select(Mask mask, Packet a, Packet b) { return Packet(_mm256_blendv_ps(b.value, a.value, mask.value)); }
+
+#elif defined(__SSE2__)
+
+constexpr int kPacketWidth = 4;
+
+struct Mask {
+  __m128 value;
+};
+
+struct Packet {
+  __m128 value;
+
+  Packet() : value(_mm_setzero_ps()) {}
+  Packet(float scalar) : value(_mm_set1_ps(scalar)) {}
+  explicit Packet(__m128 native) : value(native) {}
+
+  static Packet load(const float* values) { return Packet(_mm_loadu_ps(values)); }
+  void store(float* values) const { _mm_storeu_ps(values, value); }
+};
+
+inline Packet operator+(Packet a, Packet b) { return Packet(_mm_add_ps(a.value, b.value)); }
+inline Packet operator-(Packet a, Packet b) { return Packet(_mm_sub_ps(a.value, b.value)); }
+inline Packet operator*(Packet a, Packet b) { return Packet(_mm_mul_ps(a.value, b.value)); }
+inline Packet operator/(Packet a, Packet b) { return Packet(_mm_div_ps(a.value, b.value)); }
+inline Packet sqrt(Packet a) { return Packet(_mm_sqrt_ps(a.value)); }
+inline Packet min(Packet a, Packet b) { return Packet(_mm_min_ps(a.value, b.value)); }
+inline Packet max(Packet a, Packet b) { return Packet(_mm_max_ps(a.value, b.value)); }
+
+inline Mask operator<(Packet a, Packet b) { return {_mm_cmplt_ps(a.value, b.value)}; }
+inline Mask operator<=(Packet a, Packet b) { return {_mm_cmple_ps(a.value, b.value)}; }
+inline Mask operator&(Mask a, Mask b) { return {_mm_and_ps(a.value, b.value)}; }
+inline Mask operator|(Mask a, Mask b) { return {_mm_or_ps(a.value, b.value)}; }
+inline Mask andNot(Mask a, Mask b) { return {_mm_andnot_ps(b.value, a.value)}; }  // a & ~b
+inline int bits(Mask mask) { return _mm_movemask_ps(mask.value); }
+inline Mask maskFromBits(int laneBits) {
+  __m128i lanes = _mm_set_epi32(8, 4, 2, 1);
+  __m128i selected = _mm_and_si128(_mm_set1_epi32(laneBits), lanes);
+  return {_mm_castsi128_ps(_mm_cmpeq_epi32(selected, lanes))};
+}
+inline Packet select(Mask mask, Packet a, Packet b) {
+  return Packet(_mm_or_ps(_mm_and_ps(mask.value, a.value), _mm_andnot_ps(mask.value, b.value)));
+}
+
+#else
+
+constexpr int kPacketWidth = 4;
+
+struct Mask {
+  int value;  // One bit per lane
+};
+
+struct Packet {
+  float value[kPacketWidth];
+
+  Packet() : value{} {}
+  Packet(float scalar) {
+    for (float& lane : value) {
+      lane = scalar;
+    }
+  }
+
+  static Packet load(const float* values) {
+    Packet packet;
+    for (int i = 0; i < kPacketWidth; ++i) {
+      packet.value[i] = values[i];
+    }
+    return packet;
+  }
+  void store(float* values) const {
+    for (int i = 0; i < kPacketWidth; ++i) {
+      values[i] = value[i];
+    }
+  }
+};
+
+template<class Operation>
+inline Packet lanewise(Packet a, Packet b, Operation operation) {
+  Packet result;
+  for (int i = 0; i < kPacketWidth; ++i) {
+    result.value[i] = operation(a.value[i], b.value[i]);
+  }
+  return result;
+}
+
+template<class Operation>
+inline Mask compare(Packet a, Packet b, Operation operation) {
+  Mask result{0};
+  for (int i = 0; i < kPacketWidth; ++i) {
+    result.value |= operation(a.value[i], b.value[i]) ? 1 << i : 0;
+  }
+  return result;
+}
+
+inline Packet operator+(Packet a, Packet b) { return lanewise(a, b, [](float x, float y) { return x + y; }); }
+inline Packet operator-(Packet a, Packet b) { return lanewise(a, b, [](float x, float y) { return x - y; }); }
+inline Packet operator*(Packet a, Packet b) { return lanewise(a, b, [](float x, float y) { return x * y; }); }
+inline Packet operator/(Packet a, Packet b) { return lanewise(a, b, [](float x, float y) { return x / y; }); }
+inline Packet sqrt(Packet a) { return lanewise(a, a, [](float x, float) { return std::sqrt(x); }); }
+inline Packet min(Packet a, Packet b) { return lanewise(a, b, [](float x, float y) { return x < y ? x : y; }); }
+inline Packet max(Packet a, Packet b) { return lanewise(a, b, [](float x, float y) { return x > y ? x : y; }); }
+
+inline Mask operator<(Packet a, Packet b) { return compare(a, b, [](float x, float y) { return x < y; }); }
+inline Mask operator<=(Packet a, Packet b) { return compare(a, b, [](float x, float y) { return x <= y; }); }
+inline Mask operator&(Mask a, Mask b) { return {a.value & b.value}; }
+inline Mask operator|(Mask a, Mask b) { return {a.value | b.value}; }
+inline Mask andNot(Mask a, Mask b) { return {a.value & ~b.value}; }
+inline int bits(Mask mask) { return mask.value; }
+inline Mask maskFromBits(int laneBits) { return {laneBits}; }
+inline Packet select(Mask mask, Packet a, Packet b) {
+  Packet result;
+  for (int i = 0; i < kPacketWidth; ++i) {
+    result.value[i] = (mask.value >> i) & 1 ? a.value[i] : b.value[i];
+  }
+  return result;
+}
+
+#endif
+
+inline bool any(Mask mask) {
+  return bits(mask) != 0;
+}
@@ -0,0 +1,152 @@
+#include "sphere_bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <stdexcept>
+
+#include "event_tracer.h"
+
+namespace {
+
+Aabb getBounds(const Sphere& sphere) {
+  return {sphere.center - glm::vec3(sphere.radius), sphere.center + glm::vec3(sphere.radius)};
+}
+
+}  // namespace
+
+SphereBvh::SphereBvh(const std::vector<Sphere>& spheres, float rebuildThreshold)
+    : _rebuildThreshold(rebuildThreshold) {
+  if (spheres.empty()) {
+    throw std::runtime_error("failed to build a BVH without spheres!");
+  }
+  _sphereDirty.assign(spheres.size(), false);
+  _nodeDirty.assign(getNodeCapacity(spheres.size()), false);
+
+  _bounds.reserve(spheres.size());
+  for (const Sphere& sphere : spheres) {
+    _bounds.push_back(getBounds(sphere));
+  }
+  Bvh bvh;
+  bvh.build(_bounds);
+  install(std::move(bvh), spheres);
+}
+
+void SphereBvh::update(const std::vector<Sphere>& spheres, const std::vector<uint32_t>& moved) {
+  TraceScope scope("refit spheres");
+
+  for (uint32_t sphere : moved) {
+    _bounds[sphere] = getBounds(spheres[sphere]);
+    _spheres[_slots[sphere]] = spheres[sphere];
+    markDirty(_slots[sphere], _dirtySpheres, _sphereDirty);
+  }
+
+  if (_rebuild.valid() && _rebuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+    Bvh bvh = _rebuild.get();
+    // Spheres kept moving while it was built from the snapshot
+    std::vector<uint32_t> all(spheres.size());
+    std::iota(all.begin(), all.end(), 0);
+    bvh.refit(_bounds, all);
+    install(std::move(bvh), spheres);
+    ++_rebuildCount;
+
+    for (uint32_t i = 0; i < _spheres.size(); ++i) {
+      markDirty(i, _dirtySpheres, _sphereDirty);
+    }
+    for (uint32_t i = 0; i < _bvh.getNodes().size(); ++i) {
+      markDirty(i, _dirtyNodes, _nodeDirty);
+    }
+    return;
+  }
+
+  for (uint32_t node : _bvh.refit(_bounds, moved)) {
+    markDirty(node, _dirtyNodes, _nodeDirty);
+  }
+
+  if (!_rebuild.valid() && getDegradation() > _rebuildThreshold) {
+    // Not traced, every rebuild runs on a new thread and would register an event ring of its own
+    _rebuild = std::async(std::launch::async, [bounds = _bounds] {
+      Bvh bvh;
+      bvh.build(bounds);
+      return bvh;
+    });
+  }
+}
+
+const std::vector<Sphere>& SphereBvh::getSpheres() const {
+  return _spheres;
+}
+
+const std::vector<BvhNode>& SphereBvh::getNodes() const {
+  return _bvh.getNodes();
+}
+
+uint32_t SphereBvh::getNodeCapacity() const {
+  return getNodeCapacity(_spheres.size());
+}
+
+std::vector<SphereBvh::Range> SphereBvh::takeDirtySpheres() {
+  return takeRanges(_dirtySpheres, _sphereDirty);
+}
+
+std::vector<SphereBvh::Range> SphereBvh::takeDirtyNodes() {
+  return takeRanges(_dirtyNodes, _nodeDirty);
+}
+
+float SphereBvh::getDegradation() const {
+  return _builtCost > 0.0f ? _bvh.getCost() / _builtCost : 1.0f;
+}
+
+uint32_t SphereBvh::getRebuildCount() const {
+  return _rebuildCount;
+}
+
+uint32_t SphereBvh::getNodeCapacity(size_t sphereCount) {
+  // Every split leaves at least one sphere on each side
+  return static_cast<uint32_t>(2 * sphereCount - 1);
+}
+
+void SphereBvh::install(Bvh bvh, const std::vector<Sphere>& spheres) {
+  _bvh = std::move(bvh);
+  _builtCost = _bvh.getCost();
+
+  const std::vector<uint32_t>& order = _bvh.getPrimitiveIndices();
+  _spheres.resize(order.size());
+  _slots.resize(order.size());
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    _spheres[i] = spheres[order[i]];
+    _slots[order[i]] = i;
+  }
+}
+
+void SphereBvh::markDirty(uint32_t index, std::vector<uint32_t>& indices, std::vector<bool>& dirty) {
+  if (!dirty[index]) {
+    dirty[index] = true;
+    indices.push_back(index);
+  }
+}
+
+std::vector<SphereBvh::Range> SphereBvh::takeRanges(std::vector<uint32_t>& indices, std::vector<bool>& dirty) {
+  if (indices.size() * 16 > dirty.size()) {
+    // Sweeping the marks is cheaper than sorting this many
+    indices.clear();
+    for (uint32_t index = 0; index < dirty.size(); ++index) {
+      if (dirty[index]) {
+        indices.push_back(index);
+      }
+    }
+  } else {
+    std::sort(indices.begin(), indices.end());
+  }
+  std::vector<Range> ranges;
+  for (uint32_t index : indices) {
+    dirty[index] = false;
+    if (!ranges.empty() && ranges.back().first + ranges.back().count == index) {
+      ++ranges.back().count;
+    } else {
+      ranges.push_back({index, 1});
+    }
+  }
+  indices.clear();
+  return ranges;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <vector>
+
+#include "bvh.h"
+#include "scene.h"
+
+// BVH over spheres that move. Every update refits the nodes above the moved spheres, and once refitting has loosened
+// the tree past rebuildThreshold times its cost when built, a new tree is built from a snapshot on a background thread
+// and swapped in when it is done. What changed is collected as ranges of spheres and nodes to upload.
+class SphereBvh {
+ public:
+  struct Range {
+    uint32_t first;
+    uint32_t count;
+  };
+
+  SphereBvh(const std::vector<Sphere>& spheres, float rebuildThreshold);
+
+  // spheres are in scene order, moved are the indices of those that changed since the last update
+  void update(const std::vector<Sphere>& spheres, const std::vector<uint32_t>& moved);
+
+  // In the order the leaves reference them
+  const std::vector<Sphere>& getSpheres() const;
+  const std::vector<BvhNode>& getNodes() const;
+  // No tree over these spheres has more nodes, so rebuilt trees fit where the first one was uploaded
+  uint32_t getNodeCapacity() const;
+  // Changed since the last call, in ascending order with neighbours merged
+  std::vector<Range> takeDirtySpheres();
+  std::vector<Range> takeDirtyNodes();
+
+  // Cost of the tree relative to its cost when it was built
+  float getDegradation() const;
+  uint32_t getRebuildCount() const;
+
+ private:
+  // Takes over the tree and reorders the spheres for it
+  void install(Bvh bvh, const std::vector<Sphere>& spheres);
+  static uint32_t getNodeCapacity(size_t sphereCount);
+  static void markDirty(uint32_t index, std::vector<uint32_t>& indices, std::vector<bool>& dirty);
+  static std::vector<Range> takeRanges(std::vector<uint32_t>& indices, std::vector<bool>& dirty);
+
+  float _rebuildThreshold;
+  Bvh _bvh;
+  float _builtCost = 0.0f;
+  std::vector<Aabb> _bounds;  // In scene order
+  std::vector<Sphere> _spheres;
+  std::vector<uint32_t> _slots;  // Where each scene sphere is in _spheres
+  std::vector<uint32_t> _dirtySpheres;
+  std::vector<bool> _sphereDirty;
+  std::vector<uint32_t> _dirtyNodes;
+  std::vector<bool> _nodeDirty;
+  std::future<Bvh> _rebuild;
+  uint32_t _rebuildCount = 0;
+};
@@ -0,0 +1,67 @@
+#include "tile_scheduler.h"
+
+#include <algorithm>
+#include <thread>
+
+TileScheduler::TileScheduler(uint32_t width, uint32_t height, uint32_t tileSize, uint32_t threadCount) {
+  for (uint32_t y = 0; y < height; y += tileSize) {
+    for (uint32_t x = 0; x < width; x += tileSize) {
+      _tiles.push_back({x, y, std::min(tileSize, width - x), std::min(tileSize, height - y)});
+    }
+  }
+
+  _queues.resize(std::max(1u, threadCount));
+  for (auto& queue : _queues) {
+    queue = std::make_unique<WorkerQueue>();
+  }
+}
+
+void TileScheduler::run(const std::function<void(const Tile&)>& job) {
+  // Contiguous ranges keep the tiles of one thread close together, so stealing only happens near the end
+  size_t perQueue = (_tiles.size() + _queues.size() - 1) / _queues.size();
+  for (size_t i = 0; i < _tiles.size(); ++i) {
+    _queues[i / perQueue]->tiles.push_back(_tiles[i]);
+  }
+
+  std::vector<std::thread> threads;
+  for (uint32_t worker = 1; worker < _queues.size(); ++worker) {
+    threads.emplace_back(&TileScheduler::work, this, worker, std::cref(job));
+  }
+  work(0, job);
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+bool TileScheduler::popOwn(uint32_t worker, Tile& tile) {
+  WorkerQueue& queue = *_queues[worker];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tiles.empty()) {
+    return false;
+  }
+  tile = queue.tiles.front();
+  queue.tiles.pop_front();
+  return true;
+}
+
+bool TileScheduler::steal(uint32_t thief, Tile& tile) {
+  for (size_t offset = 1; offset < _queues.size(); ++offset) {
+    WorkerQueue& victim = *_queues[(thief + offset) % _queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tiles.empty()) {
+      tile = victim.tiles.back();
+      victim.tiles.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void TileScheduler::work(uint32_t worker, const std::function<void(const Tile&)>& job) {
+  Tile tile;
+  // Tiles are never added while running, so one unsuccessful pass over every queue means all work is taken
+  while (popOwn(worker, tile) || steal(worker, tile)) {
+    job(tile);
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct Tile {
+  uint32_t x;
+  uint32_t y;
+  uint32_t width;
+  uint32_t height;
+};
+
+// Splits an image into tiles and renders them on a fixed set of threads. Every thread owns a queue of
+// neighbouring tiles and, once it runs dry, steals from the back of the other queues.
+class TileScheduler {
+ public:
+  TileScheduler(uint32_t width, uint32_t height, uint32_t tileSize, uint32_t threadCount);
+
+  void run(const std::function<void(const Tile&)>& job);
+
+ private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<Tile> tiles;
+  };
+
+  bool popOwn(uint32_t worker, Tile& tile);
+  bool steal(uint32_t thief, Tile& tile);
+  void work(uint32_t worker, const std::function<void(const Tile&)>& job);
+
+  std::vector<Tile> _tiles;
+  std::vector<std::unique_ptr<WorkerQueue>> _queues;
+};
@@ -0,0 +1,129 @@
+#include "tiled_ppm.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+TiledPpmWriter::TiledPpmWriter(const std::string& filename, uint32_t width, uint32_t height, uint32_t tileSize,
+                               const std::string& configuration)
+    : _filename(filename), _progressFilename(filename + ".progress"), _width(width), _height(height),
+      _tileSize(tileSize), _tilesPerRow((width + tileSize - 1) / tileSize),
+      _tileCount(_tilesPerRow * ((height + tileSize - 1) / tileSize)),
+      _configuration(std::to_string(width) + "x" + std::to_string(height) + " tile=" + std::to_string(tileSize) +
+                     " " + configuration),
+      _header("P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n") {
+  if (!resume()) {
+    create();
+  }
+}
+
+uint32_t TiledPpmWriter::getTileCount() const {
+  return _tileCount;
+}
+
+uint32_t TiledPpmWriter::getCompletedTiles() const {
+  return _completedTiles;
+}
+
+Tile TiledPpmWriter::getTile(uint32_t index) const {
+  uint32_t x = index % _tilesPerRow * _tileSize;
+  uint32_t y = index / _tilesPerRow * _tileSize;
+  return {x, y, std::min(_tileSize, _width - x), std::min(_tileSize, _height - y)};
+}
+
+void TiledPpmWriter::writeTile(uint32_t index, const uint8_t* rgba, uint32_t stride) {
+  if (index != _completedTiles) {
+    throw std::runtime_error("tiles of " + _filename + " must be written in order!");
+  }
+
+  Tile tile = getTile(index);
+  std::vector<uint8_t> row(tile.width * 3);
+  for (uint32_t y = 0; y < tile.height; ++y) {
+    const uint8_t* source = rgba + static_cast<size_t>(y) * stride * 4;
+    for (uint32_t x = 0; x < tile.width; ++x) {
+      row[x * 3 + 0] = source[x * 4 + 0];
+      row[x * 3 + 1] = source[x * 4 + 1];
+      row[x * 3 + 2] = source[x * 4 + 2];
+    }
+    uint64_t pixel = static_cast<uint64_t>(tile.y + y) * _width + tile.x;
+    _file.seekp(static_cast<std::streamoff>(_header.size() + pixel * 3));
+    _file.write(reinterpret_cast<const char*>(row.data()), row.size());
+  }
+
+  // The tile has to reach the file before the progress claims it
+  _file.flush();
+  if (!_file) {
+    throw std::runtime_error("failed to write " + _filename + "!");
+  }
+  ++_completedTiles;
+  writeProgress();
+}
+
+void TiledPpmWriter::finish() {
+  if (_completedTiles != _tileCount) {
+    throw std::runtime_error("finishing " + _filename + " before every tile was written!");
+  }
+  _file.close();
+  std::filesystem::remove(_progressFilename);
+}
+
+bool TiledPpmWriter::resume() {
+  std::ifstream progress(_progressFilename);
+  std::string configuration;
+  uint32_t completedTiles;
+  if (!std::getline(progress, configuration) || configuration != _configuration || !(progress >> completedTiles) ||
+      completedTiles > _tileCount) {
+    return false;
+  }
+
+  // A file of another size was replaced since, the recorded tiles are not in it
+  std::error_code error;
+  uintmax_t size = std::filesystem::file_size(_filename, error);
+  if (error || size != _header.size() + static_cast<uint64_t>(_width) * _height * 3) {
+    return false;
+  }
+
+  _file.open(_filename, std::ios::in | std::ios::out | std::ios::binary);
+  if (!_file.is_open()) {
+    return false;
+  }
+  _completedTiles = completedTiles;
+  return true;
+}
+
+void TiledPpmWriter::create() {
+  {
+    // Sized up front, so every tile is written in place and pixels not written yet read as black
+    std::ofstream file(_filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      throw std::runtime_error("failed to open " + _filename + "!");
+    }
+    file << _header;
+    file.seekp(static_cast<std::streamoff>(_header.size() + static_cast<uint64_t>(_width) * _height * 3 - 1));
+    file.put(0);
+    if (!file) {
+      throw std::runtime_error("failed to write " + _filename + "!");
+    }
+  }
+
+  _file.open(_filename, std::ios::in | std::ios::out | std::ios::binary);
+  if (!_file.is_open()) {
+    throw std::runtime_error("failed to open " + _filename + "!");
+  }
+  _completedTiles = 0;
+  writeProgress();
+}
+
+void TiledPpmWriter::writeProgress() {
+  // Replaced with a rename, so an interrupted run never leaves a half written progress file behind
+  std::string temporaryFilename = _progressFilename + ".tmp";
+  {
+    std::ofstream progress(temporaryFilename, std::ios::trunc);
+    progress << _configuration << "\n" << _completedTiles << "\n";
+    if (!progress) {
+      throw std::runtime_error("failed to write " + temporaryFilename + "!");
+    }
+  }
+  std::filesystem::rename(temporaryFilename, _progressFilename);
+}
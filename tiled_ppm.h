@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include "tile_scheduler.h"
+
+// Streams square tiles of a binary (P6) PPM into a file on disk, so an image of any size is written holding one tile
+// at a time. Tiles are numbered row by row and written in that order. After every tile, the number of finished tiles
+// is recorded in filename + ".progress", and a writer created for the same file and configuration resumes after them.
+class TiledPpmWriter {
+ public:
+  // configuration identifies everything else the tiles depend on, progress recorded with a different one is ignored
+  TiledPpmWriter(const std::string& filename, uint32_t width, uint32_t height, uint32_t tileSize,
+                 const std::string& configuration);
+
+  uint32_t getTileCount() const;
+  // Tiles finished by earlier runs, or zero for a new file
+  uint32_t getCompletedTiles() const;
+  // Clipped to the image
+  Tile getTile(uint32_t index) const;
+
+  // Writes the tile's pixels from tightly packed 8-bit RGBA rows of stride pixels, dropping alpha
+  void writeTile(uint32_t index, const uint8_t* rgba, uint32_t stride);
+  // Closes the image once every tile was written and removes the progress file
+  void finish();
+
+ private:
+  bool resume();
+  void create();
+  void writeProgress();
+
+  std::string _filename;
+  std::string _progressFilename;
+  uint32_t _width;
+  uint32_t _height;
+  uint32_t _tileSize;
+  uint32_t _tilesPerRow;
+  uint32_t _tileCount;
+  std::string _configuration;
+  std::string _header;
+
+  std::fstream _file;
+  uint32_t _completedTiles = 0;
+};
@@ -0,0 +1,442 @@
+// Path tracer shared by shader.frag and shader.comp
+
+#define M_PI 3.1415926535897932384626433832795
+
+// rgb holds the running mean of every sample traced since the last reset, a holds their count
+layout(binding = 0, rgba32f) uniform image2D accumulation;
+// Running mean of the squared luminance of the same samples, only written with adaptive sampling
+layout(binding = 13, r32f) uniform image2D meanSquares;
+layout(std430, binding = 14) buffer Convergence {
+    uint convergedPixels;  // Skipped by this frame, reset by the host before it is submitted
+};
+
+layout(push_constant) uniform constants {
+    vec3 camera;
+    float yaw;
+    float pitch;
+    uint accumulatedFrames;
+    uint samples;
+    uint width;  // Resolution of the traced image, or of the whole image when tracing one of its tiles
+    uint height;
+    layout(offset = 48) vec3 previousCamera;  // Camera of the last frame, for the denoiser's reprojection
+    float previousYaw;
+    float previousPitch;
+    uint frame;  // Counts every frame drawn
+    uint sampling;  // One of the constants of sampling.glsl
+    float adaptiveThreshold;  // Settings::adaptiveThreshold, 0 traces every pixel
+    uint adaptiveMinSamples;
+    uint tileX;  // Offset of the traced image within the whole image, 0 unless rendering offline tiles
+    uint tileY;
+}p;
+
+const float kInfinity = 1.0 / 0.0;
+const float kEps = 1e-8;
+
+float lengthSquared(in vec3 coords) {
+    return dot(coords, coords);
+}
+vec3 normalized(in vec3 vector) {
+    return vector / length(vector);
+}
+bool nearZero(in vec3 vector) {
+    return (abs(vector.x) < kEps) && (abs(vector.y) < kEps) && (abs(vector.z) < kEps);
+}
+float luminance(in vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+vec3 cameraDirection = vec3(sin(p.yaw) * cos(p.pitch), sin(p.pitch), cos(p.yaw) * cos(p.pitch));
+vec3 u = normalized(cross(vec3(0, 1, 0), cameraDirection));
+vec3 v = cross(cameraDirection, u);
+
+float aspectRatio = float(p.width) / float(p.height);
+// Specialized per quality preset when the pipeline is created, see TracerConstants. IDs below 10 are left to the
+// shaders including this file.
+layout(constant_id = 10) const int kMaxDepth = 5;
+layout(constant_id = 11) const float kVerticalFOV = 90.0;  // Degrees
+
+float viewportHeight = 2.0 * tan(radians(kVerticalFOV) / 2);
+float viewportWidth = aspectRatio * viewportHeight;
+
+const float kFocalLength = 1.0;
+
+vec3 horizontal = viewportWidth * u;
+vec3 vertical = viewportHeight * v;
+vec3 lowerLeftCorner = p.camera - (horizontal / 2 + vertical / 2 - kFocalLength * cameraDirection);
+
+const int kBvhStackSize = 64;
+
+vec2 fragCoord;  // Center of the traced pixel in the whole image, equals gl_FragCoord.xy in the fragment shader when untiled
+
+#include "sampling.glsl"
+
+float random(float min, float max) {
+    return min + (max - min) * random();
+}
+vec3 randomVec3(float min, float max) {
+    return vec3(random(min, max),
+                random(min, max),
+                random(min, max));
+}
+vec3 randomInHemisphere(in vec3 normal) {
+    vec3 vector = randomVec3(-1.0, 1.0);
+    if (dot(vector, normal) > 0.0) {
+        return vector;
+    }
+    return -vector;
+}
+
+struct Ray {
+    vec3 origin;
+    vec3 direction;  // Direction should always be normalized (length = 1.0)
+};
+vec3 rayAt(in Ray ray, in float t) {
+    return (ray.origin + t * ray.direction);
+}
+
+#define MaterialType int
+#define DiffuseType int(1)
+#define ReflectiveType int(2)
+struct Material {
+    vec3 albedo;
+    float fuzz;
+    MaterialType type;
+};
+struct Sphere {
+    vec3 center;
+    float radius;
+    uint material;
+};
+struct BvhNode {
+    vec3 boundsMin;
+    uint leftOrFirst;  // First primitive of a leaf or left child of an interior node, the right child follows it
+    vec3 boundsMax;
+    uint count;  // Number of primitives in a leaf, 0 for interior nodes
+};
+struct Triangle {
+    uvec3 vertices;
+    uint material;
+};
+
+// Built and uploaded by Scene and Bvh, spheres are ordered so that every leaf references a contiguous range
+layout(std430, binding = 2) readonly buffer Materials {
+    Material materials[];
+};
+layout(std430, binding = 3) readonly buffer Spheres {
+    Sphere spheres[];
+};
+layout(std430, binding = 4) readonly buffer BvhNodes {
+    BvhNode nodes[];
+};
+// Built and uploaded by compactMesh(). Vertices are positions quantized to 16 bits per axis, x | y << 16 and z, in
+// steps of meshScale from meshOrigin. Triangles are ordered like spheres, by their BVH that starts at node meshRoot.
+layout(std430, binding = 15) readonly buffer MeshVertices {
+    vec3 meshOrigin;
+    uint meshRoot;
+    vec3 meshScale;
+    uint triangleCount;
+    uvec2 vertices[];
+};
+layout(std430, binding = 16) readonly buffer Triangles {
+    Triangle triangles[];
+};
+
+const uint kCameraMaterial = 0;
+const float kCameraRadius = 0.25;
+
+struct HitRecord {
+    vec3 point;
+    vec3 normal;
+    Material material;
+    float t;
+};
+bool sphereHit(in Sphere sphere, in Ray ray, float t_min, float t_max, inout HitRecord hit_record) {
+    if (length(ray.origin - sphere.center) < sphere.radius) {
+        return false;
+    }
+
+    vec3 oc = ray.origin - sphere.center;
+
+    float a = lengthSquared(ray.direction);
+    float half_b = dot(oc, ray.direction);
+    float c = lengthSquared(oc) - sphere.radius * sphere.radius;
+
+    float discriminant = half_b * half_b - a * c;
+    if (discriminant < 0) {
+        return false;
+    }
+    float sqrt_discriminant = sqrt(discriminant);
+
+    float root = (-half_b - sqrt_discriminant) / a;
+    if (root < t_min || t_max < root) {
+        root = (-half_b + sqrt_discriminant) / a;
+
+        if (root < t_min || t_max < root) {
+            return false;
+        }
+    }
+
+    hit_record.t = root;
+    hit_record.point = rayAt(ray, hit_record.t);
+    hit_record.normal = (hit_record.point - sphere.center) / sphere.radius;
+    hit_record.material = materials[sphere.material];
+
+    return true;
+}
+// Distance to the entry point of the box, kInfinity when the ray misses it within [t_min, t_max]
+float boxHit(in vec3 boundsMin, in vec3 boundsMax, in Ray ray, in vec3 inverseDirection, float t_min, float t_max) {
+    vec3 t0 = (boundsMin - ray.origin) * inverseDirection;
+    vec3 t1 = (boundsMax - ray.origin) * inverseDirection;
+    vec3 tNear = min(t0, t1);
+    vec3 tFar = max(t0, t1);
+    float entry = max(max(tNear.x, tNear.y), max(tNear.z, t_min));
+    float exit = min(min(tFar.x, tFar.y), min(tFar.z, t_max));
+    return entry <= exit ? entry : kInfinity;
+}
+// The ray of the watertight ray/triangle test of Woop et al.: the axis the direction is largest along becomes z and
+// the shear maps the direction onto it
+struct ShearedRay {
+    ivec3 axes;
+    vec3 shear;
+};
+ShearedRay shearRay(in Ray ray) {
+    vec3 magnitude = abs(ray.direction);
+    int kz = magnitude.x > magnitude.y ? (magnitude.x > magnitude.z ? 0 : 2) : (magnitude.y > magnitude.z ? 1 : 2);
+    int kx = (kz + 1) % 3;
+    int ky = (kx + 1) % 3;
+    float dz = ray.direction[kz];
+    return ShearedRay(ivec3(kx, ky, kz), vec3(ray.direction[kx] / dz, ray.direction[ky] / dz, 1.0 / dz));
+}
+vec3 meshVertex(uint index) {
+    uvec2 quantized = vertices[index];
+    return meshOrigin + meshScale * vec3(quantized.x & 0xFFFFu, quantized.x >> 16, quantized.y & 0xFFFFu);
+}
+// Edges are tested in the ray's sheared space with the same arithmetic for both triangles sharing them, so rays never
+// slip through the edges of a closed mesh
+bool triangleHit(in Triangle triangle, in Ray ray, in ShearedRay sheared, float t_min, float t_max, inout HitRecord hit_record) {
+    vec3 v0 = meshVertex(triangle.vertices.x);
+    vec3 v1 = meshVertex(triangle.vertices.y);
+    vec3 v2 = meshVertex(triangle.vertices.z);
+    vec3 a = v0 - ray.origin;
+    vec3 b = v1 - ray.origin;
+    vec3 c = v2 - ray.origin;
+
+    int kx = sheared.axes.x;
+    int ky = sheared.axes.y;
+    int kz = sheared.axes.z;
+    float ax = a[kx] - sheared.shear.x * a[kz];
+    float ay = a[ky] - sheared.shear.y * a[kz];
+    float bx = b[kx] - sheared.shear.x * b[kz];
+    float by = b[ky] - sheared.shear.y * b[kz];
+    float cx = c[kx] - sheared.shear.x * c[kz];
+    float cy = c[ky] - sheared.shear.y * c[kz];
+
+    // Scaled barycentric coordinates, a hit needs all of them on the same side
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+    if ((u < 0.0 || v < 0.0 || w < 0.0) && (u > 0.0 || v > 0.0 || w > 0.0)) {
+        return false;
+    }
+    float determinant = u + v + w;
+    if (determinant == 0.0) {
+        return false;
+    }
+    float t = sheared.shear.z * (u * a[kz] + v * b[kz] + w * c[kz]) / determinant;
+    if (t < t_min || t_max < t) {
+        return false;
+    }
+
+    hit_record.t = t;
+    hit_record.point = rayAt(ray, t);
+    vec3 normal = normalize(cross(v1 - v0, v2 - v0));
+    hit_record.normal = dot(normal, ray.direction) > 0.0 ? -normal : normal;
+    hit_record.material = materials[triangle.material];
+
+    return true;
+}
+// Leaves of the BVH below root reference spheres or, for the mesh BVH, triangles
+bool bvhHit(uint root, bool meshLeaves, in Ray ray, in vec3 inverseDirection, in ShearedRay sheared, float t_min,
+            inout float closest_t, inout HitRecord hit_record) {
+    bool hit_anything = false;
+    uint stack[kBvhStackSize];
+    float stackDistances[kBvhStackSize];
+    int stackSize = 0;
+
+    float rootDistance = boxHit(nodes[root].boundsMin, nodes[root].boundsMax, ray, inverseDirection, t_min, closest_t);
+    if (rootDistance < kInfinity) {
+        stack[stackSize] = root;
+        stackDistances[stackSize] = rootDistance;
+        ++stackSize;
+    }
+
+    while (stackSize > 0) {
+        --stackSize;
+        if (stackDistances[stackSize] > closest_t) {
+            continue;
+        }
+        BvhNode node = nodes[stack[stackSize]];
+
+        if (node.count > 0) {
+            for (uint i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+                bool hit = meshLeaves ? triangleHit(triangles[i], ray, sheared, t_min, closest_t, hit_record)
+                                      : sphereHit(spheres[i], ray, t_min, closest_t, hit_record);
+                if (hit) {
+                    hit_anything = true;
+                    closest_t = hit_record.t;
+                }
+            }
+            continue;
+        }
+
+        uint nearChild = node.leftOrFirst;
+        uint farChild = node.leftOrFirst + 1;
+        float nearDistance = boxHit(nodes[nearChild].boundsMin, nodes[nearChild].boundsMax, ray, inverseDirection, t_min, closest_t);
+        float farDistance = boxHit(nodes[farChild].boundsMin, nodes[farChild].boundsMax, ray, inverseDirection, t_min, closest_t);
+        if (farDistance < nearDistance) {
+            uint swappedChild = nearChild;
+            nearChild = farChild;
+            farChild = swappedChild;
+            float swappedDistance = nearDistance;
+            nearDistance = farDistance;
+            farDistance = swappedDistance;
+        }
+
+        // The nearer child is pushed last so it is visited first and shrinks closest_t early
+        if (farDistance < kInfinity) {
+            stack[stackSize] = farChild;
+            stackDistances[stackSize] = farDistance;
+            ++stackSize;
+        }
+        if (nearDistance < kInfinity) {
+            stack[stackSize] = nearChild;
+            stackDistances[stackSize] = nearDistance;
+            ++stackSize;
+        }
+    }
+
+    return hit_anything;
+}
+
+bool sceneHit(in Ray ray, float t_min, float t_max, inout HitRecord hit_record) {
+    // The sphere following the camera moves every frame and is kept out of the BVH
+    bool hit_anything = sphereHit(Sphere(p.camera, kCameraRadius, kCameraMaterial), ray, t_min, t_max, hit_record);
+    float closest_t = hit_anything ? hit_record.t : t_max;
+
+    vec3 inverseDirection = 1.0 / ray.direction;
+    ShearedRay sheared = shearRay(ray);
+    if (bvhHit(0, false, ray, inverseDirection, sheared, t_min, closest_t, hit_record)) {
+        hit_anything = true;
+    }
+    if (triangleCount > 0 && bvhHit(meshRoot, true, ray, inverseDirection, sheared, t_min, closest_t, hit_record)) {
+        hit_anything = true;
+    }
+
+    return hit_anything;
+}
+
+bool scatter(inout Ray ray, in HitRecord hit_record, inout vec3 color) {
+    switch (hit_record.material.type) {
+        case DiffuseType: {
+            vec3 scatterDirection = hit_record.normal + randomVec3(-1.0, 1.0);
+            if (nearZero(scatterDirection)) {
+                scatterDirection = hit_record.normal;
+            }
+            ray = Ray(hit_record.point, scatterDirection);
+            color = hit_record.material.albedo;
+            return true;
+        }
+        case ReflectiveType: {
+            float cos_alpha = dot(ray.direction, hit_record.normal) / (length(ray.direction) * length(hit_record.normal));
+            ray = Ray(hit_record.point, normalized(ray.direction - 2 * hit_record.normal * cos_alpha + hit_record.material.fuzz * randomInHemisphere(hit_record.normal)));
+            color = vec3(1, 1, 1) * 0.9;
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+vec3 processRay(Ray ray) {
+    vec3 color = vec3(1, 1, 1);
+    HitRecord hit_record;
+    int depth = 0;
+    while (sceneHit(ray, 0.001, kInfinity, hit_record)) {
+        if (depth >= kMaxDepth) {
+            return vec3(0, 0, 0);
+        }
+
+        vec3 attenuation;
+        if (scatter(ray, hit_record, attenuation)) {
+            color *= attenuation;
+        } else {
+            return vec3(0, 0, 0);
+        }
+
+        ++depth;
+    }
+
+    float skyCoefficient = (ray.direction.y + 1.0) / 2.0;
+    vec3 skyColor = vec3(1, 1, 1) - skyCoefficient * vec3(1, 0, 0);
+    if (depth == 0) {
+        return skyColor;
+    } else if (hit_record.material.type == ReflectiveType) {
+        return color * skyColor;
+    } else {
+        return color;
+    }
+}
+
+const float kMinAdaptiveLuminance = 0.05;  // The error of darker pixels is measured against this
+
+// Whether the standard error of the pixel's mean luminance fell below the threshold, mirrors CpuTracer::hasConverged()
+bool hasConverged(in vec4 accumulated, in float meanSquare) {
+    if (p.accumulatedFrames == 0 || accumulated.a < float(p.adaptiveMinSamples)) {
+        return false;
+    }
+    float mean = luminance(accumulated.rgb);
+    float variance = max(meanSquare - mean * mean, 0.0);
+    return sqrt(variance / accumulated.a) <= p.adaptiveThreshold * max(mean, kMinAdaptiveLuminance);
+}
+
+vec3 tracePixel(in ivec2 pixel) {
+    // Rays and random sequences follow the pixel's position in the whole image, so tiles match an untiled render
+    ivec2 imagePixel = pixel + ivec2(p.tileX, p.tileY);
+    fragCoord = vec2(imagePixel) + 0.5;
+
+    vec4 accumulated = p.accumulatedFrames > 0 ? imageLoad(accumulation, pixel) : vec4(0.0);
+    bool adaptive = p.adaptiveThreshold > 0.0;
+    float meanSquare = adaptive && p.accumulatedFrames > 0 ? imageLoad(meanSquares, pixel).r : 0.0;
+    if (adaptive && hasConverged(accumulated, meanSquare)) {
+        atomicAdd(convergedPixels, 1u);
+        return accumulated.rgb;
+    }
+    beginPixel(imagePixel, uint(accumulated.a));
+
+    Ray ray;
+    ray.origin = p.camera;
+    vec3 color = vec3(0, 0, 0);
+    float squares = 0.0;
+    for (int i = 0; i < int(p.samples); ++i) {
+        float x = (fragCoord.x + random()) / (float(p.width) - 1.0);
+        float y = 1.0 - (fragCoord.y + random()) / (float(p.height) - 1.0);
+        ray.direction = normalized(lowerLeftCorner +
+                                   x * horizontal +
+                                   y * vertical -
+                                   p.camera);
+
+        vec3 sampleColor = processRay(ray);
+        color += sampleColor;
+        squares += luminance(sampleColor) * luminance(sampleColor);
+        nextSample();
+    }
+
+    float samples = float(p.samples) + accumulated.a;
+    color = (color + accumulated.rgb * accumulated.a) / samples;
+
+    imageStore(accumulation, pixel, vec4(color, samples));
+    if (adaptive) {
+        imageStore(meanSquares, pixel, vec4((squares + meanSquare * accumulated.a) / samples));
+    }
+    return color;
+}
@@ -3,71 +3,107 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
-#include <functional>
-#include <algorithm>
-#include <string>
+#include <utility>
 
-template<class VkThing, class DeleterType>
-class VkWrapperInterface {
+// Move-only owners of Vulkan handles. The destroy function is a template argument, so it is called directly and a
+// handle takes no more space than the raw handle plus, for children, the handle of their parent.
+//
+//   VkDeviceChild<VkImage, vkDestroyImage> image;
+//   vkCreateImage(device, &createInfo, nullptr, image.put(device));
+//
+// Destroying VK_NULL_HANDLE is a no-op, so owners that never received a handle are fine.
+
+template<class Handle, auto Destroy>
+class VkHandle {
  public:
-  explicit VkWrapperInterface(DeleterType deleter) : _deleter(std::move(deleter)) {}
-  DeleterType getDeleter() {
-    return _deleter;
+  VkHandle() = default;
+  VkHandle(const VkHandle&) = delete;
+  VkHandle& operator=(const VkHandle&) = delete;
+  VkHandle(VkHandle&& other) noexcept : _handle(other.release()) {}
+  VkHandle& operator=(VkHandle&& other) noexcept {
+    if (this != &other) {
+      reset();
+      _handle = other.release();
+    }
+    return *this;
+  }
+  ~VkHandle() {
+    reset();
   }
-  VkThing* get() {
-    return &_thing;
+
+  Handle operator*() const {
+    return _handle;
+  }
+  // For create functions: destroys the owned handle and returns where the new one is written to
+  Handle* put() {
+    reset();
+    return &_handle;
   }
-  VkThing& operator->() {
-    return _thing;
+  Handle release() {
+    return std::exchange(_handle, Handle{});
   }
-  VkThing operator*() {
-    return _thing;
+  void reset() {
+    if (_handle != Handle{}) {
+      Destroy(release(), nullptr);
+    }
   }
 
  private:
-  DeleterType _deleter;
-  VkThing _thing;
+  Handle _handle{};
 };
 
-template<class VkThing>
-using VkWrapperDeleter = std::function<void(VkThing, const VkAllocationCallbacks*)>;
-
-template<class VkThing>
-class VkWrapper : public VkWrapperInterface<VkThing, VkWrapperDeleter<VkThing>> {
-  using Interface = VkWrapperInterface<VkThing, VkWrapperDeleter<VkThing>>;
+template<class Handle, class Parent, auto Destroy>
+class VkChildHandle {
  public:
-  explicit VkWrapper(VkWrapperDeleter<VkThing> deleter) : Interface(deleter) {}
-  virtual ~VkWrapper() {
-    Interface::getDeleter()(Interface::operator*(), nullptr);
+  VkChildHandle() = default;
+  VkChildHandle(const VkChildHandle&) = delete;
+  VkChildHandle& operator=(const VkChildHandle&) = delete;
+  VkChildHandle(VkChildHandle&& other) noexcept : _parent(other._parent), _handle(other.release()) {}
+  VkChildHandle& operator=(VkChildHandle&& other) noexcept {
+    if (this != &other) {
+      reset();
+      _parent = other._parent;
+      _handle = other.release();
+    }
+    return *this;
   }
-};
-
-template<class VkThing, class VkParent>
-using VkWrapperWithParentDeleter = std::function<void(VkParent, VkThing, const VkAllocationCallbacks*)>;
-
-template<class VkThing, class VkParent>
-class VkWrapperWithParent: public VkWrapperInterface<VkThing, VkWrapperWithParentDeleter<VkThing, VkParent>> {
-  using Interface = VkWrapperInterface<VkThing, VkWrapperWithParentDeleter<VkThing, VkParent>>;
- public:
-  VkWrapperWithParent(VkParent* parent, VkWrapperWithParentDeleter<VkThing, VkParent> deleter) : Interface(deleter), _parent(parent) {}
-  virtual ~VkWrapperWithParent() {
-    Interface::getDeleter()(*_parent, Interface::operator*(), nullptr);
+  ~VkChildHandle() {
+    reset();
   }
- private:
-  VkParent* _parent;
-};
 
-template<class VkThing, class VkParent>
-class VkWrapperVectorWithParent: public VkWrapperInterface<std::vector<VkThing>, VkWrapperWithParentDeleter<VkThing, VkParent>> {
-  using Interface = VkWrapperInterface<std::vector<VkThing>, VkWrapperWithParentDeleter<VkThing, VkParent>>;
- public:
-  VkWrapperVectorWithParent(VkParent* parent, VkWrapperWithParentDeleter<VkThing, VkParent> deleter) : Interface(deleter), _parent(parent) {}
-  virtual ~VkWrapperVectorWithParent() {
-    for (auto& thing : Interface::operator*()) {
-      Interface::getDeleter()(*_parent, thing, nullptr);
+  Handle operator*() const {
+    return _handle;
+  }
+  // For functions taking arrays of handles
+  const Handle* address() const {
+    return &_handle;
+  }
+  Parent getParent() const {
+    return _parent;
+  }
+  // For create functions: destroys the owned handle and returns where the new one, created from parent, is written to
+  Handle* put(Parent parent) {
+    reset();
+    _parent = parent;
+    return &_handle;
+  }
+  Handle release() {
+    return std::exchange(_handle, Handle{});
+  }
+  void reset() {
+    if (_handle != Handle{}) {
+      Destroy(_parent, release(), nullptr);
     }
   }
 
+  static void destroy(Parent parent, Handle handle) {
+    Destroy(parent, handle, nullptr);
+  }
+
  private:
-  VkParent* _parent;
+  Parent _parent{};
+  Handle _handle{};
 };
+
+template<class Handle, auto Destroy>
+using VkDeviceChild = VkChildHandle<Handle, VkDevice, Destroy>;
@@ -1,21 +1,116 @@
 #include "vulkan.h"
 
-Vulkan::Vulkan(GLFWwindow* window) : _window(window) {
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <random>
+
+#include "event_tracer.h"
+#include "ppm.h"
+#include "sampling.h"
+#include "shaders.h"
+
+Vulkan::Vulkan(GLFWwindow* window, const Settings& settings, const Scene& scene) : _window(window), _settings(settings) {
+  TraceScope scope("init vulkan");
   initInstance();
-  initSurface();
+  if (!isHeadless()) {
+    initSurface();
+  }
   initPhysicalDevice();
   initLogicalDevice();
-  initSwapChain();
+  initAllocator();
+  initProfiler();
+  if (isHeadless()) {
+    initOffscreenImages();
+  } else {
+    initSwapChain();
+  }
   initImageViews();
-  initRenderPass();
-  initGraphicsPipeline();
-  initFramebuffers();
+  initDescriptorSetLayout();
+  initPipelineLayout();
+  initPipelineCache();
+  if (_settings.backend == Backend::Compute) {
+    initTracePipelines();
+    if (_settings.dynamicResolution) {
+      initUpscalePipeline();
+    }
+    if (_settings.denoise) {
+      initDenoisePipelines();
+    }
+  } else {
+    initRenderPass();
+    initTracePipelines();
+    initFramebuffers();
+  }
   initCommandPool();
+  if (!_settings.traceOutput.empty() && _profiler->isEnabled()) {
+    initGpuClockCalibration();
+  }
+  initAccumulationImage();
+  if (_settings.backend == Backend::Compute) {
+    initOutputImage();
+  }
+  if (_settings.denoise) {
+    initDenoiseImages();
+  }
+  if (_settings.dynamicResolution) {
+    initUpscaledImage();
+    _resolutionController = std::make_unique<ResolutionController>(_settings.frameBudgetMs, _settings.minResolutionScale);
+  }
+  updateTraceExtent();
+  _pushConstant.sampling = static_cast<uint32_t>(_settings.sampler);
+  _pushConstant.adaptiveThreshold = _settings.adaptiveThreshold;
+  _pushConstant.adaptiveMinSamples = _settings.adaptiveMinSamples;
+  initSceneBuffers(scene);
+  initBlueNoiseBuffer();
+  initConvergenceBuffers();
+  initDescriptorPool();
+  initDescriptorSets();
+  if (isHeadless()) {
+    initReadbackBuffers();
+  }
+  if (!_settings.capturePrefix.empty()) {
+    initCapture();
+  }
   initCommandBuffers();
   initSyncObjects();
+  if (!_settings.shaderDirectory.empty()) {
+    initShaderWatcher();
+  }
+}
+
+Vulkan::~Vulkan() {
+  // Its callback builds pipelines on this object
+  _shaderWatcher.reset();
+  vkDeviceWaitIdle(*_device);
+  if (_captureWriter) {
+    // Writes the frames still in flight before their staging buffers are destroyed. A failed writer rethrows its
+    // error, which must not escape the destructor; while unwinding it is the error being reported already.
+    try {
+      for (size_t i = 0; i < kMaxFramesInFlight; ++i) {
+        submitCapture((_currentFrame + i) % kMaxFramesInFlight);
+      }
+    } catch (const std::exception& e) {
+      if (std::uncaught_exceptions() == 0) {
+        std::cerr << e.what() << std::endl;
+      }
+    }
+    _captureWriter.reset();
+  }
+  _deletionQueue.flush();
+  // Finishes the variants still compiling, so they end up in the saved cache too
+  _reloadedTracePipelines.reset();
+  _tracePipelines.reset();
+  savePipelineCache();
 }
 
 void Vulkan::initInstance() {
+  TraceScope scope("initInstance");
   if (kEnableValidationLayers && !checkValidationLayerSupport()) {
     throw std::runtime_error("validation layers requested, but not available!");
   }
@@ -41,7 +136,7 @@ void Vulkan::initInstance() {
     createInfo.enabledLayerCount = 0;
   }
 
-  if (vkCreateInstance(&createInfo, nullptr, _instance.get()) != VK_SUCCESS) {
+  if (vkCreateInstance(&createInfo, nullptr, _instance.put()) != VK_SUCCESS) {
     throw std::runtime_error("failed to create instance!");
   }
 }
@@ -66,10 +161,12 @@ bool Vulkan::checkValidationLayerSupport() {
 }
 
 std::vector<const char*> Vulkan::getRequiredExtensions() const {
-  uint32_t glfwExtensionCount = 0;
-  auto glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-  std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  std::vector<const char*> extensions;
+  if (!isHeadless()) {
+    uint32_t glfwExtensionCount = 0;
+    auto glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
   extensions.push_back("VK_KHR_get_physical_device_properties2");
 
   if (kEnableValidationLayers) {
@@ -80,6 +177,7 @@ std::vector<const char*> Vulkan::getRequiredExtensions() const {
 }
 
 void Vulkan::initPhysicalDevice() {
+  TraceScope scope("initPhysicalDevice");
   uint32_t deviceCount = 0;
   vkEnumeratePhysicalDevices(*_instance, &deviceCount, nullptr);
 
@@ -114,15 +212,24 @@ Vulkan::QueueFamilyIndices Vulkan::findQueueFamilies(VkPhysicalDevice device) {
   std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
   vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
+  VkQueueFlags graphicsFlags = VK_QUEUE_GRAPHICS_BIT;
+  if (_settings.backend == Backend::Compute) {
+    graphicsFlags |= VK_QUEUE_COMPUTE_BIT;
+  }
+
   for (int i = 0; i < queueFamilyCount; ++i) {
-    if (queueFamilies.at(i).queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+    if ((queueFamilies.at(i).queueFlags & graphicsFlags) == graphicsFlags) {
       indices.graphicsFamily = i;
     }
 
-    VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, *_surface, &presentSupport);
-    if (presentSupport) {
-      indices.presentFamily = i;
+    if (isHeadless()) {
+      indices.presentFamily = indices.graphicsFamily;  // Nothing is presented, the queue is never used
+    } else {
+      VkBool32 presentSupport = false;
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, *_surface, &presentSupport);
+      if (presentSupport) {
+        indices.presentFamily = i;
+      }
     }
 
     if (indices.isComplete()) {
@@ -130,6 +237,22 @@ Vulkan::QueueFamilyIndices Vulkan::findQueueFamilies(VkPhysicalDevice device) {
     }
   }
 
+  if (_settings.asyncCompute && indices.graphicsFamily) {
+    // A family without graphics support is most likely backed by dedicated compute hardware
+    for (uint32_t i = 0; i < queueFamilyCount; ++i) {
+      VkQueueFlags flags = queueFamilies.at(i).queueFlags;
+      if (!(flags & VK_QUEUE_COMPUTE_BIT) || i == indices.graphicsFamily.value()) {
+        continue;
+      }
+      if (!indices.computeFamily || !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+        indices.computeFamily = i;
+        if (!(flags & VK_QUEUE_GRAPHICS_BIT)) {
+          break;
+        }
+      }
+    }
+  }
+
   return indices;
 }
 
@@ -140,8 +263,8 @@ int Vulkan::rateDeviceSuitability(VkPhysicalDevice device) {  // TODO: Refactor
   vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
 
   bool extensionsSupported = checkDeviceExtensionSupport(device);
-  bool swapChainAdequate;
-  if (extensionsSupported) {
+  bool swapChainAdequate = isHeadless();
+  if (extensionsSupported && !isHeadless()) {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
     swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
   }
@@ -151,6 +274,11 @@ int Vulkan::rateDeviceSuitability(VkPhysicalDevice device) {  // TODO: Refactor
     return 0;
   }
 
+  // The fragment tracer writes its accumulation image
+  if (_settings.backend == Backend::Fragment && !deviceFeatures.fragmentStoresAndAtomics) {
+    return 0;
+  }
+
   if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
     return INT_MAX;
   }
@@ -159,10 +287,20 @@ int Vulkan::rateDeviceSuitability(VkPhysicalDevice device) {  // TODO: Refactor
 }
 
 void Vulkan::initLogicalDevice() {
+  TraceScope scope("initLogicalDevice");
   QueueFamilyIndices indices = findQueueFamilies(_physicalDevice);
+  _graphicsFamily = indices.graphicsFamily.value();
+  _asyncCompute = indices.computeFamily.has_value();
+  if (_settings.asyncCompute && !_asyncCompute) {
+    std::cerr << "the device has no separate compute queue family, async compute is disabled" << std::endl;
+  }
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
   std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+  if (_asyncCompute) {
+    _computeFamily = indices.computeFamily.value();
+    uniqueQueueFamilies.insert(_computeFamily);
+  }
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -175,13 +313,15 @@ void Vulkan::initLogicalDevice() {
   }
 
   VkPhysicalDeviceFeatures deviceFeatures{};
+  deviceFeatures.fragmentStoresAndAtomics = _settings.backend == Backend::Fragment;
   VkDeviceCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
   createInfo.queueCreateInfoCount = queueCreateInfos.size();
   createInfo.pEnabledFeatures = &deviceFeatures;
-  createInfo.enabledExtensionCount = kDeviceExtensions.size();
-  createInfo.ppEnabledExtensionNames = kDeviceExtensions.data();
+  auto extensions = getRequiredDeviceExtensions(_physicalDevice);
+  createInfo.enabledExtensionCount = extensions.size();
+  createInfo.ppEnabledExtensionNames = extensions.data();
 
   if (kEnableValidationLayers) {
     createInfo.enabledLayerCount = static_cast<uint32_t>(kValidationLayers.size());
@@ -190,30 +330,85 @@ void Vulkan::initLogicalDevice() {
     createInfo.enabledLayerCount = 0;
   }
 
-  if (vkCreateDevice(_physicalDevice, &createInfo, nullptr, _device.get()) != VK_SUCCESS) {
+  if (vkCreateDevice(_physicalDevice, &createInfo, nullptr, _device.put()) != VK_SUCCESS) {
     throw std::runtime_error("failed to create logical device!");
   }
 
   vkGetDeviceQueue(*_device, indices.graphicsFamily.value(), 0, &_graphicsQueue);
   vkGetDeviceQueue(*_device, indices.presentFamily.value(), 0, &_presentQueue);
+  if (_asyncCompute) {
+    vkGetDeviceQueue(*_device, _computeFamily, 0, &_computeQueue);
+  }
+}
+
+void Vulkan::initAllocator() {
+  _allocator = std::make_unique<MemoryAllocator>(_physicalDevice, *_device, kMaxFramesInFlight);
+}
+
+void Vulkan::initProfiler() {
+  QueueFamilyIndices indices = findQueueFamilies(_physicalDevice);
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(_physicalDevice, &deviceProperties);
+
+  // Dynamic resolution is driven by the measured frame times
+  uint32_t validBits = 0;
+  if (!_settings.profileOutput.empty() || _settings.profileStdout || _settings.dynamicResolution ||
+      !_settings.traceOutput.empty()) {
+    validBits = queueFamilies[indices.graphicsFamily.value()].timestampValidBits;
+    if (_asyncCompute) {
+      validBits = std::min(validBits, queueFamilies[_computeFamily].timestampValidBits);
+    }
+    if (validBits == 0) {
+      std::cerr << "timestamps are not supported by the queues, GPU profiling and dynamic resolution are disabled"
+                << std::endl;
+    }
+  }
+  _profiler = std::make_unique<GpuProfiler>(*_device, kMaxFramesInFlight, validBits,
+                                            deviceProperties.limits.timestampPeriod);
 }
 
 void Vulkan::initSurface() {
-  if (glfwCreateWindowSurface(*_instance, _window, nullptr, _surface.get()) != VK_SUCCESS) {
+  if (glfwCreateWindowSurface(*_instance, _window, nullptr, _surface.put(*_instance)) != VK_SUCCESS) {
     throw std::runtime_error("failed to create window surface!");
   }
 }
 
-bool Vulkan::checkDeviceExtensionSupport(VkPhysicalDevice device) {
+std::vector<VkExtensionProperties> Vulkan::getAvailableDeviceExtensions(VkPhysicalDevice device) {
   uint32_t extensionCount;
   vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
 
   std::vector<VkExtensionProperties> availableExtensions(extensionCount);
   vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-  std::set<std::string> requiredExtensions(kDeviceExtensions.begin(), kDeviceExtensions.end());
+  return availableExtensions;
+}
+
+std::vector<const char*> Vulkan::getRequiredDeviceExtensions(VkPhysicalDevice device) {
+  std::vector<const char*> extensions;
+  if (!isHeadless()) {
+    extensions = kSwapChainExtensions;
+  }
+
+  // The spec requires enabling the portability subset whenever the implementation (e.g. MoltenVK) exposes it
+  for (const auto& extension : getAvailableDeviceExtensions(device)) {
+    if (strcmp(extension.extensionName, kPortabilitySubsetExtension) == 0) {
+      extensions.push_back(kPortabilitySubsetExtension);
+    }
+  }
+
+  return extensions;
+}
+
+bool Vulkan::checkDeviceExtensionSupport(VkPhysicalDevice device) {
+  auto extensions = getRequiredDeviceExtensions(device);
+  std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
-  for (const auto& extension : availableExtensions) {
+  for (const auto& extension : getAvailableDeviceExtensions(device)) {
     requiredExtensions.erase(extension.extensionName);
   }
 
@@ -255,12 +450,33 @@ VkSurfaceFormatKHR Vulkan::chooseSwapSurfaceFormat(const std::vector<VkSurfaceFo
 }
 
 VkPresentModeKHR Vulkan::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
-  for (const auto& availablePresentMode : availablePresentModes) {
-    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-      return availablePresentMode;
+  std::vector<VkPresentModeKHR> preferredPresentModes;
+  switch (_settings.presentMode) {
+    case PresentMode::Auto:
+      if (_settings.pacing != Pacing::Vsync) {
+        preferredPresentModes = {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
+      }
+      break;
+    case PresentMode::Fifo:
+      break;
+    case PresentMode::Mailbox:
+      preferredPresentModes = {VK_PRESENT_MODE_MAILBOX_KHR};
+      break;
+    case PresentMode::Immediate:
+      preferredPresentModes = {VK_PRESENT_MODE_IMMEDIATE_KHR};
+      break;
+  }
+
+  for (auto preferredPresentMode : preferredPresentModes) {
+    if (std::find(availablePresentModes.begin(), availablePresentModes.end(), preferredPresentMode) != availablePresentModes.end()) {
+      return preferredPresentMode;
     }
   }
+  if (_settings.presentMode != PresentMode::Auto && _settings.presentMode != PresentMode::Fifo) {
+    std::cerr << "requested present mode is not supported, falling back to FIFO" << std::endl;
+  }
 
+  // The only mode every implementation has to support
   return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -283,7 +499,8 @@ VkExtent2D Vulkan::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities
   }
 }
 
-void Vulkan::initSwapChain() {
+void Vulkan::initSwapChain(VkSwapchainKHR oldSwapChain) {
+  TraceScope scope("initSwapChain");
   SwapChainSupportDetails swapChainSupport = querySwapChainSupport(_physicalDevice);
 
   VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
@@ -305,6 +522,18 @@ void Vulkan::initSwapChain() {
   createInfo.imageExtent = extent;
   createInfo.imageArrayLayers = 1;
   createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  if (_settings.backend == Backend::Compute) {
+    if (!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+      throw std::runtime_error("swap chain images can't be blitted to!");
+    }
+    createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  }
+  if (!_settings.capturePrefix.empty()) {
+    if (!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+      throw std::runtime_error("swap chain images can't be captured!");
+    }
+    createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
 
   QueueFamilyIndices indices = findQueueFamilies(_physicalDevice);
   uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
@@ -321,9 +550,9 @@ void Vulkan::initSwapChain() {
   createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
   createInfo.presentMode = presentMode;
   createInfo.clipped = VK_TRUE;
-  createInfo.oldSwapchain = VK_NULL_HANDLE;
+  createInfo.oldSwapchain = oldSwapChain;
 
-  if (vkCreateSwapchainKHR(*_device, &createInfo, nullptr, _swapChain.get()) != VK_SUCCESS) {
+  if (vkCreateSwapchainKHR(*_device, &createInfo, nullptr, _swapChain.put(*_device)) != VK_SUCCESS) {
     throw std::runtime_error("failed to create swap chain!");
   }
 
@@ -335,8 +564,46 @@ void Vulkan::initSwapChain() {
   _swapChainExtent = extent;
 }
 
+void Vulkan::initOffscreenImages() {
+  TraceScope scope("initOffscreenImages");
+  _swapChainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+  _swapChainExtent = {_settings.width, _settings.height};
+  if (_settings.offlineTileSize > 0) {
+    _swapChainExtent = {std::min(_settings.width, _settings.offlineTileSize),
+                        std::min(_settings.height, _settings.offlineTileSize)};
+  }
+
+  _offscreenImages.resize(kMaxFramesInFlight);
+  _offscreenImageMemory.resize(kMaxFramesInFlight);
+  _swapChainImages.resize(kMaxFramesInFlight);
+
+  for (size_t i = 0; i < kMaxFramesInFlight; i++) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = _swapChainImageFormat;
+    imageInfo.extent = {_swapChainExtent.width, _swapChainExtent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (vkCreateImage(*_device, &imageInfo, nullptr, _offscreenImages.at(i).put(*_device)) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create offscreen image!");
+    }
+
+    _offscreenImageMemory.at(i) =
+        _allocator->allocateForImage(*_offscreenImages.at(i), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    _swapChainImages[i] = *_offscreenImages.at(i);
+  }
+}
+
 void Vulkan::initImageViews() {
-  _swapChainImageViews.get()->resize(_swapChainImages.size());
+  _swapChainImageViews.resize(_swapChainImages.size());
 
   for (size_t i = 0; i < _swapChainImages.size(); i++) {
     VkImageViewCreateInfo createInfo{};
@@ -354,18 +621,73 @@ void Vulkan::initImageViews() {
     createInfo.subresourceRange.baseArrayLayer = 0;
     createInfo.subresourceRange.layerCount = 1;
 
-    if (vkCreateImageView(*_device, &createInfo, nullptr, &_swapChainImageViews.get()->at(i)) != VK_SUCCESS) {
+    if (vkCreateImageView(*_device, &createInfo, nullptr, _swapChainImageViews.at(i).put(*_device)) != VK_SUCCESS) {
       throw std::runtime_error("failed to create image views!");
     }
   }
 }
 
-void Vulkan::initGraphicsPipeline() {
-  auto vertShaderCode = readFile("./vert.spv");
-  auto fragShaderCode = readFile("./frag.spv");
+void Vulkan::initPipelineLayout() {
+  VkPushConstantRange pushConstant;
+  pushConstant.offset = 0;
+  pushConstant.size = sizeof(PushConstants);
+  pushConstant.stageFlags = getTracingShaderStage();
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = _descriptorSetLayout.address();
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+
+  if (vkCreatePipelineLayout(*_device, &pipelineLayoutInfo, nullptr, _pipelineLayout.put(*_device)) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline layout!");
+  }
+}
+
+void Vulkan::initTracePipelines() {
+  TraceScope scope("initTracePipelines");
+  if (_settings.backend == Backend::Compute) {
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(_physicalDevice, &deviceProperties);
+    const auto& limits = deviceProperties.limits;
+    if (_settings.tileWidth > limits.maxComputeWorkGroupSize[0] || _settings.tileHeight > limits.maxComputeWorkGroupSize[1] ||
+        _settings.tileWidth * _settings.tileHeight > limits.maxComputeWorkGroupInvocations) {
+      throw std::runtime_error("tile size exceeds the device's compute workgroup limits!");
+    }
+  }
+
+  std::vector<ShaderCode> code;
+  if (_settings.backend == Backend::Compute) {
+    code = {kCompShaderCode};
+  } else {
+    code = {kVertShaderCode, kFragShaderCode};
+  }
+  _tracePipelines = std::make_unique<PipelineVariants>(*_device, makeTraceFactory(code));
+  // The first frame can't do without its variant, the other one is likely needed as soon as the camera moves or stops.
+  // Frames written headless must never be traced by a fallback variant, so they wait for both.
+  Quality firstQuality = _settings.accumulate ? _settings.movingQuality : _settings.quality;
+  _tracePipelines->build(firstQuality);
+  if (isHeadless()) {
+    _tracePipelines->build(_settings.quality);
+    _tracePipelines->build(_settings.movingQuality);
+  }
+  _tracePipelines->request(_settings.quality);
+  _tracePipelines->request(_settings.movingQuality);
+}
+
+PipelineVariants::Factory Vulkan::makeTraceFactory(std::vector<ShaderCode> code) {
+  return [this, code](Quality quality) {
+    TracerConstants constants = getTracerConstants(quality, _settings.verticalFov);
+    return _settings.backend == Backend::Compute ? createComputeTracePipeline(code.at(0), constants)
+                                                 : createGraphicsPipeline(code.at(0), code.at(1), constants);
+  };
+}
 
-  VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-  VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+VkPipeline Vulkan::createGraphicsPipeline(const ShaderCode& vertCode, const ShaderCode& fragCode,
+                                          const TracerConstants& constants) {
+  VkShaderModule vertShaderModule = createShaderModule(vertCode);
+  VkShaderModule fragShaderModule = createShaderModule(fragCode);
 
   VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
   vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -378,6 +700,9 @@ void Vulkan::initGraphicsPipeline() {
   fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
   fragShaderStageInfo.module = fragShaderModule;
   fragShaderStageInfo.pName = "main";
+  VkSpecializationMapEntry specializationEntries[2];
+  VkSpecializationInfo specializationInfo = getTracerSpecializationInfo(&constants, 0, specializationEntries);
+  fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
 
   VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
@@ -391,24 +716,17 @@ void Vulkan::initGraphicsPipeline() {
   inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
   inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-  VkViewport viewport{};
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width = (float) _swapChainExtent.width;
-  viewport.height = (float) _swapChainExtent.height;
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-
-  VkRect2D scissor{};
-  scissor.offset = {0, 0};
-  scissor.extent = _swapChainExtent;
-
+  // Set while recording, so the pipeline survives swap chain recreation
   VkPipelineViewportStateCreateInfo viewportState{};
   viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
   viewportState.viewportCount = 1;
-  viewportState.pViewports = &viewport;
   viewportState.scissorCount = 1;
-  viewportState.pScissors = &scissor;
+
+  VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamicState{};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = 2;
+  dynamicState.pDynamicStates = dynamicStates;
 
   VkPipelineRasterizationStateCreateInfo rasterizer{};
   rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -440,21 +758,6 @@ void Vulkan::initGraphicsPipeline() {
   colorBlending.blendConstants[2] = 0.0f;
   colorBlending.blendConstants[3] = 0.0f;
 
-  VkPushConstantRange pushConstant;
-  pushConstant.offset = 0;
-  pushConstant.size = sizeof(Camera);
-  pushConstant.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 0;
-  pipelineLayoutInfo.pushConstantRangeCount = 1;
-  pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
-
-  if (vkCreatePipelineLayout(*_device, &pipelineLayoutInfo, nullptr, _pipelineLayout.get()) != VK_SUCCESS) {
-    throw std::runtime_error("failed to create pipeline layout!");
-  }
-
   VkGraphicsPipelineCreateInfo pipelineInfo{};
   pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineInfo.stageCount = 2;
@@ -465,42 +768,230 @@ void Vulkan::initGraphicsPipeline() {
   pipelineInfo.pRasterizationState = &rasterizer;
   pipelineInfo.pMultisampleState = &multisampling;
   pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.pDynamicState = &dynamicState;
   pipelineInfo.layout = *_pipelineLayout;
   pipelineInfo.renderPass = *_renderPass;
   pipelineInfo.subpass = 0;
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-  if (vkCreateGraphicsPipelines(*_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, _graphicsPipeline.get()) != VK_SUCCESS) {
+  VkPipeline pipeline;
+  VkResult result = vkCreateGraphicsPipelines(*_device, *_pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+  vkDestroyShaderModule(*_device, fragShaderModule, nullptr);
+  vkDestroyShaderModule(*_device, vertShaderModule, nullptr);
+  if (result != VK_SUCCESS) {
     throw std::runtime_error("failed to create graphics pipeline!");
   }
+  return pipeline;
+}
 
-  vkDestroyShaderModule(*_device, fragShaderModule, nullptr);
-  vkDestroyShaderModule(*_device, vertShaderModule, nullptr);
+VkPipeline Vulkan::createComputeTracePipeline(const ShaderCode& code, const TracerConstants& constants) {
+  struct ComputeConstants {
+    uint32_t tileWidth;
+    uint32_t tileHeight;
+    TracerConstants tracer;
+  };
+  ComputeConstants computeConstants{_settings.tileWidth, _settings.tileHeight, constants};
+
+  VkSpecializationMapEntry specializationEntries[4]{};
+  specializationEntries[0] = {0, offsetof(ComputeConstants, tileWidth), sizeof(uint32_t)};
+  specializationEntries[1] = {1, offsetof(ComputeConstants, tileHeight), sizeof(uint32_t)};
+  getTracerSpecializationInfo(&computeConstants.tracer, offsetof(ComputeConstants, tracer), specializationEntries + 2);
+
+  VkSpecializationInfo specializationInfo{};
+  specializationInfo.mapEntryCount = 4;
+  specializationInfo.pMapEntries = specializationEntries;
+  specializationInfo.dataSize = sizeof(computeConstants);
+  specializationInfo.pData = &computeConstants;
+
+  VkPipeline pipeline;
+  createComputePipeline(code, &specializationInfo, &pipeline);
+  return pipeline;
 }
 
-std::vector<char> Vulkan::readFile(const std::string& filename) {
-  std::ifstream file(filename, std::ios::ate | std::ios::binary);
+VkSpecializationInfo Vulkan::getTracerSpecializationInfo(const TracerConstants* constants, uint32_t offset,
+                                                         VkSpecializationMapEntry* entries) {
+  // Mirrors the specialization constants of tracer.glsl
+  entries[0] = {10, offset + static_cast<uint32_t>(offsetof(TracerConstants, maxDepth)), sizeof(int32_t)};
+  entries[1] = {11, offset + static_cast<uint32_t>(offsetof(TracerConstants, verticalFov)), sizeof(float)};
+
+  VkSpecializationInfo specializationInfo{};
+  specializationInfo.mapEntryCount = 2;
+  specializationInfo.pMapEntries = entries;
+  specializationInfo.dataSize = sizeof(TracerConstants);
+  specializationInfo.pData = constants;
+  return specializationInfo;
+}
 
-  if (!file.is_open()) {
-    throw std::runtime_error("failed to open file!");
+void Vulkan::initShaderWatcher() {
+  std::filesystem::path directory = _settings.shaderDirectory;
+  std::vector<std::string> files;
+  if (_settings.backend == Backend::Compute) {
+    files = {(directory / "shader.comp").string()};
+  } else {
+    files = {(directory / "shader.vert").string(), (directory / "shader.frag").string()};
   }
 
-  size_t fileSize = (size_t) file.tellg();
-  std::vector<char> buffer(fileSize);
+  _shaderWatcher = std::make_unique<ShaderWatcher>(files, [this](std::vector<std::vector<uint32_t>> spirv) {
+    // Owned by the factory, which outlives the variants it creates
+    auto shared = std::make_shared<const std::vector<std::vector<uint32_t>>>(std::move(spirv));
+    std::vector<ShaderCode> code;
+    for (const auto& words : *shared) {
+      code.push_back({words.data(), words.size() * sizeof(uint32_t)});
+    }
+    PipelineVariants::Factory factory = makeTraceFactory(code);
+    auto variants = std::make_unique<PipelineVariants>(*_device, [shared, factory](Quality quality) {
+      return factory(quality);
+    });
+
+    // The preset of moving frames never changes, others are compiled once they are asked for. Headless frames must not
+    // fall back, so the still preset is compiled up front too.
+    try {
+      variants->build(_settings.movingQuality);
+      if (isHeadless()) {
+        variants->build(_settings.quality);
+      }
+    } catch (const std::exception& e) {
+      std::cerr << "keeping the previous shaders: " << e.what() << std::endl;
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(_reloadMutex);
+      _reloadedTracePipelines = std::move(variants);
+    }
+    if (!isHeadless()) {
+      // Wakes a window that sleeps until there is input, so the new shaders show up right away
+      glfwPostEmptyEvent();
+    }
+  });
+}
+
+void Vulkan::swapReloadedPipelines() {
+  std::unique_ptr<PipelineVariants> reloaded;
+  {
+    std::lock_guard<std::mutex> lock(_reloadMutex);
+    reloaded = std::move(_reloadedTracePipelines);
+  }
+  if (!reloaded) {
+    return;
+  }
+
+  // The previous frame may still trace with the old variants. A variant the old set was compiling is waited for,
+  // which only happens when the preset was switched right before.
+  std::vector<VkDeviceChild<VkPipeline, vkDestroyPipeline>> pipelines = _tracePipelines->takePipelines();
+  _deletionQueue.retire(pipelines);
+  _tracePipelines = std::move(reloaded);
+  // Frames accumulated so far were traced by the old shaders
+  _pushConstant.accumulatedFrames = 0;
+  std::cout << "swapped in the reloaded shaders" << std::endl;
+}
+
+void Vulkan::initUpscalePipeline() {
+  VkShaderModule upscaleShaderModule = createShaderModule(kUpscaleShaderCode);
+
+  VkSpecializationMapEntry specializationEntry{};
+  specializationEntry.constantID = 0;
+  specializationEntry.offset = 0;
+  specializationEntry.size = sizeof(float);
+
+  VkSpecializationInfo specializationInfo{};
+  specializationInfo.mapEntryCount = 1;
+  specializationInfo.pMapEntries = &specializationEntry;
+  specializationInfo.dataSize = sizeof(float);
+  specializationInfo.pData = &_settings.sharpness;
+
+  VkPipelineShaderStageCreateInfo upscaleShaderStageInfo{};
+  upscaleShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  upscaleShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  upscaleShaderStageInfo.module = upscaleShaderModule;
+  upscaleShaderStageInfo.pName = "main";
+  upscaleShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage = upscaleShaderStageInfo;
+  pipelineInfo.layout = *_pipelineLayout;
+  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+  if (vkCreateComputePipelines(*_device, *_pipelineCache, 1, &pipelineInfo, nullptr, _upscalePipeline.put(*_device)) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create upscale pipeline!");
+  }
+
+  vkDestroyShaderModule(*_device, upscaleShaderModule, nullptr);
+}
+
+void Vulkan::initDenoisePipelines() {
+  TraceScope scope("initDenoisePipelines");
+  // Their primary rays have to match the tracer's, the bounces don't matter to them
+  TracerConstants tracerConstants = getTracerConstants(_settings.quality, _settings.verticalFov);
+  VkSpecializationMapEntry tracerEntries[2];
+  VkSpecializationInfo tracerSpecializationInfo = getTracerSpecializationInfo(&tracerConstants, 0, tracerEntries);
+  createComputePipeline(kGbufferShaderCode, &tracerSpecializationInfo, _gbufferPipeline.put(*_device));
+  createComputePipeline(kTemporalShaderCode, &tracerSpecializationInfo, _temporalPipeline.put(*_device));
+
+  // Mirrors the specialization constants of atrous.comp
+  struct AtrousConstants {
+    int32_t step;
+    float colorSigma;
+    int32_t source;
+    int32_t destination;
+  };
+  enum AtrousImage : int32_t { kPing, kPong, kHistory, kOutput };
+  constexpr float kColorSigma = 1.0f;  // Of the first iteration, every further one halves it
+
+  VkSpecializationMapEntry specializationEntries[4]{};
+  specializationEntries[0] = {0, offsetof(AtrousConstants, step), sizeof(int32_t)};
+  specializationEntries[1] = {1, offsetof(AtrousConstants, colorSigma), sizeof(float)};
+  specializationEntries[2] = {2, offsetof(AtrousConstants, source), sizeof(int32_t)};
+  specializationEntries[3] = {3, offsetof(AtrousConstants, destination), sizeof(int32_t)};
+
+  // The temporal pass writes the ping image. The first iteration's result becomes the history of the next frame, so
+  // the history carries less of the single frames' noise without being blurred again every frame.
+  _atrousPipelines.resize(kDenoiseIterations);
+  int32_t source = kPing;
+  for (int i = 0; i < kDenoiseIterations; i++) {
+    int32_t destination = i == kDenoiseIterations - 1 ? kOutput : i == 0 ? kHistory : source == kPong ? kPing : kPong;
+    AtrousConstants constants{1 << i, kColorSigma / (1 << i), source, destination};
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = 4;
+    specializationInfo.pMapEntries = specializationEntries;
+    specializationInfo.dataSize = sizeof(constants);
+    specializationInfo.pData = &constants;
+    createComputePipeline(kAtrousShaderCode, &specializationInfo, _atrousPipelines.at(i).put(*_device));
+
+    source = destination;
+  }
+}
+
+void Vulkan::createComputePipeline(const ShaderCode& code, const VkSpecializationInfo* specializationInfo,
+                                   VkPipeline* pipeline) {
+  VkShaderModule shaderModule = createShaderModule(code);
+
+  VkPipelineShaderStageCreateInfo shaderStageInfo{};
+  shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  shaderStageInfo.module = shaderModule;
+  shaderStageInfo.pName = "main";
+  shaderStageInfo.pSpecializationInfo = specializationInfo;
 
-  file.seekg(0);
-  file.read(buffer.data(), fileSize);
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage = shaderStageInfo;
+  pipelineInfo.layout = *_pipelineLayout;
+  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-  file.close();
+  if (vkCreateComputePipelines(*_device, *_pipelineCache, 1, &pipelineInfo, nullptr, pipeline) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute pipeline!");
+  }
 
-  return buffer;
+  vkDestroyShaderModule(*_device, shaderModule, nullptr);
 }
 
-VkShaderModule Vulkan::createShaderModule(const std::vector<char>& code) {
+VkShaderModule Vulkan::createShaderModule(const ShaderCode& code) {
   VkShaderModuleCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  createInfo.codeSize = code.size();
-  createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+  createInfo.codeSize = code.size;
+  createInfo.pCode = code.code;
 
   VkShaderModule shaderModule;
   if (vkCreateShaderModule(*_device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
@@ -510,6 +1001,99 @@ VkShaderModule Vulkan::createShaderModule(const std::vector<char>& code) {
   return shaderModule;
 }
 
+std::string Vulkan::getPipelineCachePath() {
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(_physicalDevice, &deviceProperties);
+
+  // A cache is only valid for the exact device and driver build that produced it
+  std::string key;
+  char hex[3];
+  for (uint8_t byte : deviceProperties.pipelineCacheUUID) {
+    std::snprintf(hex, sizeof(hex), "%02x", byte);
+    key += hex;
+  }
+  return _settings.pipelineCacheDirectory + "/pipeline_cache_" + key + "_" + std::to_string(deviceProperties.driverVersion) + ".bin";
+}
+
+bool Vulkan::isPipelineCacheCompatible(const std::vector<char>& data) {
+  if (data.size() < sizeof(VkPipelineCacheHeaderVersionOne)) {
+    return false;
+  }
+
+  VkPipelineCacheHeaderVersionOne header;
+  std::memcpy(&header, data.data(), sizeof(header));
+
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(_physicalDevice, &deviceProperties);
+  return header.headerSize >= sizeof(header) && header.headerSize <= data.size() &&
+         header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendorID == deviceProperties.vendorID && header.deviceID == deviceProperties.deviceID &&
+         std::memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void Vulkan::initPipelineCache() {
+  TraceScope scope("initPipelineCache");
+  std::vector<char> data;
+  if (!_settings.pipelineCacheDirectory.empty()) {
+    std::ifstream file(getPipelineCachePath(), std::ios::ate | std::ios::binary);
+    if (file.is_open()) {
+      data.resize(static_cast<size_t>(file.tellg()));
+      file.seekg(0);
+      file.read(data.data(), data.size());
+      // Drivers are not required to reject foreign or corrupted data, so the header is checked here as well
+      if (!file || !isPipelineCacheCompatible(data)) {
+        data.clear();
+      }
+    }
+  }
+
+  VkPipelineCacheCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  createInfo.initialDataSize = data.size();
+  createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+  if (vkCreatePipelineCache(*_device, &createInfo, nullptr, _pipelineCache.put(*_device)) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline cache!");
+  }
+  _loadedPipelineCacheSize = data.size();
+}
+
+void Vulkan::savePipelineCache() {
+  if (_settings.pipelineCacheDirectory.empty() || *_pipelineCache == VK_NULL_HANDLE) {
+    return;
+  }
+
+  size_t size = 0;
+  if (vkGetPipelineCacheData(*_device, *_pipelineCache, &size, nullptr) != VK_SUCCESS) {
+    return;
+  }
+  // Nothing was compiled that the loaded cache did not already contain
+  if (size == _loadedPipelineCacheSize) {
+    return;
+  }
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(*_device, *_pipelineCache, &size, data.data()) != VK_SUCCESS) {
+    return;
+  }
+
+  // Concurrent processes each write their own file and atomically rename it over the previous cache
+  std::string path = getPipelineCachePath();
+  std::string temporaryPath = path + "." + std::to_string(std::random_device{}()) + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), size);
+    if (!file) {
+      std::cerr << "failed to write pipeline cache " << temporaryPath << std::endl;
+      std::remove(temporaryPath.c_str());
+      return;
+    }
+  }
+  if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+    std::cerr << "failed to write pipeline cache " << path << std::endl;
+    std::remove(temporaryPath.c_str());
+  }
+}
+
 void Vulkan::initRenderPass() {
   VkAttachmentDescription colorAttachment{};
   colorAttachment.format = _swapChainImageFormat;
@@ -519,7 +1103,7 @@ void Vulkan::initRenderPass() {
   colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  colorAttachment.finalLayout = isHeadless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
   VkAttachmentReference colorAttachmentRef{};
   colorAttachmentRef.attachment = 0;
@@ -530,13 +1114,21 @@ void Vulkan::initRenderPass() {
   subpass.colorAttachmentCount = 1;
   subpass.pColorAttachments = &colorAttachmentRef;
 
-  VkSubpassDependency dependency{};
-  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.dstSubpass = 0;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.srcAccessMask = 0;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  VkSubpassDependency dependencies[2]{};
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass = 0;
+  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[0].srcAccessMask = 0;
+  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+  // Headless frames are copied to a readback buffer right after the render pass
+  dependencies[1].srcSubpass = 0;
+  dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 
   VkRenderPassCreateInfo renderPassInfo{};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -544,20 +1136,20 @@ void Vulkan::initRenderPass() {
   renderPassInfo.pAttachments = &colorAttachment;
   renderPassInfo.subpassCount = 1;
   renderPassInfo.pSubpasses = &subpass;
-  renderPassInfo.dependencyCount = 1;
-  renderPassInfo.pDependencies = &dependency;
+  renderPassInfo.dependencyCount = isHeadless() ? 2 : 1;
+  renderPassInfo.pDependencies = dependencies;
 
-  if (vkCreateRenderPass(*_device, &renderPassInfo, nullptr, _renderPass.get()) != VK_SUCCESS) {
+  if (vkCreateRenderPass(*_device, &renderPassInfo, nullptr, _renderPass.put(*_device)) != VK_SUCCESS) {
     throw std::runtime_error("failed to create render pass!");
   }
 }
 
 void Vulkan::initFramebuffers() {
-  _swapChainFramebuffers.get()->resize(_swapChainImageViews.get()->size());
+  _swapChainFramebuffers.resize(_swapChainImageViews.size());
 
-  for (size_t i = 0; i < _swapChainImageViews.get()->size(); i++) {
+  for (size_t i = 0; i < _swapChainImageViews.size(); i++) {
     VkImageView attachments[] = {
-        _swapChainImageViews.get()->at(i)
+        *_swapChainImageViews.at(i)
     };
 
     VkFramebufferCreateInfo framebufferInfo{};
@@ -569,25 +1161,533 @@ void Vulkan::initFramebuffers() {
     framebufferInfo.height = _swapChainExtent.height;
     framebufferInfo.layers = 1;
 
-    if (vkCreateFramebuffer(*_device, &framebufferInfo, nullptr, &_swapChainFramebuffers.get()->at(i)) != VK_SUCCESS) {
+    if (vkCreateFramebuffer(*_device, &framebufferInfo, nullptr, _swapChainFramebuffers.at(i).put(*_device)) != VK_SUCCESS) {
       throw std::runtime_error("failed to create framebuffer!");
     }
   }
 }
+void Vulkan::initUpscaledImage() {
+  uint32_t count = _asyncCompute ? kMaxFramesInFlight : 1;
+  _upscaledImageMemory.resize(count);
+  _upscaledImages.resize(count);
+  _upscaledImageViews.resize(count);
+  for (uint32_t i = 0; i < count; i++) {
+    *_upscaledImageViews.at(i).put(*_device) = createStorageImage(VK_FORMAT_R16G16B16A16_SFLOAT,
+                                                                  VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                                                  _upscaledImages.at(i).put(*_device),
+                                                                  &_upscaledImageMemory.at(i));
+  }
+}
+
+void Vulkan::initDenoiseImages() {
+  // The depth comparisons need 32 bit floats, colors don't
+  const VkFormat formats[kDenoiseImageCount] = {
+      VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT,
+      VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT
+  };
+  // Every frame copies its normals and distances for the next one, the history is cleared when it is outdated
+  const VkImageUsageFlags usages[kDenoiseImageCount] = {
+      VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 0, VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT, 0, 0
+  };
+
+  _denoiseImageMemory.resize(kDenoiseImageCount);
+  _denoiseImages.resize(kDenoiseImageCount);
+  _denoiseImageViews.resize(kDenoiseImageCount);
+  for (uint32_t i = 0; i < kDenoiseImageCount; i++) {
+    *_denoiseImageViews.at(i).put(*_device) = createStorageImage(formats[i], usages[i], _denoiseImages.at(i).put(*_device),
+                                                                 &_denoiseImageMemory.at(i));
+  }
+  _denoiseHistoryOutdated = true;
+}
+
 void Vulkan::initCommandPool() {
   QueueFamilyIndices queueFamilyIndices = findQueueFamilies(_physicalDevice);
 
   VkCommandPoolCreateInfo poolInfo{};
   poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
   poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
 
-  if (vkCreateCommandPool(*_device, &poolInfo, nullptr, _commandPool.get()) != VK_SUCCESS) {
+  if (vkCreateCommandPool(*_device, &poolInfo, nullptr, _commandPool.put(*_device)) != VK_SUCCESS) {
     throw std::runtime_error("failed to create command pool!");
   }
+
+  if (_asyncCompute) {
+    poolInfo.queueFamilyIndex = _computeFamily;
+    if (vkCreateCommandPool(*_device, &poolInfo, nullptr, _computeCommandPool.put(*_device)) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create compute command pool!");
+    }
+  }
+}
+
+// Uploads the scene buffers on the queue that traces, so they stay owned by the only queue family reading them
+VkCommandBuffer Vulkan::beginSingleTimeCommands() {
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = _asyncCompute ? *_computeCommandPool : *_commandPool;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+
+  VkCommandBuffer commandBuffer;
+  if (vkAllocateCommandBuffers(*_device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate command buffers!");
+  }
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin recording command buffer!");
+  }
+
+  return commandBuffer;
+}
+
+void Vulkan::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record command buffer!");
+  }
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+
+  VkQueue queue = _asyncCompute ? _computeQueue : _graphicsQueue;
+  if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+    throw std::runtime_error("failed to submit command buffer!");
+  }
+  vkQueueWaitIdle(queue);
+
+  vkFreeCommandBuffers(*_device, _asyncCompute ? *_computeCommandPool : *_commandPool, 1, &commandBuffer);
+}
+
+void Vulkan::initDescriptorSetLayout() {
+  std::vector<VkDescriptorSetLayoutBinding> bindings(1);
+  bindings[0].binding = 0;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  bindings[0].descriptorCount = 1;
+  bindings[0].stageFlags = getTracingShaderStage();
+
+  if (_settings.backend == Backend::Compute) {
+    VkDescriptorSetLayoutBinding outputBinding{};
+    outputBinding.binding = 1;
+    outputBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    outputBinding.descriptorCount = 1;
+    outputBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings.push_back(outputBinding);
+  }
+
+  for (uint32_t i = 0; i < kSceneBufferCount; i++) {
+    VkDescriptorSetLayoutBinding sceneBinding{};
+    sceneBinding.binding = kSceneBufferBindings[i];
+    sceneBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    sceneBinding.descriptorCount = 1;
+    sceneBinding.stageFlags = getTracingShaderStage();
+    bindings.push_back(sceneBinding);
+  }
+
+  VkDescriptorSetLayoutBinding blueNoiseBinding{};
+  blueNoiseBinding.binding = kBlueNoiseBinding;
+  blueNoiseBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  blueNoiseBinding.descriptorCount = 1;
+  blueNoiseBinding.stageFlags = getTracingShaderStage();
+  bindings.push_back(blueNoiseBinding);
+
+  // Bound even without adaptive sampling, tracer.glsl only skips them at runtime
+  VkDescriptorSetLayoutBinding meanSquaresBinding{};
+  meanSquaresBinding.binding = kMeanSquaresBinding;
+  meanSquaresBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  meanSquaresBinding.descriptorCount = 1;
+  meanSquaresBinding.stageFlags = getTracingShaderStage();
+  bindings.push_back(meanSquaresBinding);
+
+  VkDescriptorSetLayoutBinding convergenceBinding{};
+  convergenceBinding.binding = kConvergenceBinding;
+  convergenceBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  convergenceBinding.descriptorCount = 1;
+  convergenceBinding.stageFlags = getTracingShaderStage();
+  bindings.push_back(convergenceBinding);
+
+  if (_settings.dynamicResolution) {
+    VkDescriptorSetLayoutBinding upscaledBinding{};
+    upscaledBinding.binding = kUpscaledBinding;
+    upscaledBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    upscaledBinding.descriptorCount = 1;
+    upscaledBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings.push_back(upscaledBinding);
+  }
+
+  if (_settings.denoise) {
+    for (uint32_t i = 0; i < kDenoiseImageCount; i++) {
+      VkDescriptorSetLayoutBinding denoiseBinding{};
+      denoiseBinding.binding = kDenoiseBinding + i;
+      denoiseBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+      denoiseBinding.descriptorCount = 1;
+      denoiseBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+      bindings.push_back(denoiseBinding);
+    }
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = bindings.size();
+  layoutInfo.pBindings = bindings.data();
+
+  if (vkCreateDescriptorSetLayout(*_device, &layoutInfo, nullptr, _descriptorSetLayout.put(*_device)) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create descriptor set layout!");
+  }
+}
+
+VkImageView Vulkan::createStorageImage(VkFormat format, VkImageUsageFlags usage, VkImage* image, MemoryAllocation* memory) {
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = format;
+  imageInfo.extent = {_swapChainExtent.width, _swapChainExtent.height, 1};
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | usage;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  if (vkCreateImage(*_device, &imageInfo, nullptr, image) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create storage image!");
+  }
+
+  *memory = _allocator->allocateForImage(*image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = *image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = format;
+  viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  viewInfo.subresourceRange.levelCount = 1;
+  viewInfo.subresourceRange.layerCount = 1;
+
+  VkImageView imageView;
+  if (vkCreateImageView(*_device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create storage image view!");
+  }
+
+  // Storage images stay in the general layout for their whole lifetime, the next frame transitions them
+  _storageImagesUndefined = true;
+
+  return imageView;
+}
+
+void Vulkan::initAccumulationImage() {
+  *_accumulationImageView.put(*_device) = createStorageImage(VK_FORMAT_R32G32B32A32_SFLOAT, 0,
+                                                             _accumulationImage.put(*_device), &_accumulationImageMemory);
+  *_meanSquaresImageView.put(*_device) = createStorageImage(VK_FORMAT_R32_SFLOAT, 0, _meanSquaresImage.put(*_device),
+                                                            &_meanSquaresImageMemory);
+}
+
+void Vulkan::initOutputImage() {
+  uint32_t count = _asyncCompute ? kMaxFramesInFlight : 1;
+  _outputImageMemory.resize(count);
+  _outputImages.resize(count);
+  _outputImageViews.resize(count);
+  for (uint32_t i = 0; i < count; i++) {
+    *_outputImageViews.at(i).put(*_device) = createStorageImage(VK_FORMAT_R16G16B16A16_SFLOAT,
+                                                                VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                                                _outputImages.at(i).put(*_device),
+                                                                &_outputImageMemory.at(i));
+  }
+}
+
+void Vulkan::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                          VkBuffer* buffer, MemoryAllocation* memory) {
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = usage;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  if (vkCreateBuffer(*_device, &bufferInfo, nullptr, buffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create buffer!");
+  }
+
+  *memory = _allocator->allocateForBuffer(*buffer, properties);
+}
+
+void Vulkan::createDeviceLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+                                     VkBuffer* buffer, MemoryAllocation* memory) {
+  MemoryAllocation stagingBufferMemory;
+  VkDeviceChild<VkBuffer, vkDestroyBuffer> stagingBuffer;
+  createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+               stagingBuffer.put(*_device), &stagingBufferMemory);
+  memcpy(stagingBufferMemory.getMapped(), data, size);
+
+  createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+
+  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+  VkBufferCopy copyRegion{};
+  copyRegion.size = size;
+  vkCmdCopyBuffer(commandBuffer, *stagingBuffer, *buffer, 1, &copyRegion);
+  endSingleTimeCommands(commandBuffer);
+}
+
+void Vulkan::initSceneBuffers(const Scene& scene) {
+  TraceScope scope("initSceneBuffers");
+  const auto& spheres = scene.getSpheres();
+  if (spheres.empty()) {
+    throw std::runtime_error("scene has no spheres!");
+  }
+
+  _sphereBvh = std::make_unique<SphereBvh>(spheres, _settings.rebuildThreshold);
+  _sceneUploadBuffers.resize(kMaxFramesInFlight);
+
+  CompactMesh mesh = compactMesh(scene.getMeshPositions(), scene.getMeshTriangles(), getThreadCount(_settings));
+  // Interior nodes of the triangle BVH reference their children by their index in the shared buffer
+  std::vector<BvhNode> nodes = _sphereBvh->getNodes();
+  nodes.resize(_sphereBvh->getNodeCapacity(), BvhNode{});
+  mesh.header.root = nodes.size();
+  for (BvhNode node : mesh.nodes) {
+    if (node.count == 0) {
+      node.leftOrFirst += mesh.header.root;
+    }
+    nodes.push_back(node);
+  }
+
+  std::vector<uint8_t> meshVertices(sizeof(MeshHeader) + mesh.vertices.size() * sizeof(MeshVertex));
+  std::memcpy(meshVertices.data(), &mesh.header, sizeof(MeshHeader));
+  const auto* vertexBytes = reinterpret_cast<const uint8_t*>(mesh.vertices.data());
+  std::copy(vertexBytes, vertexBytes + mesh.vertices.size() * sizeof(MeshVertex),
+            meshVertices.begin() + sizeof(MeshHeader));
+  if (mesh.triangles.empty()) {
+    // Buffers can't be empty, the shader skips this triangle as the header counts none
+    mesh.triangles.resize(1);
+  }
+
+  const auto& materials = scene.getMaterials();
+  std::pair<const void*, VkDeviceSize> contents[kSceneBufferCount] = {
+      {materials.data(), materials.size() * sizeof(Material)},
+      {_sphereBvh->getSpheres().data(), spheres.size() * sizeof(Sphere)},
+      {nodes.data(), nodes.size() * sizeof(BvhNode)},
+      {meshVertices.data(), meshVertices.size()},
+      {mesh.triangles.data(), mesh.triangles.size() * sizeof(MeshTriangle)},
+  };
+
+  _sceneBuffers.resize(kSceneBufferCount);
+  _sceneBufferMemory.resize(kSceneBufferCount);
+  for (size_t i = 0; i < kSceneBufferCount; i++) {
+    createDeviceLocalBuffer(contents[i].first, contents[i].second, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                            _sceneBuffers.at(i).put(*_device), &_sceneBufferMemory.at(i));
+  }
+
+  if (mesh.header.triangleCount > 0) {
+    VkDeviceSize meshSize = contents[3].second + contents[4].second + mesh.nodes.size() * sizeof(BvhNode);
+    std::cout << "mesh: " << mesh.header.triangleCount << " triangles, " << mesh.vertices.size() << " vertices, "
+              << meshSize / double(1 << 20) << " MiB on the device" << std::endl;
+  }
+}
+
+void Vulkan::stageSceneUpload() {
+  std::vector<SphereBvh::Range> sphereRanges = _sphereBvh->takeDirtySpheres();
+  std::vector<SphereBvh::Range> nodeRanges = _sphereBvh->takeDirtyNodes();
+  _sphereCopies.clear();
+  _nodeCopies.clear();
+  // The fence of the frame was waited on, so the frame's last staging buffer is unused
+  _sceneUploadBuffers.at(_currentFrame).reset();
+  if (sphereRanges.empty() && nodeRanges.empty()) {
+    return;
+  }
+
+  TraceScope scope("stage scene upload");
+  VkDeviceSize size = 0;
+  for (const SphereBvh::Range& range : sphereRanges) {
+    size += range.count * sizeof(Sphere);
+  }
+  for (const SphereBvh::Range& range : nodeRanges) {
+    size += range.count * sizeof(BvhNode);
+  }
+  auto& buffer = _sceneUploadBuffers.at(_currentFrame);
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if (vkCreateBuffer(*_device, &bufferInfo, nullptr, buffer.put(*_device)) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create scene upload buffer!");
+  }
+  // Lives in the frame's arena, which is reset once the frame's fence signaled
+  MemoryAllocation memory = _allocator->allocateTransientForBuffer(
+      _currentFrame, *buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  auto* staging = static_cast<uint8_t*>(memory.getMapped());
+  VkDeviceSize offset = 0;
+  auto stage = [&](const std::vector<SphereBvh::Range>& ranges, const auto& elements,
+                   std::vector<VkBufferCopy>& copies) {
+    VkDeviceSize elementSize = sizeof(elements[0]);
+    for (const SphereBvh::Range& range : ranges) {
+      VkDeviceSize rangeSize = range.count * elementSize;
+      std::memcpy(staging + offset, &elements[range.first], rangeSize);
+      copies.push_back({offset, range.first * elementSize, rangeSize});
+      offset += rangeSize;
+    }
+  };
+  stage(sphereRanges, _sphereBvh->getSpheres(), _sphereCopies);
+  stage(nodeRanges, _sphereBvh->getNodes(), _nodeCopies);
+}
+
+void Vulkan::recordSceneUpload(VkCommandBuffer commandBuffer) {
+  if (_sphereCopies.empty() && _nodeCopies.empty()) {
+    return;
+  }
+
+  uint32_t uploadPass = _profiler->beginPass(commandBuffer, "scene upload");
+  // Frames submitted before to this queue may still trace the old spheres and nodes
+  vkCmdPipelineBarrier(commandBuffer, getTracingStage(), VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0,
+                       nullptr);
+
+  // Spheres and nodes are the second and third scene buffer
+  std::pair<VkBuffer, const std::vector<VkBufferCopy>*> uploads[] = {
+      {*_sceneBuffers.at(1), &_sphereCopies},
+      {*_sceneBuffers.at(2), &_nodeCopies},
+  };
+  std::vector<VkBufferMemoryBarrier> barriers;
+  for (const auto& [buffer, copies] : uploads) {
+    if (copies->empty()) {
+      continue;
+    }
+    vkCmdCopyBuffer(commandBuffer, *_sceneUploadBuffers.at(_currentFrame), buffer, copies->size(), copies->data());
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.size = VK_WHOLE_SIZE;
+    barriers.push_back(barrier);
+  }
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, getTracingStage(), 0, 0, nullptr,
+                       barriers.size(), barriers.data(), 0, nullptr);
+  _profiler->endPass(commandBuffer, uploadPass);
+}
+
+void Vulkan::initBlueNoiseBuffer() {
+  TraceScope scope("initBlueNoiseBuffer");
+  std::vector<float> blueNoise = makeBlueNoise();
+  createDeviceLocalBuffer(blueNoise.data(), blueNoise.size() * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                          _blueNoiseBuffer.put(*_device), &_blueNoiseBufferMemory);
+}
+
+void Vulkan::initConvergenceBuffers() {
+  _convergenceBuffers.resize(kMaxFramesInFlight);
+  _convergenceBufferMemory.resize(kMaxFramesInFlight);
+  for (uint32_t i = 0; i < kMaxFramesInFlight; i++) {
+    createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 _convergenceBuffers.at(i).put(*_device), &_convergenceBufferMemory.at(i));
+    *static_cast<uint32_t*>(_convergenceBufferMemory.at(i).getMapped()) = 0;
+  }
+}
+
+void Vulkan::initDescriptorPool() {
+  VkDescriptorPoolSize poolSizes[2]{};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  poolSizes[0].descriptorCount = (4 + kDenoiseImageCount) * kMaxFramesInFlight;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSizes[1].descriptorCount = (kSceneBufferCount + 2) * kMaxFramesInFlight;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes = poolSizes;
+  poolInfo.maxSets = kMaxFramesInFlight;
+
+  if (vkCreateDescriptorPool(*_device, &poolInfo, nullptr, _descriptorPool.put(*_device)) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create descriptor pool!");
+  }
+}
+
+void Vulkan::initDescriptorSets() {
+  TraceScope scope("initDescriptorSets");
+  std::vector<VkDescriptorSetLayout> layouts(kMaxFramesInFlight, *_descriptorSetLayout);
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = *_descriptorPool;
+  allocInfo.descriptorSetCount = layouts.size();
+  allocInfo.pSetLayouts = layouts.data();
+
+  _descriptorSets.resize(kMaxFramesInFlight);
+  if (vkAllocateDescriptorSets(*_device, &allocInfo, _descriptorSets.data()) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate descriptor sets!");
+  }
+  _imageDescriptorsOutdated.assign(kMaxFramesInFlight, false);
+
+  for (uint32_t frame = 0; frame < kMaxFramesInFlight; frame++) {
+    VkDescriptorSet descriptorSet = _descriptorSets.at(frame);
+    updateImageDescriptors(frame);
+
+    std::vector<VkBuffer> buffers = {*_blueNoiseBuffer, *_convergenceBuffers.at(frame)};
+    std::vector<uint32_t> bindings = {kBlueNoiseBinding, kConvergenceBinding};
+    for (uint32_t i = 0; i < kSceneBufferCount; i++) {
+      buffers.push_back(*_sceneBuffers.at(i));
+      bindings.push_back(kSceneBufferBindings[i]);
+    }
+    std::vector<VkDescriptorBufferInfo> bufferInfos(buffers.size());
+    std::vector<VkWriteDescriptorSet> descriptorWrites(buffers.size());
+    for (uint32_t i = 0; i < buffers.size(); i++) {
+      bufferInfos[i].buffer = buffers[i];
+      bufferInfos[i].offset = 0;
+      bufferInfos[i].range = VK_WHOLE_SIZE;
+
+      descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptorWrites[i].dstSet = descriptorSet;
+      descriptorWrites[i].dstBinding = bindings[i];
+      descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      descriptorWrites[i].descriptorCount = 1;
+      descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    vkUpdateDescriptorSets(*_device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+  }
+}
+
+void Vulkan::updateImageDescriptors(uint32_t frame) {
+  std::vector<uint32_t> bindings = {0, kMeanSquaresBinding};
+  std::vector<VkImageView> imageViews = {*_accumulationImageView, *_meanSquaresImageView};
+  if (_settings.backend == Backend::Compute) {
+    bindings.push_back(1);
+    imageViews.push_back(*_outputImageViews.at(getFrameImageIndex(frame)));
+  }
+  if (_settings.dynamicResolution) {
+    bindings.push_back(kUpscaledBinding);
+    imageViews.push_back(*_upscaledImageViews.at(getFrameImageIndex(frame)));
+  }
+  for (uint32_t i = 0; i < _denoiseImageViews.size(); i++) {
+    bindings.push_back(kDenoiseBinding + i);
+    imageViews.push_back(*_denoiseImageViews.at(i));
+  }
+
+  std::vector<VkDescriptorImageInfo> imageInfos(imageViews.size());
+  std::vector<VkWriteDescriptorSet> descriptorWrites(imageViews.size());
+  for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+    imageInfos[i].imageView = imageViews[i];
+    imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[i].dstSet = _descriptorSets.at(frame);
+    descriptorWrites[i].dstBinding = bindings[i];
+    descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptorWrites[i].descriptorCount = 1;
+    descriptorWrites[i].pImageInfo = &imageInfos[i];
+  }
+
+  vkUpdateDescriptorSets(*_device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
 }
 
 void Vulkan::initCommandBuffers() {
-  _commandBuffers.resize(_swapChainFramebuffers.get()->size());
+  _commandBuffers.resize(kMaxFramesInFlight);
 
   VkCommandBufferAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -599,46 +1699,634 @@ void Vulkan::initCommandBuffers() {
     throw std::runtime_error("failed to allocate command buffers!");
   }
 
-  for (size_t i = 0; i < _commandBuffers.size(); i++) {
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  if (_asyncCompute) {
+    _computeCommandBuffers.resize(kMaxFramesInFlight);
+    allocInfo.commandPool = *_computeCommandPool;
+    if (vkAllocateCommandBuffers(*_device, &allocInfo, _computeCommandBuffers.data()) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate compute command buffers!");
+    }
+  }
+}
+
+void Vulkan::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin recording command buffer!");
+  }
+
+  // With async compute the frame was begun, profiled and traced by recordComputeCommandBuffer()
+  uint32_t framePass = 0;
+  if (!_asyncCompute) {
+    _profiler->beginFrame(commandBuffer, _currentFrame);
+    framePass = _profiler->beginPass(commandBuffer, "frame");
+    recordSceneUpload(commandBuffer);
+    recordStorageImageBarriers(commandBuffer);
+  }
 
-    if (vkBeginCommandBuffer(_commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-      throw std::runtime_error("failed to begin recording command buffer!");
+  if (_settings.backend == Backend::Compute) {
+    if (_asyncCompute) {
+      recordOwnershipTransfer(commandBuffer, true, false);
+    } else {
+      recordDispatch(commandBuffer);
     }
+    recordBlit(commandBuffer, imageIndex);
+    if (_asyncCompute) {
+      recordOwnershipTransfer(commandBuffer, false, true);
+      _frameImagesReleased.at(getFrameImageIndex(_currentFrame)) = true;
+    }
+  } else {
+    recordRenderPass(commandBuffer, imageIndex);
+  }
+  if (!_asyncCompute) {
+    recordConvergenceBarrier(commandBuffer);
+  }
+
+  if (isHeadless()) {
+    uint32_t readbackPass = _profiler->beginPass(commandBuffer, "readback");
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {_swapChainExtent.width, _swapChainExtent.height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, _swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           *_readbackBuffers.at(imageIndex), 1, &region);
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = *_readbackBuffers.at(imageIndex);
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                         0, nullptr, 1, &barrier, 0, nullptr);
+    _profiler->endPass(commandBuffer, readbackPass);
+  }
+  if (_captureWriter) {
+    recordCapture(commandBuffer, imageIndex);
+  }
+
+  if (!_asyncCompute) {
+    _profiler->endPass(commandBuffer, framePass);
+  }
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record command buffer!");
+  }
+}
+
+void Vulkan::recordComputeCommandBuffer(VkCommandBuffer commandBuffer) {
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = *_renderPass;
-    renderPassInfo.framebuffer = _swapChainFramebuffers.get()->at(i);
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = _swapChainExtent;
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin recording compute command buffer!");
+  }
 
-    VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
+  // Timestamps are only comparable within a queue, so the frame pass measures the tracing on this one
+  _profiler->beginFrame(commandBuffer, _currentFrame);
+  uint32_t framePass = _profiler->beginPass(commandBuffer, "frame");
+  recordSceneUpload(commandBuffer);
+  recordStorageImageBarriers(commandBuffer);
+  if (_frameImagesReleased.at(getFrameImageIndex(_currentFrame))) {
+    recordOwnershipTransfer(commandBuffer, false, false);
+  }
+  recordDispatch(commandBuffer);
+  recordConvergenceBarrier(commandBuffer);
+  recordOwnershipTransfer(commandBuffer, true, true);
+  _profiler->endPass(commandBuffer, framePass);
 
-    vkCmdBeginRenderPass(_commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record compute command buffer!");
+  }
+}
 
-    vkCmdBindPipeline(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, *_graphicsPipeline);
+void Vulkan::recordConvergenceBarrier(VkCommandBuffer commandBuffer) {
+  if (_settings.adaptiveThreshold <= 0.0f) {
+    return;
+  }
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = *_convergenceBuffers.at(_currentFrame);
+  barrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(commandBuffer, getTracingStage(), VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0,
+                       nullptr);
+}
 
-    vkCmdPushConstants(_commandBuffers[i], *_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(Camera), &_pushConstant);
+void Vulkan::recordStorageImageBarriers(VkCommandBuffer commandBuffer) {
+  if (_storageImagesUndefined) {
+    // Images created since the last frame have no contents to keep. The images of every frame in flight are
+    // transitioned here, so with async compute they all start out owned by the compute queue.
+    std::vector<VkImage> images = {*_accumulationImage, *_meanSquaresImage};
+    for (const auto& image : _outputImages) {
+      images.push_back(*image);
+    }
+    for (const auto& image : _upscaledImages) {
+      images.push_back(*image);
+    }
+    for (const auto& image : _denoiseImages) {
+      images.push_back(*image);
+    }
 
-    vkCmdDraw(_commandBuffers[i], 6, 1, 0, 0);
+    std::vector<VkImageMemoryBarrier> barriers(images.size());
+    for (size_t i = 0; i < images.size(); i++) {
+      barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      barriers[i].srcAccessMask = 0;
+      barriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+      barriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      barriers[i].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+      barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barriers[i].image = images[i];
+      barriers[i].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      barriers[i].subresourceRange.levelCount = 1;
+      barriers[i].subresourceRange.layerCount = 1;
+    }
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, getTracingStage(), 0,
+                         0, nullptr, 0, nullptr, barriers.size(), barriers.data());
+    _storageImagesUndefined = false;
+    _frameImagesReleased.assign(kMaxFramesInFlight, false);
+  } else {
+    // The previous frame may still be reading and writing the accumulation image
+    VkMemoryBarrier accumulationBarrier{};
+    accumulationBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    accumulationBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    accumulationBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, getTracingStage(), getTracingStage(), 0,
+                         1, &accumulationBarrier, 0, nullptr, 0, nullptr);
+  }
+}
 
-    vkCmdEndRenderPass(_commandBuffers[i]);
+void Vulkan::recordOwnershipTransfer(VkCommandBuffer commandBuffer, bool toGraphics, bool release) {
+  // The frame's images change queue family twice per frame: the compute queue releases them after tracing and the
+  // graphics queue acquires them for the blit, then the reverse. Each transfer is a pair of barriers with the same
+  // families and layouts: the release on the source queue only sets the source access, making its writes available,
+  // and the acquire on the destination queue only sets the destination access, making them visible.
+  uint32_t frameImage = getFrameImageIndex(_currentFrame);
+  std::vector<VkImage> images = {*_outputImages.at(frameImage)};
+  if (_settings.dynamicResolution) {
+    images.push_back(*_upscaledImages.at(frameImage));
+  }
 
-    if (vkEndCommandBuffer(_commandBuffers[i]) != VK_SUCCESS) {
-      throw std::runtime_error("failed to record command buffer!");
+  std::vector<VkImageMemoryBarrier> barriers(images.size());
+  for (size_t i = 0; i < images.size(); i++) {
+    barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    if (release) {
+      barriers[i].srcAccessMask = toGraphics ? VK_ACCESS_SHADER_WRITE_BIT : 0;
+    } else {
+      barriers[i].dstAccessMask = toGraphics ? VK_ACCESS_TRANSFER_READ_BIT
+                                             : VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
     }
+    barriers[i].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barriers[i].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barriers[i].srcQueueFamilyIndex = toGraphics ? _computeFamily : _graphicsFamily;
+    barriers[i].dstQueueFamilyIndex = toGraphics ? _graphicsFamily : _computeFamily;
+    barriers[i].image = images[i];
+    barriers[i].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barriers[i].subresourceRange.levelCount = 1;
+    barriers[i].subresourceRange.layerCount = 1;
+  }
+
+  VkPipelineStageFlags sourceStage = toGraphics ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+  VkPipelineStageFlags destinationStage = toGraphics ? VK_PIPELINE_STAGE_TRANSFER_BIT
+                                                     : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  // The semaphore between the submissions orders the halves, the acquire waits at the stage the semaphore does
+  vkCmdPipelineBarrier(commandBuffer, release ? sourceStage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       release ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : destinationStage, 0,
+                       0, nullptr, 0, nullptr, barriers.size(), barriers.data());
+}
+
+void Vulkan::recordRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+  VkRenderPassBeginInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  renderPassInfo.renderPass = *_renderPass;
+  renderPassInfo.framebuffer = *_swapChainFramebuffers.at(imageIndex);
+  renderPassInfo.renderArea.offset = {0, 0};
+  renderPassInfo.renderArea.extent = _swapChainExtent;
+
+  VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
+  renderPassInfo.clearValueCount = 1;
+  renderPassInfo.pClearValues = &clearColor;
+
+  uint32_t tracePass = _profiler->beginPass(commandBuffer, "trace");
+  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _tracePipeline);
+
+  VkViewport viewport{};
+  viewport.width = (float) _swapChainExtent.width;
+  viewport.height = (float) _swapChainExtent.height;
+  viewport.maxDepth = 1.0f;
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+  VkRect2D scissor{};
+  scissor.extent = _swapChainExtent;
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, *_pipelineLayout, 0, 1, &_descriptorSets.at(_currentFrame), 0, nullptr);
+
+  vkCmdPushConstants(commandBuffer, *_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &_pushConstant);
+
+  vkCmdDraw(commandBuffer, 6, 1, 0, 0);
+
+  vkCmdEndRenderPass(commandBuffer);
+  _profiler->endPass(commandBuffer, tracePass);
+}
+
+void Vulkan::recordDispatch(VkCommandBuffer commandBuffer) {
+  VkImageSubresourceRange subresourceRange{};
+  subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  subresourceRange.levelCount = 1;
+  subresourceRange.layerCount = 1;
+
+  // The previous upscale and blit have to finish reading the output image before it is overwritten
+  VkImageMemoryBarrier outputBarrier{};
+  outputBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  outputBarrier.srcAccessMask = 0;
+  outputBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  outputBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+  outputBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  outputBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  outputBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  outputBarrier.image = *_outputImages.at(getFrameImageIndex(_currentFrame));
+  outputBarrier.subresourceRange = subresourceRange;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &outputBarrier);
+
+  uint32_t tracePass = _profiler->beginPass(commandBuffer, "trace");
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _tracePipeline);
+
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, *_pipelineLayout, 0, 1, &_descriptorSets.at(_currentFrame), 0, nullptr);
+
+  vkCmdPushConstants(commandBuffer, *_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &_pushConstant);
+
+  uint32_t groupCountX = (_traceExtent.width + _settings.tileWidth - 1) / _settings.tileWidth;
+  uint32_t groupCountY = (_traceExtent.height + _settings.tileHeight - 1) / _settings.tileHeight;
+  vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+  _profiler->endPass(commandBuffer, tracePass);
+
+  if (_settings.denoise) {
+    recordDenoise(commandBuffer);
+  }
+  if (_traceExtent.width != _swapChainExtent.width || _traceExtent.height != _swapChainExtent.height) {
+    recordUpscale(commandBuffer);
   }
 }
 
+void Vulkan::recordBlit(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+  VkImageSubresourceRange subresourceRange{};
+  subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  subresourceRange.levelCount = 1;
+  subresourceRange.layerCount = 1;
+
+  uint32_t frameImage = getFrameImageIndex(_currentFrame);
+  VkImage blitSource = *_outputImages.at(frameImage);
+  if (_traceExtent.width != _swapChainExtent.width || _traceExtent.height != _swapChainExtent.height) {
+    blitSource = *_upscaledImages.at(frameImage);
+  }
+
+  uint32_t blitPass = _profiler->beginPass(commandBuffer, "blit");
+  VkImageMemoryBarrier barriers[2]{};
+  barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barriers[0].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[0].image = blitSource;
+  barriers[0].subresourceRange = subresourceRange;
+
+  barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barriers[1].srcAccessMask = 0;
+  barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[1].image = _swapChainImages[imageIndex];
+  barriers[1].subresourceRange = subresourceRange;
+
+  // Also waits for the image acquisition, drawFrame() waits on it at the transfer stage. With async compute the
+  // ownership transfer already made the traced image visible.
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+                       _asyncCompute ? 1 : 2, _asyncCompute ? &barriers[1] : barriers);
+
+  VkImageBlit blit{};
+  blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  blit.srcSubresource.layerCount = 1;
+  blit.srcOffsets[1] = {static_cast<int32_t>(_swapChainExtent.width), static_cast<int32_t>(_swapChainExtent.height), 1};
+  blit.dstSubresource = blit.srcSubresource;
+  blit.dstOffsets[1] = blit.srcOffsets[1];
+  vkCmdBlitImage(commandBuffer, blitSource, VK_IMAGE_LAYOUT_GENERAL,
+                 _swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_NEAREST);
+
+  VkImageMemoryBarrier presentBarrier{};
+  presentBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  presentBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  presentBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  presentBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  presentBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  presentBarrier.image = _swapChainImages[imageIndex];
+  presentBarrier.subresourceRange = subresourceRange;
+  if (isHeadless()) {
+    presentBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    presentBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  } else {
+    presentBarrier.dstAccessMask = 0;
+    presentBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  }
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       isHeadless() ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                       0, nullptr, 0, nullptr, 1, &presentBarrier);
+  _profiler->endPass(commandBuffer, blitPass);
+}
+
+void Vulkan::recordUpscale(VkCommandBuffer commandBuffer) {
+  VkImageMemoryBarrier barriers[2]{};
+  for (auto& barrier : barriers) {
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+  }
+  barriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barriers[0].image = *_outputImages.at(getFrameImageIndex(_currentFrame));
+  // The previous blit has to finish reading the upscaled image before it is overwritten
+  barriers[1].srcAccessMask = 0;
+  barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barriers[1].image = *_upscaledImages.at(getFrameImageIndex(_currentFrame));
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+  // Shares the pipeline layout of the tracer, so the bound descriptor set and push constants stay valid
+  uint32_t upscalePass = _profiler->beginPass(commandBuffer, "upscale");
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, *_upscalePipeline);
+  vkCmdDispatch(commandBuffer, (_swapChainExtent.width + 7) / 8, (_swapChainExtent.height + 7) / 8, 1);
+  _profiler->endPass(commandBuffer, upscalePass);
+}
+
+void Vulkan::recordDenoise(VkCommandBuffer commandBuffer) {
+  VkImageSubresourceRange subresourceRange{};
+  subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  subresourceRange.levelCount = 1;
+  subresourceRange.layerCount = 1;
+
+  // Filters the traced region before it is upscaled, so with dynamic resolution fewer pixels are filtered
+  uint32_t denoisePass = _profiler->beginPass(commandBuffer, "denoise");
+  if (_denoiseHistoryOutdated) {
+    // A frame count of zero makes the temporal pass ignore the history
+    recordDenoiseBarrier(commandBuffer);
+    VkClearColorValue clearColor{};
+    vkCmdClearColorImage(commandBuffer, *_denoiseImages.at(kHistoryImage), VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1,
+                         &subresourceRange);
+    _denoiseHistoryOutdated = false;
+  }
+
+  std::vector<VkPipeline> pipelines = {*_gbufferPipeline, *_temporalPipeline};
+  for (const auto& pipeline : _atrousPipelines) {
+    pipelines.push_back(*pipeline);
+  }
+  for (VkPipeline pipeline : pipelines) {
+    recordDenoiseBarrier(commandBuffer);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdDispatch(commandBuffer, (_traceExtent.width + 7) / 8, (_traceExtent.height + 7) / 8, 1);
+  }
+
+  // The next frame's reprojection is validated against this frame's surfaces
+  recordDenoiseBarrier(commandBuffer);
+  VkImageCopy copy{};
+  copy.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  copy.srcSubresource.layerCount = 1;
+  copy.dstSubresource = copy.srcSubresource;
+  copy.extent = {_traceExtent.width, _traceExtent.height, 1};
+  vkCmdCopyImage(commandBuffer, *_denoiseImages.at(kNormalDepthImage), VK_IMAGE_LAYOUT_GENERAL,
+                 *_denoiseImages.at(kPreviousNormalDepthImage), VK_IMAGE_LAYOUT_GENERAL, 1, &copy);
+  _profiler->endPass(commandBuffer, denoisePass);
+}
+
+// Every denoiser pass reads what the one before wrote, and the previous frame's passes may still be reading what the
+// next one overwrites
+void Vulkan::recordDenoiseBarrier(VkCommandBuffer commandBuffer) {
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT |
+                          VK_ACCESS_TRANSFER_WRITE_BIT;
+  VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+  vkCmdPipelineBarrier(commandBuffer, stages, stages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void Vulkan::updateTraceExtent() {
+  VkExtent2D extent = _swapChainExtent;
+  if (_resolutionController) {
+    // Whole tiles, so no workgroup at the edge is partially idle
+    float scale = _resolutionController->getScale();
+    uint32_t width = std::lround(_swapChainExtent.width * scale);
+    uint32_t height = std::lround(_swapChainExtent.height * scale);
+    width = (width + _settings.tileWidth - 1) / _settings.tileWidth * _settings.tileWidth;
+    height = (height + _settings.tileHeight - 1) / _settings.tileHeight * _settings.tileHeight;
+    extent.width = std::min(std::max(width, _settings.tileWidth), _swapChainExtent.width);
+    extent.height = std::min(std::max(height, _settings.tileHeight), _swapChainExtent.height);
+  }
+
+  if (extent.width != _traceExtent.width || extent.height != _traceExtent.height) {
+    _traceExtent = extent;
+    // Accumulated pixels and the denoiser's history belong to the previous resolution
+    _pushConstant.accumulatedFrames = 0;
+    _denoiseHistoryOutdated = true;
+  }
+}
+
+uint32_t Vulkan::getFrameImageIndex(size_t frame) const {
+  return _asyncCompute ? static_cast<uint32_t>(frame) : 0;
+}
+
+VkPipelineStageFlags Vulkan::getTracingStage() const {
+  return _settings.backend == Backend::Compute ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+}
+
+VkShaderStageFlags Vulkan::getTracingShaderStage() const {
+  return _settings.backend == Backend::Compute ? VK_SHADER_STAGE_COMPUTE_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+}
+
+void Vulkan::initReadbackBuffers() {
+  _readbackBuffers.resize(_swapChainImages.size());
+  _readbackBufferMemory.resize(_swapChainImages.size());
+
+  for (size_t i = 0; i < _swapChainImages.size(); i++) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = static_cast<VkDeviceSize>(_swapChainExtent.width) * _swapChainExtent.height * 4;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(*_device, &bufferInfo, nullptr, _readbackBuffers.at(i).put(*_device)) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create readback buffer!");
+    }
+
+    _readbackBufferMemory.at(i) = _allocator->allocateForBuffer(
+        *_readbackBuffers.at(i), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  }
+}
+
+void Vulkan::initCapture() {
+  switch (_swapChainImageFormat) {
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_R8G8B8A8_UNORM:
+      _captureBgra = false;
+      break;
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+      _captureBgra = true;
+      break;
+    default:
+      throw std::runtime_error("capturing requires an 8-bit RGBA or BGRA target!");
+  }
+
+  // Frames in flight hold a slot each until their fence signals, one more lets the writer work meanwhile
+  uint32_t slotCount = std::max(_settings.captureBuffers, static_cast<uint32_t>(kMaxFramesInFlight) + 1);
+  _captureWriter = std::make_unique<CaptureWriter>(_settings.capturePrefix, _settings.captureFormat, slotCount);
+  _captureBufferMemory.resize(slotCount);
+  _captureBuffers.resize(slotCount);
+  _frameCaptureSlots.assign(kMaxFramesInFlight, -1);
+  _frameCaptureExtents.resize(kMaxFramesInFlight);
+}
+
+void Vulkan::acquireCaptureBuffer() {
+  TraceScope scope("acquire capture buffer");
+  uint32_t slot = _captureWriter->acquire();
+  VkDeviceSize size = static_cast<VkDeviceSize>(_swapChainExtent.width) * _swapChainExtent.height * 4;
+  if (*_captureBuffers.at(slot) == VK_NULL_HANDLE || _captureBufferMemory.at(slot).getSize() < size) {
+    // Nothing uses a free slot, the old buffer is destroyed right away
+    _captureBufferMemory.at(slot) = MemoryAllocation();
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 _captureBuffers.at(slot).put(*_device), &_captureBufferMemory.at(slot));
+  }
+  _frameCaptureSlots.at(_currentFrame) = slot;
+  _frameCaptureExtents.at(_currentFrame) = _swapChainExtent;
+}
+
+void Vulkan::recordCapture(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+  uint32_t capturePass = _profiler->beginPass(commandBuffer, "capture");
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = _swapChainImages[imageIndex];
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.layerCount = 1;
+  if (!isHeadless()) {
+    // Headless images already are transfer sources, presentable ones are borrowed for the copy
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+  }
+
+  VkBuffer buffer = *_captureBuffers.at(_frameCaptureSlots.at(_currentFrame));
+  VkBufferImageCopy region{};
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent = {_swapChainExtent.width, _swapChainExtent.height, 1};
+  vkCmdCopyImageToBuffer(commandBuffer, _swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1,
+                         &region);
+
+  VkBufferMemoryBarrier bufferBarrier{};
+  bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.buffer = buffer;
+  bufferBarrier.size = VK_WHOLE_SIZE;
+  uint32_t imageBarrierCount = 0;
+  if (!isHeadless()) {
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    imageBarrierCount = 1;
+  }
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1,
+                       &bufferBarrier, imageBarrierCount, &barrier);
+  _profiler->endPass(commandBuffer, capturePass);
+}
+
+void Vulkan::submitCapture(size_t frame) {
+  int64_t slot = _frameCaptureSlots.at(frame);
+  if (slot < 0) {
+    return;
+  }
+  VkExtent2D extent = _frameCaptureExtents.at(frame);
+  const void* pixels = _captureBufferMemory.at(slot).getMapped();
+  _captureWriter->submit(static_cast<uint32_t>(slot), static_cast<const uint8_t*>(pixels), extent.width, extent.height,
+                         _captureBgra);
+  _frameCaptureSlots.at(frame) = -1;
+}
+
+void Vulkan::initGpuClockCalibration() {
+  VkDeviceChild<VkQueryPool, vkDestroyQueryPool> queryPool;
+  VkQueryPoolCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  createInfo.queryCount = 1;
+  if (vkCreateQueryPool(*_device, &createInfo, nullptr, queryPool.put(*_device)) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create timestamp query pool!");
+  }
+
+  // The timestamp is taken somewhere between the submission and the end of the wait, the middle is the best guess
+  EventTracer& tracer = EventTracer::get();
+  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+  vkCmdResetQueryPool(commandBuffer, *queryPool, 0, 1);
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, *queryPool, 0);
+  int64_t submitted = tracer.now();
+  endSingleTimeCommands(commandBuffer);
+  int64_t finished = tracer.now();
+
+  uint64_t timestamp;
+  if (vkGetQueryPoolResults(*_device, *queryPool, 0, 1, sizeof(timestamp), &timestamp, sizeof(timestamp),
+                            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+    throw std::runtime_error("failed to read timestamp!");
+  }
+  int64_t offset = submitted + (finished - submitted) / 2 - _profiler->toNanoseconds(timestamp);
+  std::cout << "GPU trace events are aligned to the CPU within " << (finished - submitted) / 2000 << " us"
+            << std::endl;
+
+  _profiler->setPassCallback([offset](const char* name, int64_t begin, int64_t end) {
+    EventTracer::get().recordGpu(name, begin + offset, end + offset);
+  });
+}
+
 void Vulkan::initSyncObjects() {
-  _imageAvailableSemaphores.get()->resize(kMaxFramesInFlight);
-  _renderFinishedSemaphores.get()->resize(kMaxFramesInFlight);
-  _inFlightFences.get()->resize(kMaxFramesInFlight);
+  _imageAvailableSemaphores.resize(kMaxFramesInFlight);
+  _renderFinishedSemaphores.resize(kMaxFramesInFlight);
+  _traceFinishedSemaphores.resize(_asyncCompute ? kMaxFramesInFlight : 0);
+  _imagesReleasedSemaphores.resize(_asyncCompute ? kMaxFramesInFlight : 0);
+  _imagesReleasedPending.resize(kMaxFramesInFlight, false);
+  _frameImagesReleased.resize(kMaxFramesInFlight, false);
+  _inFlightFences.resize(kMaxFramesInFlight);
   _imagesInFlight.resize(_swapChainImages.size(), VK_NULL_HANDLE);
+  _frameInputTimes.resize(kMaxFramesInFlight);
+  _frameScales.resize(kMaxFramesInFlight, 1.0f);
 
   VkSemaphoreCreateInfo semaphoreInfo{};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -648,52 +2336,190 @@ void Vulkan::initSyncObjects() {
   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
   for (size_t i = 0; i < kMaxFramesInFlight; i++) {
-    if (vkCreateSemaphore(*_device, &semaphoreInfo, nullptr, &_imageAvailableSemaphores.get()->at(i)) != VK_SUCCESS ||
-        vkCreateSemaphore(*_device, &semaphoreInfo, nullptr, &_renderFinishedSemaphores.get()->at(i)) != VK_SUCCESS ||
-        vkCreateFence(*_device, &fenceInfo, nullptr, &_inFlightFences.get()->at(i)) != VK_SUCCESS) {
+    if (vkCreateSemaphore(*_device, &semaphoreInfo, nullptr, _imageAvailableSemaphores.at(i).put(*_device)) != VK_SUCCESS ||
+        vkCreateSemaphore(*_device, &semaphoreInfo, nullptr, _renderFinishedSemaphores.at(i).put(*_device)) != VK_SUCCESS ||
+        vkCreateFence(*_device, &fenceInfo, nullptr, _inFlightFences.at(i).put(*_device)) != VK_SUCCESS) {
       throw std::runtime_error("failed to create synchronization objects for a frame!");
     }
+    if (_asyncCompute &&
+        (vkCreateSemaphore(*_device, &semaphoreInfo, nullptr, _traceFinishedSemaphores.at(i).put(*_device)) != VK_SUCCESS ||
+         vkCreateSemaphore(*_device, &semaphoreInfo, nullptr, _imagesReleasedSemaphores.at(i).put(*_device)) != VK_SUCCESS)) {
+      throw std::runtime_error("failed to create synchronization objects for a frame!");
+    }
+  }
+}
+
+void Vulkan::collectLatency() {
+  // Frames are only seen finished when the CPU gets here, so this is an upper bound at frame granularity.
+  // The GPU finishing a frame stands in for its presentation, which core Vulkan cannot observe.
+  auto now = FrameScheduler::Clock::now();
+  for (int frame = 0; frame < kMaxFramesInFlight; ++frame) {
+    auto& inputTime = _frameInputTimes.at(frame);
+    if (inputTime != FrameScheduler::Clock::time_point{} &&
+        vkGetFenceStatus(*_device, *_inFlightFences.at(frame)) == VK_SUCCESS) {
+      _latency.add(now - inputTime);
+      inputTime = {};
+    }
   }
 }
 
-void Vulkan::drawFrame() {
-  vkWaitForFences(*_device, 1, &_inFlightFences.get()->at(_currentFrame), VK_TRUE, UINT64_MAX);
+void Vulkan::drawFrame(FrameScheduler::Clock::time_point inputTime) {
+  TraceScope frameScope("drawFrame");
+  if (_swapChainOutdated) {
+    recreateSwapChain();
+    if (_swapChainOutdated) {
+      return;
+    }
+  }
+
+  {
+    TraceScope scope("wait for frame in flight");
+    vkWaitForFences(*_device, 1, _inFlightFences.at(_currentFrame).address(), VK_TRUE, UINT64_MAX);
+  }
+  if (_profiler->collect(_currentFrame) && _resolutionController) {
+    _resolutionController->update(_profiler->getLatestMs("frame"), _frameScales.at(_currentFrame));
+  }
+  _deletionQueue.collect(_currentFrame);
+  _allocator->resetFrame(_currentFrame);
+  if (_captureWriter) {
+    submitCapture(_currentFrame);
+  }
 
   uint32_t imageIndex;
-  vkAcquireNextImageKHR(*_device, *_swapChain, UINT64_MAX, _imageAvailableSemaphores.get()->at(_currentFrame), VK_NULL_HANDLE, &imageIndex);
+  if (isHeadless()) {
+    imageIndex = _currentFrame;
+  } else {
+    TraceScope scope("acquire image");
+    VkResult result = vkAcquireNextImageKHR(*_device, *_swapChain, UINT64_MAX, *_imageAvailableSemaphores.at(_currentFrame),
+                                            VK_NULL_HANDLE, &imageIndex);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+      recreateSwapChain();
+      return;
+    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+      throw std::runtime_error("failed to acquire swap chain image!");
+    }
+  }
+  collectLatency();
+  // The fence above guarantees the frame's counter is written, it is zeroed for the frame being recorded
+  uint32_t* convergedPixels = static_cast<uint32_t*>(_convergenceBufferMemory.at(_currentFrame).getMapped());
+  _convergedPixels = *convergedPixels;
+  *convergedPixels = 0;
+
+  if (_imageDescriptorsOutdated.at(_currentFrame)) {
+    // The fence above guarantees no submitted frame still uses this set
+    updateImageDescriptors(_currentFrame);
+    _imageDescriptorsOutdated.at(_currentFrame) = false;
+  }
+  // After the image was acquired, so the changes are not lost when the frame is skipped
+  stageSceneUpload();
 
   if (_imagesInFlight.at(imageIndex) != VK_NULL_HANDLE) {
+    TraceScope scope("wait for image in flight");
     vkWaitForFences(*_device, 1, &_imagesInFlight.at(imageIndex), VK_TRUE, UINT64_MAX);
   }
-  _imagesInFlight.at(imageIndex) = _inFlightFences.get()->at(_currentFrame);
+  _imagesInFlight.at(imageIndex) = *_inFlightFences.at(_currentFrame);
+
+  // The fence above guarantees this frame's command buffer is no longer executing
+  VkCommandBuffer commandBuffer = _commandBuffers.at(_currentFrame);
+  vkResetCommandBuffer(commandBuffer, 0);
+  updateTraceExtent();
+  if (_shaderWatcher) {
+    swapReloadedPipelines();
+  }
+  bool moving = _settings.accumulate && _pushConstant.accumulatedFrames == 0;
+  Quality quality = moving ? _settings.movingQuality : _settings.quality;
+  _tracePipeline = _tracePipelines->get(quality);
+  bool fallback = _tracePipeline == VK_NULL_HANDLE;
+  if (fallback) {
+    // Traces with whatever variant is ready while the wanted one compiles, without accumulating what it traced
+    _tracePipelines->request(quality);
+    _tracePipeline = _tracePipelines->getAny();
+    _pushConstant.accumulatedFrames = 0;
+    moving = _settings.accumulate;
+  }
+  _pushConstant.samples = moving ? _settings.movingSamples : _settings.samples;
+  _pushConstant.width = _traceExtent.width;
+  _pushConstant.height = _traceExtent.height;
+  if (_settings.offlineTileSize > 0) {
+    // Tiles are traced as parts of the whole image
+    _pushConstant.width = _settings.width;
+    _pushConstant.height = _settings.height;
+  }
+  if (_resolutionController) {
+    _frameScales.at(_currentFrame) = _resolutionController->getScale();
+  }
+  if (_captureWriter) {
+    acquireCaptureBuffer();
+  }
+  if (_asyncCompute) {
+    // Submitted ahead of the graphics work, so it overlaps whatever the graphics queue still has from the last frame
+    TraceScope scope("record and submit compute");
+    submitCompute();
+  }
+  {
+    TraceScope scope("record");
+    recordCommandBuffer(commandBuffer, imageIndex);
+  }
+  _pushConstant.previousCamera = _pushConstant.camera;
+  ++_pushConstant.frame;
+  if (_settings.accumulate && !fallback) {
+    ++_pushConstant.accumulatedFrames;
+  }
 
   VkSubmitInfo submitInfo{};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-  VkSemaphore waitSemaphores[] = {_imageAvailableSemaphores.get()->at(_currentFrame)};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = waitSemaphores;
-  submitInfo.pWaitDstStageMask = waitStages;
+  std::vector<VkSemaphore> waitSemaphores;
+  std::vector<VkPipelineStageFlags> waitStages;
+  if (!isHeadless()) {
+    waitSemaphores.push_back(*_imageAvailableSemaphores.at(_currentFrame));
+    waitStages.push_back(_settings.backend == Backend::Compute ? VK_PIPELINE_STAGE_TRANSFER_BIT
+                                                               : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+  }
+  if (_asyncCompute) {
+    waitSemaphores.push_back(*_traceFinishedSemaphores.at(_currentFrame));
+    waitStages.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT);
+  }
+  submitInfo.waitSemaphoreCount = waitSemaphores.size();
+  submitInfo.pWaitSemaphores = waitSemaphores.data();
+  submitInfo.pWaitDstStageMask = waitStages.data();
 
   submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &_commandBuffers.at(imageIndex);
+  submitInfo.pCommandBuffers = &commandBuffer;
 
-  VkSemaphore signalSemaphores[] = {_renderFinishedSemaphores.get()->at(_currentFrame)};
-  submitInfo.signalSemaphoreCount = 1;
-  submitInfo.pSignalSemaphores = signalSemaphores;
+  std::vector<VkSemaphore> signalSemaphores;
+  if (!isHeadless()) {
+    signalSemaphores.push_back(*_renderFinishedSemaphores.at(_currentFrame));
+  }
+  if (_asyncCompute) {
+    signalSemaphores.push_back(*_imagesReleasedSemaphores.at(_currentFrame));
+    _imagesReleasedPending.at(_currentFrame) = true;
+  }
+  submitInfo.signalSemaphoreCount = signalSemaphores.size();
+  submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+  vkResetFences(*_device, 1, _inFlightFences.at(_currentFrame).address());
+  _frameInputTimes.at(_currentFrame) = inputTime;
 
-  vkResetFences(*_device, 1, &_inFlightFences.get()->at(_currentFrame));
+  {
+    TraceScope scope("submit");
+    if (vkQueueSubmit(_graphicsQueue, 1, &submitInfo, *_inFlightFences.at(_currentFrame)) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit draw command buffer!");
+    }
+  }
+  _deletionQueue.submitted(_currentFrame);
 
-  if (vkQueueSubmit(_graphicsQueue, 1, &submitInfo, _inFlightFences.get()->at(_currentFrame)) != VK_SUCCESS) {
-    throw std::runtime_error("failed to submit draw command buffer!");
+  _lastImageIndex = imageIndex;
+  if (isHeadless()) {
+    _currentFrame = (_currentFrame + 1) % kMaxFramesInFlight;
+    return;
   }
 
   VkPresentInfoKHR presentInfo{};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
   presentInfo.waitSemaphoreCount = 1;
-  presentInfo.pWaitSemaphores = signalSemaphores;
+  presentInfo.pWaitSemaphores = _renderFinishedSemaphores.at(_currentFrame).address();
 
   VkSwapchainKHR swapChains[] = {*_swapChain};
   presentInfo.swapchainCount = 1;
@@ -701,17 +2527,201 @@ void Vulkan::drawFrame() {
 
   presentInfo.pImageIndices = &imageIndex;
 
-  vkQueuePresentKHR(_presentQueue, &presentInfo);
+  VkResult result;
+  {
+    TraceScope scope("present");
+    result = vkQueuePresentKHR(_presentQueue, &presentInfo);
+  }
 
   _currentFrame = (_currentFrame + 1) % kMaxFramesInFlight;
+
+  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || _framebufferResized) {
+    _framebufferResized = false;
+    recreateSwapChain();
+  } else if (result != VK_SUCCESS) {
+    throw std::runtime_error("failed to present swap chain image!");
+  }
 }
 
-VkDevice* Vulkan::getDevice() {
-  return _device.get();
+void Vulkan::submitCompute() {
+  VkCommandBuffer commandBuffer = _computeCommandBuffers.at(_currentFrame);
+  vkResetCommandBuffer(commandBuffer, 0);
+  recordComputeCommandBuffer(commandBuffer);
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+  // The graphics queue hands the frame's images back at the end of the frame that last used this slot
+  VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  if (_imagesReleasedPending.at(_currentFrame)) {
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = _imagesReleasedSemaphores.at(_currentFrame).address();
+    submitInfo.pWaitDstStageMask = &waitStage;
+    _imagesReleasedPending.at(_currentFrame) = false;
+  }
+
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = _traceFinishedSemaphores.at(_currentFrame).address();
+
+  if (vkQueueSubmit(_computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+    throw std::runtime_error("failed to submit compute command buffer!");
+  }
+}
+
+void Vulkan::recreateSwapChain() {
+  TraceScope scope("recreateSwapChain");
+  int width = 0;
+  int height = 0;
+  glfwGetFramebufferSize(_window, &width, &height);
+  _swapChainOutdated = width == 0 || height == 0;
+  if (_swapChainOutdated) {
+    return;
+  }
+
+  // Frames in flight keep rendering to and presenting from the old swap chain, so everything sized by it is retired
+  // instead of destroyed and the device never has to go idle
+  _deletionQueue.retire(_swapChainFramebuffers);
+  _deletionQueue.retire(_swapChainImageViews);
+  _deletionQueue.retire(_accumulationImageView);
+  _deletionQueue.retire(_accumulationImage);
+  _deletionQueue.retire(_accumulationImageMemory);
+  _deletionQueue.retire(_meanSquaresImageView);
+  _deletionQueue.retire(_meanSquaresImage);
+  _deletionQueue.retire(_meanSquaresImageMemory);
+  _deletionQueue.retire(_outputImageViews);
+  _deletionQueue.retire(_outputImages);
+  _deletionQueue.retire(_outputImageMemory);
+  _deletionQueue.retire(_upscaledImageViews);
+  _deletionQueue.retire(_upscaledImages);
+  _deletionQueue.retire(_upscaledImageMemory);
+  _deletionQueue.retire(_denoiseImageViews);
+  _deletionQueue.retire(_denoiseImages);
+  _deletionQueue.retire(_denoiseImageMemory);
+
+  // Handing the old swap chain over lets the presentation engine reuse its resources
+  VkSwapchainKHR oldSwapChain = *_swapChain;
+  _deletionQueue.retire(_swapChain);
+  initSwapChain(oldSwapChain);
+
+  initImageViews();
+  if (_settings.backend == Backend::Compute) {
+    initOutputImage();
+  } else {
+    initFramebuffers();
+  }
+  if (_settings.denoise) {
+    initDenoiseImages();
+  }
+  if (_settings.dynamicResolution) {
+    initUpscaledImage();
+  }
+  initAccumulationImage();
+
+  _imageDescriptorsOutdated.assign(kMaxFramesInFlight, true);
+  _imagesInFlight.assign(_swapChainImages.size(), VK_NULL_HANDLE);
+  // The accumulated frames were traced at the old resolution
+  _pushConstant.accumulatedFrames = 0;
+}
+
+void Vulkan::notifyFramebufferResized() {
+  _framebufferResized = true;
+}
+
+void Vulkan::saveFrame(const std::string& filename) {
+  writePpm(filename, _swapChainExtent.width, _swapChainExtent.height, readFrame());
 }
+
+const uint8_t* Vulkan::readFrame() {
+  if (!isHeadless()) {
+    throw std::runtime_error("reading frames is only supported in headless mode!");
+  }
+
+  vkWaitForFences(*_device, 1, &_imagesInFlight.at(_lastImageIndex), VK_TRUE, UINT64_MAX);
+
+  return static_cast<const uint8_t*>(_readbackBufferMemory.at(_lastImageIndex).getMapped());
+}
+
+VkDevice Vulkan::getDevice() const {
+  return *_device;
+}
+
+const MemoryAllocator& Vulkan::getAllocator() const {
+  return *_allocator;
+}
+
+const GpuProfiler& Vulkan::getProfiler() const {
+  return *_profiler;
+}
+
+const LatencyStatistics& Vulkan::getLatency() const {
+  return _latency;
+}
+
+void Vulkan::flushProfiler() {
+  vkDeviceWaitIdle(*_device);
+  for (int frame = 0; frame < kMaxFramesInFlight; ++frame) {
+    _profiler->collect(frame);
+  }
+  if (_captureWriter) {
+    for (size_t i = 0; i < kMaxFramesInFlight; ++i) {
+      submitCapture((_currentFrame + i) % kMaxFramesInFlight);
+    }
+    _captureWriter->flush();
+  }
+  // Left for drawFrame() to reset, so it reads the same count again
+  uint32_t lastFrame = (_currentFrame + kMaxFramesInFlight - 1) % kMaxFramesInFlight;
+  _convergedPixels = *static_cast<const uint32_t*>(_convergenceBufferMemory.at(lastFrame).getMapped());
+}
+
+uint32_t Vulkan::getConvergedPixels() const {
+  return _convergedPixels;
+}
+
+const CaptureWriter* Vulkan::getCaptureWriter() const {
+  return _captureWriter.get();
+}
+
+bool Vulkan::isHeadless() const {
+  return _window == nullptr;
+}
+
+VkExtent2D Vulkan::getTraceExtent() const {
+  return _traceExtent;
+}
+
+const SphereBvh& Vulkan::getSphereBvh() const {
+  return *_sphereBvh;
+}
+
 void Vulkan::pushConstants(const Camera& camera) {
-  _pushConstant = camera;
-  initCommandBuffers();
+  _pushConstant.camera = camera;
+}
+
+void Vulkan::resetAccumulation() {
+  _pushConstant.accumulatedFrames = 0;
+}
+
+void Vulkan::setQuality(Quality quality) {
+  _settings.quality = quality;
+  _tracePipelines->request(quality);
+  // Frames accumulated so far were traced with fewer or more bounces
+  _pushConstant.accumulatedFrames = 0;
+}
+
+void Vulkan::setTile(uint32_t x, uint32_t y) {
+  _pushConstant.tileX = x;
+  _pushConstant.tileY = y;
+  _pushConstant.accumulatedFrames = 0;
+}
+
+void Vulkan::moveSpheres(const std::vector<Sphere>& spheres, const std::vector<uint32_t>& moved) {
+  if (moved.empty()) {
+    return;
+  }
+  _sphereBvh->update(spheres, moved);
+  _pushConstant.accumulatedFrames = 0;
 }
 
 bool Vulkan::QueueFamilyIndices::isComplete() {
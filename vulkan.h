@@ -4,27 +4,86 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <fstream>
 #include <vector>
 #include <set>
 
+#include "camera.h"
+#include "capture_writer.h"
+#include "deletion_queue.h"
+#include "frame_scheduler.h"
+#include "gpu_profiler.h"
+#include "memory_allocator.h"
+#include "pipeline_variants.h"
+#include "resolution_controller.h"
+#include "scene.h"
+#include "settings.h"
+#include "shader_watcher.h"
+#include "shaders.h"
+#include "sphere_bvh.h"
 #include "vk_wrapper.h"
 
-struct Camera {
-  glm::vec3 origin;
-  float yaw;
-  float pitch;
+// Mirrors the push constant block of tracer.glsl
+struct PushConstants {
+  Camera camera;
+  uint32_t accumulatedFrames;
+  uint32_t samples;
+  uint32_t width;
+  uint32_t height;
+  uint32_t padding[3];  // previousCamera.origin is a vec3 and aligned to 16 bytes
+  Camera previousCamera;  // Set by drawFrame(), the denoiser reprojects its history with it
+  uint32_t frame;  // Counts every frame drawn, seeds the samplers
+  uint32_t sampling;  // Settings::sampler
+  float adaptiveThreshold;
+  uint32_t adaptiveMinSamples;
+  uint32_t tileX;  // Offset of the traced offline tile, set by setTile()
+  uint32_t tileY;
 };
 
 class Vulkan {
  public:
-  Vulkan(GLFWwindow* window);
+  // Passing a null window renders headless into offscreen images of settings.width x settings.height, or of one
+  // settings.offlineTileSize tile of them.
+  Vulkan(GLFWwindow* window, const Settings& settings, const Scene& scene);
+  ~Vulkan();
 
-  void drawFrame();
-  VkDevice* getDevice();
+  // inputTime is when the input shown by this frame was sampled, a default value measures no latency
+  void drawFrame(FrameScheduler::Clock::time_point inputTime = {});
+  void saveFrame(const std::string& filename);
+  // Waits for the last frame drawn headless and returns its tightly packed 8-bit RGBA pixels, one row per width of the
+  // offscreen image, valid until the next frame is drawn
+  const uint8_t* readFrame();
+  VkDevice getDevice() const;
+  const MemoryAllocator& getAllocator() const;
+  const GpuProfiler& getProfiler() const;
+  const LatencyStatistics& getLatency() const;
+  // Waits for the frames in flight, collects their timings and writes what they captured
+  void flushProfiler();
+  // Accumulated pixels the last finished frame skipped because they converged, up to date after flushProfiler()
+  uint32_t getConvergedPixels() const;
+  bool isHeadless() const;
+  // Null unless settings.capturePrefix is set
+  const CaptureWriter* getCaptureWriter() const;
+  // Resolution that is traced, smaller than the target while dynamic resolution scales it down
+  VkExtent2D getTraceExtent() const;
+  const SphereBvh& getSphereBvh() const;
+
+  // Call when the window's framebuffer changed size, the swap chain is recreated before the next frame
+  void notifyFramebufferResized();
 
   void pushConstants(const Camera& camera);
+  // Drops everything accumulated so far, the next frame is traced with settings.movingSamples
+  void resetAccumulation();
+  // Switches the preset of still frames, the last one keeps tracing until the new variant compiled
+  void setQuality(Quality quality);
+  // Traces the offline tile at this offset of the image from the next frame on, dropping what was accumulated
+  void setTile(uint32_t x, uint32_t y);
+  // Refits the sphere BVH to the spheres listed in moved, spheres are all of them in scene order. Only what changed is
+  // uploaded at the start of the next frame, which drops what was accumulated.
+  void moveSpheres(const std::vector<Sphere>& spheres, const std::vector<uint32_t>& moved);
 
  private:
   struct SwapChainSupportDetails {
@@ -36,16 +95,17 @@ class Vulkan {
   struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    std::optional<uint32_t> computeFamily;  // Separate from the graphics family, preferably without graphics support
 
     bool isComplete();
   };
 
-  const int kMaxFramesInFlight = 2;
+  static constexpr int kMaxFramesInFlight = 2;
 
-  const std::vector<const char*> kDeviceExtensions = {
-      VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-      "VK_KHR_portability_subset"
+  const std::vector<const char*> kSwapChainExtensions = {
+      VK_KHR_SWAPCHAIN_EXTENSION_NAME
   };
+  const char* kPortabilitySubsetExtension = "VK_KHR_portability_subset";
 
   const std::vector<const char*> kValidationLayers = {
       "VK_LAYER_KHRONOS_validation"
@@ -64,46 +124,231 @@ class Vulkan {
   QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
   int rateDeviceSuitability(VkPhysicalDevice device);
   void initLogicalDevice();
+  void initAllocator();
+  void initProfiler();
   void initSurface();
+  std::vector<VkExtensionProperties> getAvailableDeviceExtensions(VkPhysicalDevice device);
+  std::vector<const char*> getRequiredDeviceExtensions(VkPhysicalDevice device);
   bool checkDeviceExtensionSupport(VkPhysicalDevice device);
   SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
   static VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
-  static VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
+  VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
   VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
-  void initSwapChain();
+  void initSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
+  void recreateSwapChain();
+  void initOffscreenImages();
   void initImageViews();
-  void initGraphicsPipeline();
-  static std::vector<char> readFile(const std::string& filename);
-  VkShaderModule createShaderModule(const std::vector<char>& code);
+  void initPipelineLayout();
+  void initTracePipelines();
+  // Creates the variants from the vertex and fragment or the compute shader, with the code kept alive by the caller
+  PipelineVariants::Factory makeTraceFactory(std::vector<ShaderCode> code);
+  VkPipeline createGraphicsPipeline(const ShaderCode& vertCode, const ShaderCode& fragCode,
+                                    const TracerConstants& constants);
+  VkPipeline createComputeTracePipeline(const ShaderCode& code, const TracerConstants& constants);
+  void initShaderWatcher();
+  // At the frame boundary, before anything is recorded with the old variants
+  void swapReloadedPipelines();
+  // Fills two entries for the constants placed at offset in the specialization data
+  static VkSpecializationInfo getTracerSpecializationInfo(const TracerConstants* constants, uint32_t offset,
+                                                          VkSpecializationMapEntry* entries);
+  void initUpscalePipeline();
+  void initDenoisePipelines();
+  void createComputePipeline(const ShaderCode& code, const VkSpecializationInfo* specializationInfo, VkPipeline* pipeline);
+  VkShaderModule createShaderModule(const ShaderCode& code);
+  std::string getPipelineCachePath();
+  bool isPipelineCacheCompatible(const std::vector<char>& data);
+  void initPipelineCache();
+  void savePipelineCache();
   void initRenderPass();
   void initFramebuffers();
   void initCommandPool();
+  VkCommandBuffer beginSingleTimeCommands();
+  void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+  void initDescriptorSetLayout();
+  VkImageView createStorageImage(VkFormat format, VkImageUsageFlags usage, VkImage* image, MemoryAllocation* memory);
+  void initAccumulationImage();
+  void initOutputImage();
+  void initUpscaledImage();
+  void initDenoiseImages();
+  void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* buffer, MemoryAllocation* memory);
+  void createDeviceLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer* buffer, MemoryAllocation* memory);
+  void initSceneBuffers(const Scene& scene);
+  // Copies the spheres and nodes the BVH changed into the frame's staging buffer, once its fence signaled
+  void stageSceneUpload();
+  void recordSceneUpload(VkCommandBuffer commandBuffer);
+  void initBlueNoiseBuffer();
+  void initConvergenceBuffers();
+  void initDescriptorPool();
+  void initDescriptorSets();
+  void updateImageDescriptors(uint32_t frame);
   void initCommandBuffers();
+  void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  void recordComputeCommandBuffer(VkCommandBuffer commandBuffer);
+  void recordStorageImageBarriers(VkCommandBuffer commandBuffer);
+  void recordOwnershipTransfer(VkCommandBuffer commandBuffer, bool toGraphics, bool release);
+  void recordRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  void recordDispatch(VkCommandBuffer commandBuffer);
+  void recordUpscale(VkCommandBuffer commandBuffer);
+  void recordDenoise(VkCommandBuffer commandBuffer);
+  void recordDenoiseBarrier(VkCommandBuffer commandBuffer);
+  // Makes the frame's converged pixel count visible to the host once the fence signaled
+  void recordConvergenceBarrier(VkCommandBuffer commandBuffer);
+  void recordBlit(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  void submitCompute();
+  uint32_t getFrameImageIndex(size_t frame) const;
+  void updateTraceExtent();
+  VkPipelineStageFlags getTracingStage() const;
+  VkShaderStageFlags getTracingShaderStage() const;
+  void initReadbackBuffers();
+  void initCapture();
+  // Takes a staging buffer for the frame being recorded, large enough for the target
+  void acquireCaptureBuffer();
+  void recordCapture(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  // Hands what the frame in flight captured to the writer, once its fence signaled
+  void submitCapture(size_t frame);
+  // Maps the profiler's GPU timestamps onto the event tracer's clock, so both timelines show up in one trace
+  void initGpuClockCalibration();
   void initSyncObjects();
+  void collectLatency();
 
   GLFWwindow* _window;
+  Settings _settings;
 
-  VkWrapper<VkInstance> _instance{vkDestroyInstance};
+  VkHandle<VkInstance, vkDestroyInstance> _instance;
   VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
-  VkWrapper<VkDevice> _device{vkDestroyDevice};
+  VkHandle<VkDevice, vkDestroyDevice> _device;
+  std::unique_ptr<MemoryAllocator> _allocator;
+  // Objects replaced at runtime that frames in flight may still use, declared after the device and allocator so they
+  // outlive it
+  DeletionQueue _deletionQueue{kMaxFramesInFlight};
   VkQueue _graphicsQueue;
   VkQueue _presentQueue;
-  VkWrapperWithParent<VkSurfaceKHR, VkInstance> _surface{_instance.get(), vkDestroySurfaceKHR};
-  VkWrapperWithParent<VkSwapchainKHR, VkDevice> _swapChain{_device.get(), vkDestroySwapchainKHR};
+  // With async compute the tracing runs here, otherwise everything is submitted to the graphics queue
+  bool _asyncCompute = false;
+  VkQueue _computeQueue = VK_NULL_HANDLE;
+  uint32_t _graphicsFamily = 0;
+  uint32_t _computeFamily = 0;
+  VkChildHandle<VkSurfaceKHR, VkInstance, vkDestroySurfaceKHR> _surface;
+  VkDeviceChild<VkSwapchainKHR, vkDestroySwapchainKHR> _swapChain;
+  // In headless mode these are the offscreen images below instead of swap chain images.
   std::vector<VkImage> _swapChainImages;
   VkFormat _swapChainImageFormat;
   VkExtent2D _swapChainExtent;
-  VkWrapperVectorWithParent<VkImageView, VkDevice> _swapChainImageViews{_device.get(), vkDestroyImageView};
-  VkWrapperWithParent<VkRenderPass, VkDevice> _renderPass{_device.get(), vkDestroyRenderPass};
-  VkWrapperWithParent<VkPipelineLayout, VkDevice> _pipelineLayout{_device.get(), vkDestroyPipelineLayout};
-  VkWrapperWithParent<VkPipeline, VkDevice> _graphicsPipeline{_device.get(), vkDestroyPipeline};
-  VkWrapperVectorWithParent<VkFramebuffer, VkDevice> _swapChainFramebuffers{_device.get(), vkDestroyFramebuffer};
-  VkWrapperWithParent<VkCommandPool, VkDevice> _commandPool{_device.get(), vkDestroyCommandPool};
-  std::vector<VkCommandBuffer> _commandBuffers;
-  VkWrapperVectorWithParent<VkSemaphore, VkDevice> _imageAvailableSemaphores{_device.get(), vkDestroySemaphore};
-  VkWrapperVectorWithParent<VkSemaphore, VkDevice> _renderFinishedSemaphores{_device.get(), vkDestroySemaphore};
-  VkWrapperVectorWithParent<VkFence, VkDevice> _inFlightFences{_device.get(), vkDestroyFence};
+  std::vector<MemoryAllocation> _offscreenImageMemory;
+  std::vector<VkDeviceChild<VkImage, vkDestroyImage>> _offscreenImages;
+  std::vector<VkDeviceChild<VkImageView, vkDestroyImageView>> _swapChainImageViews;
+  VkDeviceChild<VkRenderPass, vkDestroyRenderPass> _renderPass;
+  VkDeviceChild<VkDescriptorSetLayout, vkDestroyDescriptorSetLayout> _descriptorSetLayout;
+  VkDeviceChild<VkPipelineLayout, vkDestroyPipelineLayout> _pipelineLayout;
+  VkDeviceChild<VkPipelineCache, vkDestroyPipelineCache> _pipelineCache;
+  size_t _loadedPipelineCacheSize = 0;
+  std::unique_ptr<PipelineVariants> _tracePipelines;  // Graphics or compute, one per quality preset
+  VkPipeline _tracePipeline = VK_NULL_HANDLE;  // Variant of the frame being recorded
+  std::mutex _reloadMutex;
+  std::unique_ptr<PipelineVariants> _reloadedTracePipelines;  // Built by the shader watcher, guarded by _reloadMutex
+  std::unique_ptr<ShaderWatcher> _shaderWatcher;
+  VkDeviceChild<VkPipeline, vkDestroyPipeline> _upscalePipeline;
+  VkDeviceChild<VkPipeline, vkDestroyPipeline> _gbufferPipeline;
+  VkDeviceChild<VkPipeline, vkDestroyPipeline> _temporalPipeline;
+  std::vector<VkDeviceChild<VkPipeline, vkDestroyPipeline>> _atrousPipelines;  // One per iteration
+  std::vector<VkDeviceChild<VkFramebuffer, vkDestroyFramebuffer>> _swapChainFramebuffers;
+  VkDeviceChild<VkCommandPool, vkDestroyCommandPool> _commandPool;
+  VkDeviceChild<VkCommandPool, vkDestroyCommandPool> _computeCommandPool;  // Only with async compute
+  MemoryAllocation _accumulationImageMemory;
+  VkDeviceChild<VkImage, vkDestroyImage> _accumulationImage;
+  VkDeviceChild<VkImageView, vkDestroyImageView> _accumulationImageView;
+  // Squared luminance the adaptive sampler estimates the variance from, see tracer.glsl
+  static constexpr uint32_t kMeanSquaresBinding = 13;
+  MemoryAllocation _meanSquaresImageMemory;
+  VkDeviceChild<VkImage, vkDestroyImage> _meanSquaresImage;
+  VkDeviceChild<VkImageView, vkDestroyImageView> _meanSquaresImageView;
+  // Images the compute backend writes and the graphics queue blits from. With async compute there is one per frame in
+  // flight, so the next frame is traced while the last one is still read, otherwise a single one.
+  std::vector<MemoryAllocation> _outputImageMemory;
+  std::vector<VkDeviceChild<VkImage, vkDestroyImage>> _outputImages;
+  std::vector<VkDeviceChild<VkImageView, vkDestroyImageView>> _outputImageViews;
+  // Materials, spheres and BVH nodes, bound to consecutive bindings starting at kSceneBinding
+  static constexpr uint32_t kSceneBinding = 2;
+  // Target sized image the traced region of the output image is upscaled into with dynamic resolution
+  static constexpr uint32_t kUpscaledBinding = kSceneBinding + 3;
+  std::vector<MemoryAllocation> _upscaledImageMemory;
+  std::vector<VkDeviceChild<VkImage, vkDestroyImage>> _upscaledImages;
+  std::vector<VkDeviceChild<VkImageView, vkDestroyImageView>> _upscaledImageViews;
+  // Target sized images of the denoiser, bound to consecutive bindings starting at kDenoiseBinding in this order.
+  // They are only used by the compute queue, so a single set serves every frame in flight.
+  enum DenoiseImage : uint32_t {
+    kNormalDepthImage,
+    kAlbedoImage,
+    kPreviousNormalDepthImage,
+    kHistoryImage,
+    kPingImage,
+    kPongImage,
+    kDenoiseImageCount
+  };
+  static constexpr uint32_t kDenoiseBinding = kUpscaledBinding + 1;
+  static constexpr int kDenoiseIterations = 4;
+  std::vector<MemoryAllocation> _denoiseImageMemory;
+  std::vector<VkDeviceChild<VkImage, vkDestroyImage>> _denoiseImages;
+  std::vector<VkDeviceChild<VkImageView, vkDestroyImageView>> _denoiseImageViews;
+  bool _denoiseHistoryOutdated = true;  // Set while the history belongs to another resolution, the next frame clears it
+  std::vector<MemoryAllocation> _sceneBufferMemory;
+  std::vector<VkDeviceChild<VkBuffer, vkDestroyBuffer>> _sceneBuffers;
+  // Tiled blue noise the blue noise sampler shifts its points with, generated once at startup
+  static constexpr uint32_t kBlueNoiseBinding = kDenoiseBinding + kDenoiseImageCount;
+  MemoryAllocation _blueNoiseBufferMemory;
+  VkDeviceChild<VkBuffer, vkDestroyBuffer> _blueNoiseBuffer;
+  // One host visible counter of converged pixels per frame in flight, read and reset once its fence signaled
+  static constexpr uint32_t kConvergenceBinding = kMeanSquaresBinding + 1;
+  std::vector<MemoryAllocation> _convergenceBufferMemory;
+  std::vector<VkDeviceChild<VkBuffer, vkDestroyBuffer>> _convergenceBuffers;
+  uint32_t _convergedPixels = 0;
+  // Quantized mesh vertices behind their MeshHeader, and the mesh triangles. Both follow the sphere buffers in
+  // _sceneBuffers, the triangle BVH follows the sphere BVH in its buffer.
+  static constexpr uint32_t kMeshBinding = kConvergenceBinding + 1;
+  static constexpr uint32_t kSceneBufferBindings[] = {kSceneBinding, kSceneBinding + 1, kSceneBinding + 2, kMeshBinding,
+                                                      kMeshBinding + 1};
+  static constexpr uint32_t kSceneBufferCount = sizeof(kSceneBufferBindings) / sizeof(kSceneBufferBindings[0]);
+  // Its nodes are followed by padding up to its node capacity, so the mesh root stays put when it is rebuilt
+  std::unique_ptr<SphereBvh> _sphereBvh;
+  // Staging buffer of each frame in flight in the frame's transient arena, and the copies recorded from it
+  std::vector<VkDeviceChild<VkBuffer, vkDestroyBuffer>> _sceneUploadBuffers;
+  std::vector<VkBufferCopy> _sphereCopies;
+  std::vector<VkBufferCopy> _nodeCopies;
+  VkDeviceChild<VkDescriptorPool, vkDestroyDescriptorPool> _descriptorPool;
+  std::vector<VkDescriptorSet> _descriptorSets;  // One per frame in flight, so a frame never updates a set in use
+  std::vector<bool> _imageDescriptorsOutdated;
+  bool _storageImagesUndefined = true;  // Transitioned to the general layout by the next recorded frame
+  std::vector<VkCommandBuffer> _commandBuffers;  // One per frame in flight, re-recorded when the frame is drawn
+  std::vector<VkCommandBuffer> _computeCommandBuffers;  // Likewise, only with async compute
+  std::vector<bool> _frameImagesReleased;  // Whether the graphics queue handed the frame's images back to compute
+  std::vector<MemoryAllocation> _readbackBufferMemory;
+  std::vector<VkDeviceChild<VkBuffer, vkDestroyBuffer>> _readbackBuffers;
+  // Ring of persistently mapped staging buffers every drawn frame is copied to for the capture writer. A slot is only
+  // reallocated while the writer hands it out as free, when neither the GPU nor the writer uses it.
+  std::unique_ptr<CaptureWriter> _captureWriter;
+  std::vector<MemoryAllocation> _captureBufferMemory;
+  std::vector<VkDeviceChild<VkBuffer, vkDestroyBuffer>> _captureBuffers;
+  std::vector<int64_t> _frameCaptureSlots;  // Slot each frame in flight copies to, -1 for none
+  std::vector<VkExtent2D> _frameCaptureExtents;
+  bool _captureBgra = false;
+  std::vector<VkDeviceChild<VkSemaphore, vkDestroySemaphore>> _imageAvailableSemaphores;
+  std::vector<VkDeviceChild<VkSemaphore, vkDestroySemaphore>> _renderFinishedSemaphores;
+  // With async compute: the graphics submission waits for the trace, the next compute submission of the frame for the
+  // images to be handed back
+  std::vector<VkDeviceChild<VkSemaphore, vkDestroySemaphore>> _traceFinishedSemaphores;
+  std::vector<VkDeviceChild<VkSemaphore, vkDestroySemaphore>> _imagesReleasedSemaphores;
+  std::vector<bool> _imagesReleasedPending;  // Whether the semaphore above was signaled and not waited on yet
+  std::vector<VkDeviceChild<VkFence, vkDestroyFence>> _inFlightFences;
   std::vector<VkFence> _imagesInFlight;
   size_t _currentFrame = 0;
-  Camera _pushConstant;
+  uint32_t _lastImageIndex = 0;
+  PushConstants _pushConstant{};
+  std::unique_ptr<GpuProfiler> _profiler;
+  std::vector<FrameScheduler::Clock::time_point> _frameInputTimes;  // Per frame in flight, until its fence signals
+  LatencyStatistics _latency;
+  bool _framebufferResized = false;
+  bool _swapChainOutdated = false;  // Set while the window is minimized and no swap chain can be created
+  std::unique_ptr<ResolutionController> _resolutionController;  // Only with dynamic resolution
+  VkExtent2D _traceExtent{};
+  std::vector<float> _frameScales;  // Resolution scale each frame in flight was traced at
 };